@@ -1,6 +1,11 @@
 #include "aot_codegen.h"
+#include <algorithm>
 #include <sstream>
 #include <cctype>
+#include <functional>
+#include <map>
+#include <set>
+#include <tuple>
 #include <unordered_set>
 
 namespace caps::aot {
@@ -27,6 +32,58 @@ static const char* cpp_type(TypeKind k) {
   return "/*unknown*/";
 }
 
+// suffix of the try_recv_* overload for a channel element type
+static const char* result_suffix(TypeKind k) {
+  switch (k) {
+    case TypeKind::I64: return "i64";
+    case TypeKind::Bool: return "bool";
+    case TypeKind::Text: return "text";
+    default: break;
+  }
+  throw std::runtime_error("AOT emitter: no Result type for try_receive on this element type");
+}
+
+static const ChannelDecl& channel_decl(const Group& g, const std::string& name) {
+  for (auto& c : g.channels) {
+    if (c.name == name) return c;
+  }
+  throw std::runtime_error("unknown channel: " + name);
+}
+
+// Receiving end of an unbuffered channel: the process's mailbox for it.
+static std::string mailbox(const std::string& chan) { return "__mb_" + ident(chan); }
+
+static void for_each_action_list(const Process& p, const std::function<void(const std::vector<Action>&)>& fn) {
+  for (auto& kv : p.states) {
+    fn(kv.second.actions);
+    fn(kv.second.tr.then_actions);
+    fn(kv.second.tr.else_actions);
+  }
+}
+
+// unbuffered channels p receives on; it has a mailbox for each
+static std::set<std::string> process_mailboxes(const Group& g, const Process& p) {
+  std::set<std::string> out;
+  for_each_action_list(p, [&](const std::vector<Action>& acts) {
+    for (auto& a : acts) {
+      if ((a.kind == Action::Kind::Receive || a.kind == Action::Kind::TryReceive) &&
+          channel_decl(g, a.chan).capacity == 0)
+        out.insert(a.chan);
+    }
+  });
+  return out;
+}
+
+static bool uses_rendezvous(const Group& g, const Process& p) {
+  bool any = false;
+  for_each_action_list(p, [&](const std::vector<Action>& acts) {
+    for (auto& a : acts) {
+      if (a.kind != Action::Kind::Assign && channel_decl(g, a.chan).capacity == 0) any = true;
+    }
+  });
+  return any;
+}
+
 static std::string lit_text(const std::string& s) {
   std::ostringstream os;
   os << "\"";
@@ -40,36 +97,38 @@ static std::string lit_text(const std::string& s) {
   return os.str();
 }
 
-static void emit_expr(std::ostringstream& o, const Expr& e);
+// `self` prefixes process members: empty inside step(), "__p2." where the
+// fused scheduler inlines a state body.
+static void emit_expr(std::ostringstream& o, const Expr& e, const std::string& self = "");
 
-static void emit_binop(std::ostringstream& o, const Expr& e) {
+static void emit_binop(std::ostringstream& o, const Expr& e, const std::string& self) {
   // assumes typechecked
   if (e.args.size() != 2) throw std::runtime_error("BinOp expects 2 args");
   o << "(";
-  emit_expr(o, e.args[0]);
+  emit_expr(o, e.args[0], self);
   o << " " << e.op << " ";
-  emit_expr(o, e.args[1]);
+  emit_expr(o, e.args[1], self);
   o << ")";
 }
 
-static void emit_expr(std::ostringstream& o, const Expr& e) {
+static void emit_expr(std::ostringstream& o, const Expr& e, const std::string& self) {
   using K = Expr::Kind;
   switch (e.kind) {
     case K::LitI64: o << e.i64; return;
     case K::LitBool: o << (e.b ? "true" : "false"); return;
     case K::LitF64: o << e.f64; return;
     case K::LitText: o << lit_text(e.text); return;
-    case K::Var: o << ident(e.var); return;
-    case K::BinOp: emit_binop(o, e); return;
+    case K::Var: o << self << ident(e.var); return;
+    case K::BinOp: emit_binop(o, e, self); return;
 
     case K::ResultOk:
-      o << "("; emit_expr(o, e.args.at(0)); o << ").ok";
+      o << "("; emit_expr(o, e.args.at(0), self); o << ").ok";
       return;
     case K::ResultValue:
-      o << "("; emit_expr(o, e.args.at(0)); o << ").value";
+      o << "("; emit_expr(o, e.args.at(0), self); o << ").value";
       return;
     case K::ResultError:
-      o << "("; emit_expr(o, e.args.at(0)); o << ").error";
+      o << "error_text(("; emit_expr(o, e.args.at(0), self); o << ").err)";
       return;
 
     case K::Call:
@@ -84,44 +143,185 @@ static void emit_expr(std::ostringstream& o, const Expr& e) {
   throw std::runtime_error("unknown Expr kind");
 }
 
-static void emit_action(std::ostringstream& o, const Action& a, const Group& g) {
+// Profile hooks of one state body (EmitOptions::instrument / ::profile).
+struct StateProf {
+  long counter = -1;           // its index in __caps_prof, -1: not instrumenting
+  const char* cond_hint = "";  // CAPS_LIKELY / CAPS_UNLIKELY on the transition condition
+  const char* block_hint = ""; // same on the tests for a blocked step
+};
+
+static std::string hinted(const char* hint, const std::string& cond) {
+  return *hint ? std::string(hint) + "(" + cond + ")" : cond;
+}
+
+static size_t channel_index(const Group& g, const std::string& name) {
+  for (size_t i = 0; i < g.channels.size(); i++) {
+    if (g.channels[i].name == name) return i;
+  }
+  throw std::runtime_error("unknown channel: " + name);
+}
+
+// A send or receive that blocks runs `leave`, which ends the step there: the
+// actions after it do not run, as exec_action stops at a blocked op, and the
+// next step of the process starts over in the same state.
+static void emit_action(std::ostringstream& o, const Action& a, const Group& g, const std::string& self,
+                        const StateProf& sp, const std::string& leave) {
   using K = Action::Kind;
-  auto dst = ident(a.dst);
+  auto dst = self + ident(a.dst);
   auto ch = ident(a.chan);
+  // unbuffered: senders that find no parked receiver park for good, and
+  // receivers park until a send hands them a value (see RendezvousChannel)
+  bool rendezvous = a.kind != K::Assign && channel_decl(g, a.chan).capacity == 0;
+  // what a blocked send / receive does
+  auto on_block = [&](const char* op, bool park) {
+    std::string s = "{";
+    if (park) s += " " + self + "parked = true;";
+    if (sp.counter >= 0) s += " ++__caps_prof." + std::string(op) + "_blocked[" + std::to_string(channel_index(g, a.chan)) + "];";
+    return s + " " + leave + " }";
+  };
 
   switch (a.kind) {
     case K::Assign: {
       o << "      " << dst << " = ";
-      emit_expr(o, a.expr);
+      emit_expr(o, a.expr, self);
       o << ";\n";
       return;
     }
     case K::Send: {
-      o << "      if (!channels." << ch << ".send(";
-      emit_expr(o, a.expr);
-      o << ")) { blocked = true; block_reason = \"send\"; }\n";
+      std::ostringstream call;
+      call << "!channels." << ch << ".send(";
+      emit_expr(call, a.expr, self);
+      call << ")";
+      o << "      if (" << hinted(sp.block_hint, call.str()) << ") " << on_block("send", rendezvous) << "\n";
       return;
     }
     case K::Receive: {
-      o << "      if (!channels." << ch << ".recv(" << dst << ")) { blocked = true; block_reason = \"recv\"; }\n";
+      if (rendezvous) {
+        auto mb = self + mailbox(a.chan);
+        std::string call = "!channels." + ch + ".recv(" + self + "kId, " + mb + ", " + mb + "_ready, " + self + "parked, " + dst + ")";
+        o << "      if (" << hinted(sp.block_hint, call) << ") " << on_block("recv", false) << "\n";
+        return;
+      }
+      o << "      if (" << hinted(sp.block_hint, "!channels." + ch + ".recv(" + dst + ")") << ") " << on_block("recv", false) << "\n";
       return;
     }
     case K::TrySend: {
       o << "      " << dst << " = channels." << ch << ".try_send(";
-      emit_expr(o, a.expr);
+      emit_expr(o, a.expr, self);
       o << ");\n";
       return;
     }
     case K::TryReceive: {
       // returns Result<T,text>
-      o << "      " << dst << " = channels." << ch << ".try_recv();\n";
+      o << "      " << dst << " = try_recv_" << result_suffix(channel_decl(g, a.chan).elem_type.kind) << "(channels." << ch;
+      if (rendezvous) o << ", " << self << mailbox(a.chan) << ", " << self << mailbox(a.chan) << "_ready";
+      o << ");\n";
       return;
     }
   }
 }
 
-static void emit_action_list(std::ostringstream& o, const std::vector<Action>& acts, const Group& g) {
-  for (auto& a : acts) emit_action(o, a, g);
+static void emit_action_list(std::ostringstream& o, const std::vector<Action>& acts, const Group& g,
+                             const std::string& self, const StateProf& sp, const std::string& leave) {
+  for (auto& a : acts) emit_action(o, a, g, self, sp, leave);
+}
+
+// How a state body leaves the step: a terminal state, an action that
+// blocked, a transition into state `to`.
+struct StepExits {
+  std::string self; // see emit_expr
+  std::vector<std::string> finish;
+  std::string blocked;
+  std::function<std::vector<std::string>(const std::string& to)> enter;
+};
+
+static void emit_lines(std::ostringstream& o, const char* indent, const std::vector<std::string>& lines) {
+  for (auto& l : lines) o << indent << l << "\n";
+}
+
+uint32_t burst_limit(const Group& g) {
+  for (auto& a : g.annotations) {
+    if (a.rfind("burst(", 0) != 0 || a.back() != ')') continue;
+    std::string k = a.substr(6, a.size() - 7);
+    // as sema checks it: one positive count of at most 9 digits
+    if (k.empty() || k.size() > 9 || k.find_first_not_of("0123456789") != std::string::npos || std::stoul(k) == 0)
+      throw std::runtime_error("invalid annotation: @" + a);
+    return (uint32_t)std::stoul(k);
+  }
+  return 1;
+}
+
+// A state can run in bursts if it loops back to itself and every action is
+// an assignment or a try op on a buffered channel: nothing in it can block,
+// and the only effects other processes see are the channel ops. Returns the
+// condition for running it again (every try_receive channel non-empty,
+// every try_send channel not full), "true" for a state without channel ops,
+// or empty if it cannot.
+static std::string burst_guard(const Group& g, const State& st) {
+  if (st.terminal) return "";
+  bool loops = st.tr.kind == Transition::Kind::Goto ? st.tr.to_state == st.name
+                                                    : st.tr.then_state == st.name || st.tr.else_state == st.name;
+  if (!loops) return "";
+  std::set<std::string> guards;
+  for (auto* acts : {&st.actions, &st.tr.then_actions, &st.tr.else_actions}) {
+    for (auto& a : *acts) {
+      if (a.kind == Action::Kind::Assign) continue;
+      if (a.kind != Action::Kind::TrySend && a.kind != Action::Kind::TryReceive) return "";
+      auto& ch = channel_decl(g, a.chan);
+      if (ch.capacity == 0) return "";
+      if (a.kind == Action::Kind::TryReceive) guards.insert("channels." + ident(ch.name) + ".size() != 0");
+      else guards.insert("channels." + ident(ch.name) + ".size() < " + std::to_string(ch.capacity));
+    }
+  }
+  std::string cond;
+  for (auto& c : guards) cond += (cond.empty() ? "" : " && ") + c;
+  return cond.empty() ? "true" : cond;
+}
+
+// With burst > 1, a state burst_guard accepts repeats in place, up to burst
+// times per step, while its guard holds.
+static void emit_state_body(std::ostringstream& o, const Group& g, const State& st, const StepExits& x,
+                            uint32_t burst = 1, const StateProf& sp = {}) {
+  const std::string counter = sp.counter >= 0 ? "[" + std::to_string(sp.counter) + "];" : "";
+  if (!counter.empty()) o << "        ++__caps_prof.entered" << counter << "\n";
+  if (st.terminal) {
+    emit_lines(o, "        ", x.finish);
+  }
+
+  std::string guard = burst > 1 ? burst_guard(g, st) : "";
+  auto enter = [&](const std::string& to) {
+    auto lines = x.enter(to);
+    if (!guard.empty() && to == st.name) {
+      lines.insert(lines.begin(), "if (__burst < " + std::to_string(burst) + (guard == "true" ? "" : " && " + guard) +
+                                      ") continue;");
+    }
+    return lines;
+  };
+  if (!guard.empty()) o << "        for (uint32_t __burst = 1;; ++__burst) {\n";
+
+  // a blocked op leaves without transition
+  std::string leave = counter.empty() ? x.blocked : "++__caps_prof.blocked" + counter + " " + x.blocked;
+
+  // state actions
+  emit_action_list(o, st.actions, g, x.self, sp, leave);
+
+  // transition
+  if (st.tr.kind == Transition::Kind::Goto) {
+    emit_lines(o, "        ", enter(st.tr.to_state));
+  } else {
+    std::ostringstream cond;
+    emit_expr(cond, st.tr.cond, x.self);
+    o << "        if (" << hinted(sp.cond_hint, cond.str()) << ") {\n";
+    if (!counter.empty()) o << "          ++__caps_prof.then_taken" << counter << "\n";
+    emit_action_list(o, st.tr.then_actions, g, x.self, sp, leave);
+    emit_lines(o, "          ", enter(st.tr.then_state));
+    o << "        } else {\n";
+    if (!counter.empty()) o << "          ++__caps_prof.else_taken" << counter << "\n";
+    emit_action_list(o, st.tr.else_actions, g, x.self, sp, leave);
+    emit_lines(o, "          ", enter(st.tr.else_state));
+    o << "        }\n";
+  }
+  if (!guard.empty()) o << "        }\n";
 }
 
 static std::vector<std::string> topo_states(const Process& p) {
@@ -138,135 +338,1196 @@ static std::vector<std::string> topo_states(const Process& p) {
   return out;
 }
 
-// AOT backend for new features
-void emit_match_expr(const MatchExpr& expr);
-void emit_array_expr(const ArrayExpr& expr);
-void emit_for_loop(const ForLoop& loop);
-void emit_const_fn(const ConstFnDecl& fn);
+static bool uses_len(const Expr& e) {
+  if (e.kind == Expr::Kind::Call && e.func_name == "len") return true;
+  for (auto& a : e.args) {
+    if (uses_len(a)) return true;
+  }
+  return false;
+}
 
-// Generate switch for match
-void emit_match_expr(const MatchExpr& expr) {
-  // Generate if-else chain or switch
+// ===== Profiles =====
+
+void read_profile(std::istream& in, Profile& into) {
+  std::string line;
+  size_t n = 0;
+  bool header = false;
+  auto bad = [&](const std::string& why) { return std::runtime_error("profile line " + std::to_string(n) + ": " + why); };
+  while (std::getline(in, line)) {
+    n++;
+    std::istringstream ls(line);
+    std::string kind;
+    if (!(ls >> kind)) continue;
+    if (kind == "caps-profile") {
+      int version = 0;
+      std::string group;
+      if (!(ls >> version >> group) || version != 1) throw bad("unsupported header");
+      if (!into.group.empty() && into.group != group) throw bad("profile of group " + group + ", not " + into.group);
+      into.group = group;
+      header = true;
+    } else if (!header) {
+      break;
+    } else if (kind == "state") {
+      std::string proc, state;
+      Profile::StateCounts c;
+      if (!(ls >> proc >> state >> c.entered >> c.then_taken >> c.else_taken >> c.blocked)) throw bad("malformed state");
+      auto& to = into.states[{proc, state}];
+      to.entered += c.entered;
+      to.then_taken += c.then_taken;
+      to.else_taken += c.else_taken;
+      to.blocked += c.blocked;
+    } else if (kind == "channel") {
+      std::string chan;
+      Profile::ChannelCounts c;
+      if (!(ls >> chan >> c.send_blocked >> c.recv_blocked)) throw bad("malformed channel");
+      auto& to = into.channels[chan];
+      to.send_blocked += c.send_blocked;
+      to.recv_blocked += c.recv_blocked;
+    } else {
+      throw bad("unknown record " + kind);
+    }
+  }
+  if (!header) throw std::runtime_error("profile: missing caps-profile header");
 }
 
-std::string emit_cpp(const Group& g, bool emit_main) {
-  std::ostringstream o;
+// CAPS_LIKELY / CAPS_UNLIKELY when `hits` out of `total` is skewed at least
+// 90/10 over enough samples to trust, otherwise no hint.
+static const char* skew_hint(uint64_t hits, uint64_t total) {
+  if (total < 16) return "";
+  if ((double)hits >= 0.9 * (double)total) return "CAPS_LIKELY";
+  if ((double)hits <= 0.1 * (double)total) return "CAPS_UNLIKELY";
+  return "";
+}
+
+// The StateProf of every state of a group, and the state order, for one
+// emit_cpp() call. Counter indices follow topo_states, process by process.
+struct GroupProf {
+  bool instrument = false;
+  const Profile* profile = nullptr;
+  std::map<std::pair<std::string, std::string>, long> counters; // (process, state)
+
+  GroupProf(const Group& g, const EmitOptions& opts) : instrument(!opts.instrument.empty()), profile(opts.profile) {
+    if (!instrument) return;
+    for (auto& p : g.processes) {
+      for (auto& sn : topo_states(p)) counters.emplace(std::make_pair(p.name, sn), (long)counters.size());
+    }
+  }
+
+  const Profile::StateCounts* counts(const std::string& proc, const std::string& state) const {
+    if (!profile) return nullptr;
+    auto it = profile->states.find({proc, state});
+    return it == profile->states.end() ? nullptr : &it->second;
+  }
+
+  StateProf at(const Process& p, const State& st) const {
+    StateProf sp;
+    if (instrument) sp.counter = counters.at({p.name, st.name});
+    if (auto* c = counts(p.name, st.name)) {
+      if (st.tr.kind == Transition::Kind::IfElse) sp.cond_hint = skew_hint(c->then_taken, c->then_taken + c->else_taken);
+      sp.block_hint = skew_hint(c->blocked, c->entered);
+    }
+    return sp;
+  }
+
+  // The order p's state bodies are laid out in: topo_states, or with a
+  // profile the most entered first. State numbering stays topo_states:
+  // renumbering by heat measured slower (it reshapes GCC's switch lowering).
+  std::vector<std::string> layout(const Process& p) const {
+    auto out = topo_states(p);
+    if (!profile) return out;
+    auto heat = [&](const std::string& sn) {
+      auto* c = counts(p.name, sn);
+      return c ? c->entered : 0;
+    };
+    std::stable_sort(out.begin(), out.end(), [&](const std::string& a, const std::string& b) { return heat(a) > heat(b); });
+    return out;
+  }
+};
+
+static void len_channels(const Expr& e, std::set<std::string>& out) {
+  if (e.kind == Expr::Kind::Call && e.func_name == "len" && e.args.size() == 1) out.insert(e.args[0].var);
+  for (auto& a : e.args) len_channels(a, out);
+}
+
+// every channel a step of p can touch
+static std::set<std::string> process_channels(const Process& p) {
+  std::set<std::string> out;
+  for_each_action_list(p, [&](const std::vector<Action>& acts) {
+    for (auto& a : acts) {
+      if (a.kind != Action::Kind::Assign) out.insert(a.chan);
+      len_channels(a.expr, out);
+    }
+  });
+  for (auto& kv : p.states) len_channels(kv.second.tr.cond, out);
+  return out;
+}
+
+// g.schedule with each step moved ahead of earlier adjacent steps of a
+// process that is entered less often in the profile and shares no channel
+// with it. Such steps touch disjoint state, so they commute: every tick ends
+// as before, and so do the completion and deadlock checks after it.
+static std::vector<std::string> hot_schedule(const Group& g, const Profile& prof) {
+  std::unordered_map<std::string, uint64_t> heat;
+  std::unordered_map<std::string, std::set<std::string>> chans;
+  for (auto& p : g.processes) {
+    chans[p.name] = process_channels(p);
+    for (auto& kv : p.states) {
+      auto it = prof.states.find({p.name, kv.first});
+      if (it != prof.states.end()) heat[p.name] += it->second.entered;
+    }
+  }
+  auto commute = [&](const std::string& a, const std::string& b) {
+    if (a == b) return false;
+    for (auto& c : chans[a]) {
+      if (chans[b].count(c)) return false;
+    }
+    return true;
+  };
+  auto out = g.schedule;
+  for (size_t i = 1; i < out.size(); i++) {
+    for (size_t j = i; j > 0 && heat[out[j]] > heat[out[j - 1]] && commute(out[j - 1], out[j]); j--) {
+      std::swap(out[j - 1], out[j]);
+    }
+  }
+  return out;
+}
+
+// __caps_prof: the counters of an instrumented program and the destructor
+// that writes them to `path` at exit, in the format read_profile reads.
+static void emit_profile_counters(std::ostringstream& o, const Group& g, const GroupProf& gp, const std::string& path) {
+  std::vector<std::string> names(gp.counters.size());
+  for (auto& kv : gp.counters) names[kv.second] = kv.first.first + " " + kv.first.second;
+  const size_t states = std::max<size_t>(1, names.size());
+  const size_t chans = std::max<size_t>(1, g.channels.size());
+
+  o << "#include <cstdio>\n\n";
+  o << "static struct CapsProfile {\n";
+  o << "  uint64_t entered[" << states << "] = {};\n";
+  o << "  uint64_t then_taken[" << states << "] = {};\n";
+  o << "  uint64_t else_taken[" << states << "] = {};\n";
+  o << "  uint64_t blocked[" << states << "] = {};\n";
+  o << "  uint64_t send_blocked[" << chans << "] = {};\n";
+  o << "  uint64_t recv_blocked[" << chans << "] = {};\n\n";
+  o << "  ~CapsProfile() {\n";
+  o << "    static const char* const states[] = {";
+  for (size_t i = 0; i < names.size(); i++) o << (i ? ", " : "") << lit_text(names[i]);
+  o << (names.empty() ? "nullptr" : "") << "};\n";
+  o << "    static const char* const chans[] = {";
+  for (size_t i = 0; i < g.channels.size(); i++) o << (i ? ", " : "") << lit_text(g.channels[i].name);
+  o << (g.channels.empty() ? "nullptr" : "") << "};\n";
+  o << "    FILE* f = std::fopen(" << lit_text(path) << ", \"w\");\n";
+  o << "    if (!f) return;\n";
+  o << "    std::fprintf(f, \"caps-profile 1 %s\\n\", " << lit_text(g.name) << ");\n";
+  o << "    for (size_t i = 0; i < " << names.size() << "; i++)\n";
+  o << "      std::fprintf(f, \"state %s %llu %llu %llu %llu\\n\", states[i], (unsigned long long)entered[i],\n";
+  o << "                   (unsigned long long)then_taken[i], (unsigned long long)else_taken[i], (unsigned long long)blocked[i]);\n";
+  o << "    for (size_t i = 0; i < " << g.channels.size() << "; i++)\n";
+  o << "      std::fprintf(f, \"channel %s %llu %llu\\n\", chans[i], (unsigned long long)send_blocked[i],\n";
+  o << "                   (unsigned long long)recv_blocked[i]);\n";
+  o << "    std::fclose(f);\n";
+  o << "  }\n";
+  o << "} __caps_prof;\n\n";
+}
+
+namespace {
+
+struct Endpoints {
+  const Process* writer = nullptr;
+  const Process* reader = nullptr;
+};
+
+} // namespace
+
+// `first` is false when a blocked op in this list would repeat effects from
+// earlier in the step (the state actions before a then/else list).
+static std::string scan_actions(const Group& g, const Process& p, const std::vector<Action>& acts, bool first,
+                                std::unordered_map<std::string, Endpoints>& ends) {
+  using K = Action::Kind;
+  for (size_t i = 0; i < acts.size(); i++) {
+    auto& a = acts[i];
+    if (uses_len(a.expr)) return "len() of a channel";
+    if (a.kind == K::Assign) continue;
+    if (a.kind == K::TrySend || a.kind == K::TryReceive) return "try_send/try_receive on '" + a.chan + "'";
+    if (channel_decl(g, a.chan).capacity == 0) return "rendezvous channel '" + a.chan + "'";
+    if (i != 0 || !first)
+      return "process '" + p.name + "': a send/receive on '" + a.chan + "' does not open its state";
+
+    bool send = a.kind == K::Send;
+    const Process*& end = send ? ends[a.chan].writer : ends[a.chan].reader;
+    if (end && end != &p) return "channel '" + a.chan + "' has more than one " + (send ? "writer" : "reader");
+    end = &p;
+  }
+  return "";
+}
+
+std::string threads_ineligible_reason(const Group& g) {
+  if (std::find(g.annotations.begin(), g.annotations.end(), "pipeline_safe") == g.annotations.end())
+    return "group is not @pipeline_safe";
+  if (g.schedule.empty()) return "empty schedule";
+
+  std::unordered_map<std::string, Endpoints> ends;
+  for (auto& p : g.processes) {
+    for (auto& kv : p.states) {
+      auto& st = kv.second;
+      std::string why = scan_actions(g, p, st.actions, true, ends);
+      if (why.empty() && st.tr.kind == Transition::Kind::IfElse) {
+        if (uses_len(st.tr.cond)) why = "len() of a channel";
+        if (why.empty()) why = scan_actions(g, p, st.tr.then_actions, st.actions.empty(), ends);
+        if (why.empty()) why = scan_actions(g, p, st.tr.else_actions, st.actions.empty(), ends);
+      }
+      if (!why.empty()) return why;
+    }
+  }
+  for (auto& ch : g.channels) {
+    auto it = ends.find(ch.name);
+    if (it != ends.end() && it->second.writer && it->second.writer == it->second.reader)
+      return "channel '" + ch.name + "' is written and read by the same process";
+  }
+  return "";
+}
+
+namespace {
+
+// Abstract run of one process against one channel `chan`: its occupancy is
+// tracked exactly, as is ok() of a result just taken from it by try_receive;
+// everything else (other conditions, ops on other channels) may go either
+// way. Used by fuse_channels to prove that every send finds the channel
+// empty.
+struct Occupancy {
+  const std::string& chan;
+  uint32_t capacity;
+  bool may_park;       // uses a rendezvous channel: a step may do nothing
+  bool unsafe = false; // a send could find the channel non-empty
+
+  using Config = std::pair<std::string, uint32_t>; // state, occupancy
+  using Known = std::map<std::string, bool>;       // result var -> ok()
+  using Done = std::function<void(uint32_t, const Known&)>;
+
+  // Runs acts[i..]; done(occ, known) for each way the list completes,
+  // blocked outcomes (state unchanged) go straight to out.
+  void run(const std::vector<Action>& acts, uint32_t occ, Known known, const std::string& state,
+           std::set<Config>& out, const Done& done) {
+    using K = Action::Kind;
+    for (auto& a : acts) {
+      if (!a.dst.empty()) known.erase(a.dst);
+      if (a.kind == K::Assign) continue;
+      if (a.chan != chan) {
+        if (a.kind == K::Send || a.kind == K::Receive) out.insert({state, occ}); // may block here
+        continue;
+      }
+      switch (a.kind) {
+        case K::Send:
+        case K::TrySend:
+          if (occ != 0) unsafe = true;
+          if (occ < capacity) occ++;
+          else if (a.kind == K::Send) { out.insert({state, occ}); return; }
+          break;
+        case K::Receive:
+          if (occ == 0) { out.insert({state, occ}); return; }
+          occ--;
+          break;
+        case K::TryReceive:
+          known[a.dst] = occ > 0;
+          if (occ > 0) occ--;
+          break;
+        case K::Assign:
+          break;
+      }
+    }
+    done(occ, known);
+  }
+
+  // 1 / 0 when cond is ok(r) (or compared with a bool literal) for a known
+  // r, -1 otherwise
+  static int decide(const Expr& cond, const Known& known) {
+    if (cond.kind == Expr::Kind::ResultOk && cond.args.size() == 1 && cond.args[0].kind == Expr::Kind::Var) {
+      auto it = known.find(cond.args[0].var);
+      return it == known.end() ? -1 : it->second;
+    }
+    if (cond.kind == Expr::Kind::BinOp && (cond.op == "==" || cond.op == "!=") && cond.args.size() == 2 &&
+        cond.args[1].kind == Expr::Kind::LitBool) {
+      int v = decide(cond.args[0], known);
+      if (v < 0) return -1;
+      return (v == (int)cond.args[1].b) == (cond.op == "==");
+    }
+    return -1;
+  }
+
+  // Every configuration one step of p can lead to; false for an unknown state.
+  bool step(const Process& p, const Config& c, std::set<Config>& out) {
+    auto it = p.states.find(c.first);
+    if (it == p.states.end()) return false;
+    auto& st = it->second;
+    if (st.terminal) { out.insert(c); return true; } // finished: no more effects
+    if (may_park) out.insert(c);
+    run(st.actions, c.second, {}, c.first, out, [&](uint32_t occ, const Known& known) {
+      if (st.tr.kind == Transition::Kind::Goto) {
+        out.insert({st.tr.to_state, occ});
+        return;
+      }
+      int taken = decide(st.tr.cond, known);
+      auto to = [&](const std::string& s) { return [&out, s](uint32_t o2, const Known&) { out.insert({s, o2}); }; };
+      if (taken != 0) run(st.tr.then_actions, occ, known, c.first, out, to(st.tr.then_state));
+      if (taken != 1) run(st.tr.else_actions, occ, known, c.first, out, to(st.tr.else_state));
+    });
+    return true;
+  }
+};
+
+} // namespace
+
+static void channel_ends(const Group& g, const std::string& chan, std::vector<const Process*>& writers,
+                         std::vector<const Process*>& readers) {
+  for (auto& p : g.processes) {
+    bool w = false, r = false;
+    for_each_action_list(p, [&](const std::vector<Action>& acts) {
+      for (auto& a : acts) {
+        if (a.kind == Action::Kind::Assign || a.chan != chan) continue;
+        if (a.kind == Action::Kind::Send || a.kind == Action::Kind::TrySend) w = true;
+        else r = true;
+      }
+    });
+    if (w) writers.push_back(&p);
+    if (r) readers.push_back(&p);
+  }
+}
+
+// Explores (writer state, reader state, occupancy) tick by tick through the
+// writer's and reader's schedule slots until nothing new turns up.
+static bool one_in_flight(const Group& g, const ChannelDecl& ch, const Process& w, const Process& r) {
+  if (ch.capacity == 1) return true; // a ring of one slot is a slot
+  if (burst_limit(g) > 1) return false; // the runs below take one iteration per step
+  Occupancy wo{ch.name, ch.capacity, uses_rendezvous(g, w)};
+  Occupancy ro{ch.name, ch.capacity, uses_rendezvous(g, r)};
+
+  struct Config {
+    std::string w, r;
+    uint32_t occ;
+    bool operator<(const Config& o) const { return std::tie(w, r, occ) < std::tie(o.w, o.r, o.occ); }
+  };
+  const size_t kMaxConfigs = 100000;
+  std::set<Config> seen{{w.initial_state, r.initial_state, 0}};
+  std::vector<Config> todo(seen.begin(), seen.end());
+  while (!todo.empty()) {
+    std::set<Config> cur{todo.back()};
+    todo.pop_back();
+    for (auto& slot : g.schedule) {
+      if (slot != w.name && slot != r.name) continue;
+      bool writer = slot == w.name;
+      std::set<Config> next;
+      for (auto& c : cur) {
+        std::set<Occupancy::Config> out;
+        Occupancy& o = writer ? wo : ro;
+        if (!o.step(writer ? w : r, {writer ? c.w : c.r, c.occ}, out)) return false;
+        if (o.unsafe) return false;
+        for (auto& x : out) next.insert(writer ? Config{x.first, c.r, x.second} : Config{c.w, x.first, x.second});
+      }
+      cur.swap(next);
+    }
+    for (auto& c : cur) {
+      if (seen.insert(c).second) todo.push_back(c);
+    }
+    if (seen.size() > kMaxConfigs) return false;
+  }
+  return true;
+}
+
+std::vector<std::string> fuse_channels(Group& g) {
+  std::vector<std::string> fused;
+  for (auto& ch : g.channels) {
+    if (ch.capacity == 0 || ch.direct) continue;
+    std::vector<const Process*> writers, readers;
+    channel_ends(g, ch.name, writers, readers);
+    if (writers.size() != 1 || readers.size() != 1 || writers[0] == readers[0]) continue;
+    if (!one_in_flight(g, ch, *writers[0], *readers[0])) continue;
+    ch.direct = true;
+    fused.push_back(ch.name);
+  }
+  return fused;
+}
+
+// Runtime of the threaded main: worker loop and quiescence detection.
+static const char* kThreadedRuntime =
+R"(#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+static inline void cpu_relax() { _mm_pause(); }
+#elif defined(__x86_64__) || defined(__i386__)
+static inline void cpu_relax() { __builtin_ia32_pause(); }
+#elif defined(__aarch64__)
+static inline void cpu_relax() { __asm__ __volatile__("yield"); }
+#else
+static inline void cpu_relax() {}
+#endif
+
+static void pin_to_cpu(unsigned cpu) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)cpu;
+#endif
+}
+
+// Global quiescence. A worker that finds nothing to do spins, then yields,
+// then announces itself idle, sweeps once more and parks. A worker that moves
+// something while anyone is idle bumps epoch, which wakes every parked worker
+// and restarts the park count. The fence after a moving sweep pairs with the
+// idle announcement: a push is either seen by that last sweep or followed by
+// a wake. So once every worker is parked (or retired: all its processes
+// finished) with no wake in between, no process can move again.
+struct Quiescence {
+  explicit Quiescence(uint32_t n) : workers(n) {}
+
+  const uint32_t workers;
+  alignas(64) std::atomic<uint32_t> idle{0};
+  alignas(64) std::atomic<uint64_t> epoch{0};
+  std::atomic<bool> stop{false};
+  std::atomic<bool> exceeded{false};
+  std::mutex mu;
+  std::condition_variable cv;
+  uint32_t parked = 0;  // since the last wake, under mu
+  uint32_t retired = 0; // under mu
+
+  // after a sweep that moved something
+  void moved() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle.load(std::memory_order_relaxed) != 0) wake();
+  }
+
+  void wake() {
+    std::lock_guard<std::mutex> lk(mu);
+    epoch.fetch_add(1, std::memory_order_relaxed);
+    parked = 0;
+    cv.notify_all();
+  }
+
+  void exceed() {
+    exceeded.store(true, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lk(mu);
+    halt();
+  }
+
+  void retire() {
+    std::lock_guard<std::mutex> lk(mu);
+    if (parked + ++retired == workers) halt();
+  }
+
+  // True once the run is over; false when woken by progress.
+  bool park(uint64_t seen) {
+    std::unique_lock<std::mutex> lk(mu);
+    if (stop.load(std::memory_order_relaxed)) return true;
+    if (epoch.load(std::memory_order_relaxed) != seen) return false;
+    if (++parked + retired == workers) {
+      halt();
+      return true;
+    }
+    cv.wait(lk, [&] {
+      return stop.load(std::memory_order_relaxed) || epoch.load(std::memory_order_relaxed) != seen;
+    });
+    return stop.load(std::memory_order_relaxed);
+  }
+
+private:
+  void halt() { // under mu
+    stop.store(true, std::memory_order_relaxed);
+    cv.notify_all();
+  }
+};
+
+static constexpr unsigned kSpinSweeps = 256;
+static constexpr unsigned kYieldSweeps = 64;
+
+// sweep() steps the worker's processes once and says whether any moved;
+// done() says whether all of them have finished. Spinning only pays while
+// the other workers have cores of their own.
+template <typename Sweep, typename Done>
+static void run_worker(Quiescence& q, Sweep& sweep, Done& done, unsigned spin) {
+  for (unsigned quiet = 0; !q.stop.load(std::memory_order_relaxed);) {
+    if (sweep()) {
+      q.moved();
+      quiet = 0;
+      continue;
+    }
+    if (done()) {
+      q.retire();
+      return;
+    }
+    if (++quiet < spin) {
+      cpu_relax();
+      continue;
+    }
+    if (quiet < spin + kYieldSweeps) {
+      std::this_thread::yield();
+      continue;
+    }
+    uint64_t seen = q.epoch.load(std::memory_order_acquire);
+    q.idle.fetch_add(1, std::memory_order_seq_cst);
+    if (sweep()) {
+      q.idle.fetch_sub(1, std::memory_order_relaxed);
+      q.moved();
+    } else {
+      bool over = q.park(seen);
+      q.idle.fetch_sub(1, std::memory_order_relaxed);
+      if (over) return;
+    }
+    quiet = 0;
+  }
+}
+
+)";
+
+// main() for the threaded mode. Processes are split into contiguous runs of
+// their first appearance in the schedule, one run per worker; a worker steps
+// its own processes in schedule order. Blocked steps have no effects (see
+// threads_ineligible_reason) and each channel is a FIFO between two fixed
+// processes, so every process sees the messages, and ends in the state, of
+// the sequential run. The step budget is per process: MAX_TICKS times its
+// schedule slots, the most it can move in the sequential run.
+static void emit_threaded_main(std::ostringstream& o, const Group& g, unsigned threads) {
+  std::vector<std::string> order;
+  std::unordered_map<std::string, uint32_t> slots;
+  for (auto& s : g.schedule) {
+    if (slots[s]++ == 0) order.push_back(s);
+  }
+  uint32_t workers = std::max(1u, std::min<uint32_t>(threads, (uint32_t)order.size()));
+  std::unordered_map<std::string, uint32_t> part;
+  for (size_t k = 0; k < order.size(); k++) part[order[k]] = (uint32_t)(k * workers / order.size());
+
+  o << kThreadedRuntime;
+  o << "int main() {\n";
+  o << "  Channels channels;\n";
+  for (auto& p : g.processes) {
+    o << "  Proc_" << ident(p.name) << " " << ident(p.name) << ";\n";
+  }
+  o << "  const uint64_t MAX_TICKS = 1000000;\n";
+  o << "  Quiescence q(" << workers << ");\n\n";
+
+  for (uint32_t w = 0; w < workers; w++) {
+    std::vector<std::string> mine;
+    for (auto& s : order) {
+      if (part[s] == w) mine.push_back(s);
+    }
+    o << "  auto sweep" << w << " = [&";
+    for (auto& s : mine) o << ", steps_" << ident(s) << " = uint64_t(0)";
+    o << "]() mutable {\n";
+    o << "    bool moved = false;\n";
+    for (auto& s : g.schedule) {
+      if (part[s] != w) continue;
+      o << "    if (" << ident(s) << ".step(channels)) {\n";
+      o << "      moved = true;\n";
+      o << "      if (++steps_" << ident(s) << " > MAX_TICKS * " << slots[s] << ") q.exceed();\n";
+      o << "    }\n";
+    }
+    o << "    return moved;\n";
+    o << "  };\n";
+    o << "  auto done" << w << " = [&] { return ";
+    for (size_t i = 0; i < mine.size(); i++) o << (i ? " && " : "") << ident(mine[i]) << ".finished";
+    o << "; };\n";
+  }
+
+  // pin and spin only while every worker has a core of its own
+  o << "\n  const bool pin = std::thread::hardware_concurrency() >= " << workers << ";\n";
+  o << "  const unsigned spin = pin ? kSpinSweeps : 0;\n";
+  for (uint32_t w = 1; w < workers; w++) {
+    o << "  std::thread worker" << w << "([&] {\n";
+    o << "    if (pin) pin_to_cpu(" << w << ");\n";
+    o << "    run_worker(q, sweep" << w << ", done" << w << ", spin);\n";
+    o << "  });\n";
+  }
+  o << "  if (pin) pin_to_cpu(0);\n";
+  o << "  run_worker(q, sweep0, done0, spin);\n";
+  for (uint32_t w = 1; w < workers; w++) o << "  worker" << w << ".join();\n";
+
+  o << "\n  if (q.exceeded.load()) { std::cerr << \"MaxTicksExceeded\\n\"; return 2; }\n";
+  o << "  bool all_finished = true;\n";
+  for (auto& p : g.processes) {
+    o << "  all_finished = all_finished && " << ident(p.name) << ".finished;\n";
+  }
+  o << "  if (all_finished) { std::cout << \"Completed\\n\"; return 0; }\n";
+  o << "  std::cerr << \"Deadlock\\n\";\n";
+  o << "  return 2;\n";
+  o << "}\n";
+}
+
+// main() for the fused mode: one run_group() that inlines the static
+// schedule. The processes' members are copied into locals for the run (so
+// the compiler can keep them in registers) and written back when it ends.
+// Each schedule slot gets its own copy of the process's state bodies behind
+// labels, dispatched by a switch of gotos or, with -DCAPS_COMPUTED_GOTO=1, a
+// computed goto; nothing is declared in a slot ahead of a label, so no jump
+// skips an initialization. __done has a bit per process (word pi / 64,
+// bit pi % 64) set when it finishes; __moved gets the same bit on every
+// transition, and only its being nonzero matters.
+static void emit_fused_main(std::ostringstream& o, const Group& g, const GroupProf& gp) {
+  const uint32_t burst = burst_limit(g);
+  const size_t words = std::max<size_t>(1, (g.processes.size() + 63) / 64);
+  std::unordered_map<std::string, size_t> index;
+  for (size_t pi = 0; pi < g.processes.size(); pi++) index[g.processes[pi].name] = pi;
+  auto bit = [](size_t pi) {
+    std::ostringstream b;
+    b << "0x" << std::hex << (uint64_t(1) << (pi % 64)) << "ull";
+    return b.str();
+  };
+  auto done_word = [](size_t pi) { return "__done[" + std::to_string(pi / 64) + "]"; };
 
   o <<
-R"(// AUTO-GENERATED by CAPS AOT backend
-// Build example (MSVC):
-//   cl /std:c++17 /O2 /EHsc generated.cpp
-// Run:
-//   generated.exe
-#include <cstdint>
+R"(// Computed-goto dispatch is opt-in (-DCAPS_COMPUTED_GOTO=1, GCC/Clang): GCC
+// threads the switch through the constant state stores into direct jumps,
+// which measures faster than an indirect jump per step.
+#ifndef CAPS_COMPUTED_GOTO
+#define CAPS_COMPUTED_GOTO 0
+#endif
+#if CAPS_COMPUTED_GOTO && !(defined(__GNUC__) || defined(__clang__))
+#undef CAPS_COMPUTED_GOTO
+#define CAPS_COMPUTED_GOTO 0
+#endif
+
+)";
+  o << "static int run_group(Channels& channels";
+  for (size_t pi = 0; pi < g.processes.size(); pi++) {
+    o << ", Proc_" << ident(g.processes[pi].name) << "& __p" << pi;
+  }
+  o << ") {\n";
+
+  // members -> locals, in the order written back
+  std::vector<std::pair<std::string, std::string>> members; // process, member
+  for (size_t pi = 0; pi < g.processes.size(); pi++) {
+    auto& p = g.processes[pi];
+    std::string self = "__p" + std::to_string(pi);
+    std::vector<std::string> names{"state"};
+    for (auto& lv : p.locals) names.push_back(ident(lv.first));
+    if (uses_rendezvous(g, p)) {
+      names.push_back("parked");
+      auto boxes = process_mailboxes(g, p);
+      for (auto& c : boxes) {
+        names.push_back(mailbox(c));
+        names.push_back(mailbox(c) + "_ready");
+      }
+      // only receivers park, and recv() is what takes the id
+      if (!boxes.empty()) o << "  const uint32_t " << self << "_kId = Proc_" << ident(p.name) << "::kId;\n";
+    }
+    for (auto& n : names) {
+      o << "  auto " << self << "_" << n << " = std::move(" << self << "." << n << ");\n";
+      members.emplace_back(self, n);
+    }
+  }
+  o << "  uint64_t __done[" << words << "] = {};\n";
+  for (size_t pi = 0; pi < g.processes.size(); pi++) {
+    o << "  if (__p" << pi << ".finished) " << done_word(pi) << " |= " << bit(pi) << ";\n";
+  }
+  o << "  int __rc = 2;\n";
+  o << "  const uint64_t MAX_TICKS = 1000000;\n";
+  o << "  for (uint64_t __tick = 0; __tick < MAX_TICKS; ++__tick) {\n";
+  o << "    uint64_t __moved = 0;\n";
+
+  for (size_t k = 0; k < g.schedule.size(); k++) {
+    size_t pi = index.at(g.schedule[k]);
+    auto& p = g.processes[pi];
+    std::string self = "__p" + std::to_string(pi) + "_";
+    std::string slot = "__s" + std::to_string(k) + "_";
+    std::string end = slot + "end";
+    std::string st_type = "Proc_" + ident(p.name) + "::State";
+    auto ordered = topo_states(p);
+
+    o << "    { // " << p.name << "\n";
+    o << "      if ((" << done_word(pi) << " & " << bit(pi) << ")" << (uses_rendezvous(g, p) ? " || " + self + "parked" : "")
+      << ") goto " << end << ";\n";
+    o << "#if CAPS_COMPUTED_GOTO\n";
+    o << "      static void* const targets[] = {";
+    for (size_t i = 0; i < ordered.size(); i++) o << (i ? ", " : "") << "&&" << slot << ident(ordered[i]);
+    o << "};\n";
+    o << "      goto *targets[(int)" << self << "state];\n";
+    o << "#else\n";
+    o << "      switch (" << self << "state) {\n";
+    for (auto& sn : ordered) o << "        case " << st_type << "::" << ident(sn) << ": goto " << slot << ident(sn) << ";\n";
+    o << "      }\n";
+    o << "#endif\n";
+
+    StepExits exits;
+    exits.self = self;
+    exits.finish = {done_word(pi) + " |= " + bit(pi) + ";", "__moved |= " + bit(pi) + ";", "goto " + end + ";"};
+    exits.blocked = "goto " + end + ";";
+    exits.enter = [&](const std::string& to) {
+      return std::vector<std::string>{self + "state = " + st_type + "::" + ident(to) + ";", "__moved |= " + bit(pi) + ";",
+                                      "goto " + end + ";"};
+    };
+    for (auto& sn : gp.layout(p)) {
+      auto it = p.states.find(sn);
+      if (it == p.states.end()) throw std::runtime_error("missing state: " + sn);
+      o << "      " << slot << ident(sn) << ": {\n";
+      emit_state_body(o, g, it->second, exits, burst, gp.at(p, it->second));
+      o << "      }\n";
+    }
+    o << "      " << end << ":;\n";
+    o << "    }\n";
+  }
+
+  o << "    if (";
+  for (size_t w = 0; w < words; w++) {
+    size_t n = std::min<size_t>(64, g.processes.size() - std::min(g.processes.size(), w * 64));
+    std::ostringstream m;
+    m << "0x" << std::hex << (n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1) << "ull";
+    o << (w ? " && " : "") << "__done[" << w << "] == " << m.str();
+  }
+  o << ") { std::cout << \"Completed\\n\"; __rc = 0; goto __exit; }\n";
+  o << "    if (!__moved) { std::cerr << \"Deadlock\\n\"; goto __exit; }\n";
+  o << "  }\n";
+  o << "  std::cerr << \"MaxTicksExceeded\\n\";\n";
+  o << "__exit:\n";
+  for (size_t pi = 0; pi < g.processes.size(); pi++) {
+    o << "  __p" << pi << ".finished = (" << done_word(pi) << " & " << bit(pi) << ") != 0;\n";
+  }
+  for (auto& m : members) {
+    o << "  " << m.first << "." << m.second << " = std::move(" << m.first << "_" << m.second << ");\n";
+  }
+  o << "  return __rc;\n";
+  o << "}\n\n";
+
+  o << "int main() {\n";
+  o << "  Channels channels;\n";
+  for (auto& p : g.processes) {
+    o << "  Proc_" << ident(p.name) << " " << ident(p.name) << ";\n";
+  }
+  o << "  return run_group(channels";
+  for (auto& p : g.processes) o << ", " << ident(p.name);
+  o << ");\n";
+  o << "}\n";
+}
+
+// Everything the generated code uses besides the group itself: includes,
+// Result types, Ring and the channel types. Thread support and SpscChannel
+// only with threaded, SlotChannel only with slots.
+static void emit_prelude(std::ostringstream& o, bool threaded, bool slots) {
+  o <<
+R"(#include <cstdint>
+#include <cstring>
 #include <string>
 #include <iostream>
+#include <type_traits>
 #include <utility>
-
 )";
+  if (threaded) {
+    o <<
+R"(#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+)";
+  }
+  o << "\n";
 
-  // Result structs (typed, no variant)
+  // Result structs (typed, no variant). Errors are interned codes, as in the
+  // interpreter's Value::err: making or failing a Result never allocates, and
+  // error(r) turns the code into text only where the program reads it (e.g.
+  // the assignment to __last_error on the error path).
   o <<
-R"(struct Result_bool_text { bool ok; bool value; std::string error; };
-struct Result_i64_text  { bool ok; int64_t value; std::string error; };
-struct Result_text_text { bool ok; std::string value; std::string error; };
+R"(static constexpr uint32_t kErrNone = 0;
+static constexpr uint32_t kErrEmpty = 1; // built-in channel error "empty"
+static const char* const kErrorText[] = {"", "empty"};
+
+static inline std::string error_text(uint32_t code){ return kErrorText[code]; }
 
-static inline Result_bool_text OkBool(bool v){ return {true, v, ""}; }
-static inline Result_bool_text ErrBool(std::string e){ return {false, false, std::move(e)}; }
+struct Result_bool_text { bool ok; bool value; uint32_t err; };
+struct Result_i64_text  { bool ok; int64_t value; uint32_t err; };
+struct Result_text_text { bool ok; std::string value; uint32_t err; };
 
-static inline Result_i64_text OkI64(int64_t v){ return {true, v, ""}; }
-static inline Result_i64_text ErrI64(std::string e){ return {false, 0, std::move(e)}; }
+static inline Result_bool_text OkBool(bool v){ return {true, v, kErrNone}; }
+static inline Result_bool_text ErrBool(uint32_t e){ return {false, false, e}; }
 
-static inline Result_text_text OkText(std::string v){ return {true, std::move(v), ""}; }
-static inline Result_text_text ErrText(std::string e){ return {false, "", std::move(e)}; }
+static inline Result_i64_text OkI64(int64_t v){ return {true, v, kErrNone}; }
+static inline Result_i64_text ErrI64(uint32_t e){ return {false, 0, e}; }
+
+static inline Result_text_text OkText(std::string v){ return {true, std::move(v), kErrNone}; }
+static inline Result_text_text ErrText(uint32_t e){ return {false, std::string(), e}; }
 
 )";
 
-  // Ring buffer + channels
+  // Ring buffer + channels. Each channel instantiates Ring for its element
+  // type and capacity: storage rounds up to a power of two (index = counter
+  // & mask), and bulk transfers memcpy when the element is trivially copyable.
   o <<
-R"(template <typename T, uint32_t N>
+R"(static constexpr uint32_t ring_slots(uint32_t n) {
+  uint32_t s = 1;
+  while (s < n) s <<= 1;
+  return s;
+}
+
+template <typename T, uint32_t N>
 struct Ring {
   static_assert(N > 0, "Ring size must be > 0");
-  T buf[N];
-  uint32_t head = 0;
-  uint32_t tail = 0;
-  uint32_t size = 0;
-
-  bool push(const T& v) {
-    if (size >= N) return false;
-    buf[tail] = v;
-    tail = (tail + 1) % N;
-    size++;
+  static constexpr uint32_t Slots = ring_slots(N);
+  static constexpr uint64_t Mask = Slots - 1;
+
+  // Free-running counters: size is tail - head. The receiver only moves head
+  // and the sender only moves tail, so they live on separate cache lines.
+  alignas(64) uint64_t head = 0;
+  alignas(64) uint64_t tail = 0;
+  alignas(64) T buf[Slots];
+
+  uint32_t size() const { return (uint32_t)(tail - head); }
+  bool empty() const { return head == tail; }
+  bool full() const { return tail - head >= N; }
+
+  bool push(T&& v) {
+    if (full()) return false;
+    buf[tail & Mask] = std::move(v);
+    tail++;
     return true;
   }
+  bool push(const T& v) { return push(T(v)); }
 
   bool pop(T& out) {
-    if (size == 0) return false;
-    out = buf[head];
-    head = (head + 1) % N;
-    size--;
+    if (empty()) return false;
+    out = std::move(buf[head & Mask]);
+    head++;
     return true;
   }
+
+  // Up to n elements, as many as fit / are buffered; returns the count. A
+  // run wraps at most once, so it is two contiguous segments.
+  uint32_t push_n(const T* src, uint32_t n) {
+    uint32_t room = N - size();
+    if (n > room) n = room;
+    uint32_t at = (uint32_t)(tail & Mask);
+    uint32_t first = n < Slots - at ? n : Slots - at;
+    copy(buf + at, src, first);
+    copy(buf, src + first, n - first);
+    tail += n;
+    return n;
+  }
+
+  uint32_t pop_n(T* dst, uint32_t n) {
+    if (n > size()) n = size();
+    uint32_t at = (uint32_t)(head & Mask);
+    uint32_t first = n < Slots - at ? n : Slots - at;
+    move(dst, buf + at, first);
+    move(dst + first, buf, n - first);
+    head += n;
+    return n;
+  }
+
+private:
+  static void copy(T* dst, const T* src, uint32_t n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      if (n) std::memcpy(dst, src, n * sizeof(T));
+    } else {
+      for (uint32_t i = 0; i < n; i++) dst[i] = src[i];
+    }
+  }
+  static void move(T* dst, T* src, uint32_t n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      if (n) std::memcpy(dst, src, n * sizeof(T));
+    } else {
+      for (uint32_t i = 0; i < n; i++) dst[i] = std::move(src[i]);
+    }
+  }
 };
 
 template <typename T, uint32_t N>
 struct ChannelBuf {
   Ring<T, N> q;
 
+  uint32_t size() const { return q.size(); }
+
+  bool send(T&& v) { return q.push(std::move(v)); }
   bool send(const T& v) { return q.push(v); }
   bool recv(T& out) { return q.pop(out); }
 
-  Result_bool_text try_send(const T& v) {
-    bool ok = q.push(v);
+  uint32_t send_n(const T* src, uint32_t n) { return q.push_n(src, n); }
+  uint32_t recv_n(T* dst, uint32_t n) { return q.pop_n(dst, n); }
+
+  Result_bool_text try_send(T v) {
+    bool ok = q.push(std::move(v));
     return OkBool(ok);
   }
 
   // try_recv returns Result<T,text> specialized by T below via overloads.
 };
 
+// Unbuffered channel, as the interpreter runs one: a send succeeds only if a
+// receiver is parked in recv(), and moves the value straight into that
+// receiver's mailbox (the lowest process index first). The receiver takes it
+// on its next step. P bounds the parked receivers (the group's processes).
+template <typename T, uint32_t P>
+struct RendezvousChannel {
+  struct Waiter {
+    uint32_t proc;
+    T* mailbox;
+    bool* ready;
+    bool* parked;
+  };
+  Waiter waiters[P]; // ascending proc
+  uint32_t nwaiters = 0;
+
+  uint32_t size() const { return 0; } // never holds a value
+
+  bool send(T v) {
+    if (nwaiters == 0) return false;
+    Waiter w = waiters[0];
+    for (uint32_t i = 1; i < nwaiters; i++) waiters[i - 1] = waiters[i];
+    nwaiters--;
+    *w.mailbox = std::move(v);
+    *w.ready = true;
+    *w.parked = false;
+    return true;
+  }
+
+  Result_bool_text try_send(T v) { return OkBool(send(std::move(v))); }
+
+  // Takes the handed-over value, or parks proc until a send delivers one.
+  bool recv(uint32_t proc, T& mailbox, bool& ready, bool& parked, T& out) {
+    if (ready) {
+      out = std::move(mailbox);
+      ready = false;
+      return true;
+    }
+    uint32_t i = nwaiters++;
+    for (; i > 0 && waiters[i - 1].proc > proc; i--) waiters[i] = waiters[i - 1];
+    waiters[i] = Waiter{proc, &mailbox, &ready, &parked};
+    parked = true;
+    return false;
+  }
+
+  static bool take(T& mailbox, bool& ready, T& out) {
+    if (!ready) return false;
+    out = std::move(mailbox);
+    ready = false;
+    return true;
+  }
+};
+
+)";
+
+  // Threaded mode: each channel has one sending and one receiving process,
+  // possibly on different workers. Same counters as Ring, published with
+  // release stores; each end caches the other's counter and reloads it
+  // (acquire) only when the cached value says full / empty.
+  if (threaded) {
+    o <<
+R"(template <typename T, uint32_t N>
+struct SpscChannel {
+  static_assert(N > 0, "SpscChannel size must be > 0");
+  static constexpr uint32_t Slots = ring_slots(N);
+  static constexpr uint64_t Mask = Slots - 1;
+
+  alignas(64) std::atomic<uint64_t> head{0}; // written by the receiver
+  uint64_t tail_seen = 0;                    // receiver's copy of tail
+  alignas(64) std::atomic<uint64_t> tail{0}; // written by the sender
+  uint64_t head_seen = 0;                    // sender's copy of head
+  alignas(64) T buf[Slots];
+
+  // a snapshot; exact only when both ends are idle
+  uint32_t size() const {
+    return (uint32_t)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+  }
+
+  bool send(T&& v) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    if (t - head_seen >= N) {
+      head_seen = head.load(std::memory_order_acquire);
+      if (t - head_seen >= N) return false;
+    }
+    buf[t & Mask] = std::move(v);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+  bool send(const T& v) { return send(T(v)); }
+
+  bool recv(T& out) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h == tail_seen) {
+      tail_seen = tail.load(std::memory_order_acquire);
+      if (h == tail_seen) return false;
+    }
+    out = std::move(buf[h & Mask]);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+};
+
 )";
+  }
+
+  if (slots) {
+    o <<
+R"(// A channel that never holds more than one message: a slot and a flag.
+template <typename T>
+struct SlotChannel {
+  T slot{};
+  bool full = false;
+
+  uint32_t size() const { return full ? 1 : 0; }
+
+  bool send(T&& v) {
+    if (full) return false;
+    slot = std::move(v);
+    full = true;
+    return true;
+  }
+  bool send(const T& v) { return send(T(v)); }
+
+  bool recv(T& out) {
+    if (!full) return false;
+    out = std::move(slot);
+    full = false;
+    return true;
+  }
+
+  Result_bool_text try_send(T v) { return OkBool(send(std::move(v))); }
+};
+
+static inline Result_i64_text try_recv_i64(SlotChannel<int64_t>& c){
+  int64_t v{};
+  if (!c.recv(v)) return ErrI64(kErrEmpty);
+  return OkI64(v);
+}
+static inline Result_bool_text try_recv_bool(SlotChannel<bool>& c){
+  bool v{};
+  if (!c.recv(v)) return ErrBool(kErrEmpty);
+  return OkBool(v);
+}
+static inline Result_text_text try_recv_text(SlotChannel<std::string>& c){
+  std::string v{};
+  if (!c.recv(v)) return ErrText(kErrEmpty);
+  return OkText(std::move(v));
+}
+
+)";
+  }
 
   // try_recv overloads per type
   o <<
 R"(template <uint32_t N> static inline Result_i64_text try_recv_i64(ChannelBuf<int64_t,N>& c){
   int64_t v{};
-  if (!c.recv(v)) return ErrI64("empty");
+  if (!c.recv(v)) return ErrI64(kErrEmpty);
   return OkI64(v);
 }
 template <uint32_t N> static inline Result_bool_text try_recv_bool(ChannelBuf<bool,N>& c){
   bool v{};
-  if (!c.recv(v)) return ErrBool("empty");
+  if (!c.recv(v)) return ErrBool(kErrEmpty);
   return OkBool(v);
 }
 template <uint32_t N> static inline Result_text_text try_recv_text(ChannelBuf<std::string,N>& c){
   std::string v{};
-  if (!c.recv(v)) return ErrText("empty");
+  if (!c.recv(v)) return ErrText(kErrEmpty);
+  return OkText(std::move(v));
+}
+template <uint32_t P> static inline Result_i64_text try_recv_i64(RendezvousChannel<int64_t,P>&, int64_t& mb, bool& ready){
+  int64_t v{};
+  if (!RendezvousChannel<int64_t,P>::take(mb, ready, v)) return ErrI64(kErrEmpty);
+  return OkI64(v);
+}
+template <uint32_t P> static inline Result_bool_text try_recv_bool(RendezvousChannel<bool,P>&, bool& mb, bool& ready){
+  bool v{};
+  if (!RendezvousChannel<bool,P>::take(mb, ready, v)) return ErrBool(kErrEmpty);
+  return OkBool(v);
+}
+template <uint32_t P> static inline Result_text_text try_recv_text(RendezvousChannel<std::string,P>&, std::string& mb, bool& ready){
+  std::string v{};
+  if (!RendezvousChannel<std::string,P>::take(mb, ready, v)) return ErrText(kErrEmpty);
   return OkText(std::move(v));
 }
 
 )";
+}
+
+std::string runtime_header() {
+  std::ostringstream o;
+  o << "// AUTO-GENERATED by CAPS AOT backend: runtime shared by the emitted groups\n";
+  o << "#ifndef CAPS_RT_HPP\n#define CAPS_RT_HPP\n";
+  emit_prelude(o, true, true);
+  o << "#endif\n";
+  return o.str();
+}
+
+std::string emit_cpp(const Group& g, bool emit_main) {
+  EmitOptions opts;
+  opts.emit_main = emit_main;
+  return emit_cpp(g, opts);
+}
+
+std::string emit_cpp(const Group& g, const EmitOptions& opts) {
+  if (opts.profile) {
+    if (!opts.profile->group.empty() && opts.profile->group != g.name)
+      throw std::runtime_error("profile of group " + opts.profile->group + " used for " + g.name);
+    // emit the reordered schedule (hot_schedule of it is itself)
+    auto schedule = hot_schedule(g, *opts.profile);
+    if (schedule != g.schedule) {
+      Group hot = g;
+      hot.schedule = std::move(schedule);
+      return emit_cpp(hot, opts);
+    }
+  }
+
+  std::ostringstream o;
+  const GroupProf gp(g, opts);
+  const bool threaded = opts.emit_main && opts.threads > 0 && threads_ineligible_reason(g).empty();
+  const uint32_t burst = burst_limit(g);
+
+  o <<
+R"(// AUTO-GENERATED by CAPS AOT backend
+// Build example (MSVC):
+//   cl /std:c++17 /O2 /EHsc generated.cpp
+// Run:
+//   generated.exe
+)";
+  // channels fuse_channels() marked direct (sequential mains only)
+  bool slots = !threaded && std::any_of(g.channels.begin(), g.channels.end(),
+                                        [](const ChannelDecl& c) { return c.direct && c.capacity > 0; });
+  if (opts.runtime_header.empty()) {
+    emit_prelude(o, threaded, slots);
+  } else {
+    o << "#include \"" << opts.runtime_header << "\"\n\n";
+  }
+
+  if (opts.profile) {
+    o <<
+R"(#ifndef CAPS_LIKELY
+#if defined(__GNUC__) || defined(__clang__)
+#define CAPS_LIKELY(x) __builtin_expect(!!(x), 1)
+#define CAPS_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define CAPS_LIKELY(x) (x)
+#define CAPS_UNLIKELY(x) (x)
+#endif
+#endif
+
+)";
+  }
+  if (gp.instrument) emit_profile_counters(o, g, gp, opts.instrument);
 
   // Channels aggregate struct
   o << "struct Channels {\n";
   for (auto& ch : g.channels) {
     if (ch.capacity == 0) {
-      // AOT ring-buffer channels require N>0.
-      // If you want rendezvous channels, either:
-      // - lower them to capacity=1 with explicit protocol, or
-      // - emit a RendezvousChannel implementation.
-      // For now: enforce >=1 in AOT.
-      throw std::runtime_error("AOT emitter requires channel capacity >= 1 (ring buffer). Channel: " + ch.name);
+      uint32_t procs = g.processes.empty() ? 1 : (uint32_t)g.processes.size();
+      o << "  RendezvousChannel<" << cpp_type(ch.elem_type.kind) << ", " << procs << "> " << ident(ch.name) << ";\n";
+      continue;
+    }
+    if (!threaded && ch.direct) {
+      o << "  SlotChannel<" << cpp_type(ch.elem_type.kind) << "> " << ident(ch.name) << ";\n";
+      continue;
     }
-    o << "  ChannelBuf<" << cpp_type(ch.elem_type.kind) << ", " << ch.capacity << "> " << ident(ch.name) << ";\n";
+    o << (threaded ? "  SpscChannel<" : "  ChannelBuf<") << cpp_type(ch.elem_type.kind) << ", " << ch.capacity << "> " << ident(ch.name) << ";\n";
 
     // attach try_recv method via wrapper lambdas in generated process code
   }
   o << "};\n\n";
 
   // Emit processes
-  for (auto& p : g.processes) {
+  for (size_t pi = 0; pi < g.processes.size(); pi++) {
+    auto& p = g.processes[pi];
     std::string P = "Proc_" + ident(p.name);
     o << "struct " << P << " {\n";
+    o << "  static constexpr uint32_t kId = " << pi << ";\n";
 
     // locals
     for (auto& lv : p.locals) {
@@ -282,63 +1543,46 @@ template <uint32_t N> static inline Result_text_text try_recv_text(ChannelBuf<st
     o << "  };\n";
 
     o << "  State state = State::" << ident(p.initial_state) << ";\n";
-    o << "  bool finished = false;\n\n";
+    o << "  bool finished = false;\n";
+    o << "  bool parked = false; // on an unbuffered channel\n";
+
+    // a mailbox per unbuffered channel the process receives on
+    for (auto& c : process_mailboxes(g, p)) {
+      o << "  " << cpp_type(channel_decl(g, c).elem_type.kind) << " " << mailbox(c) << " {};\n";
+      o << "  bool " << mailbox(c) << "_ready = false;\n";
+    }
+    o << "\n";
 
     // step()
-    o << "  void step(Channels& channels) {\n";
-    o << "    if (finished) return;\n";
-    o << "    bool blocked = false;\n";
-    o << "    const char* block_reason = \"\";\n";
+    // false when the step was blocked or there was nothing left to run
+    o << "  bool step(Channels& channels) {\n";
+    o << "    if (finished || parked) return false;\n";
     o << "    switch (state) {\n";
 
-    for (auto& sname : ordered) {
+    StepExits exits;
+    exits.finish = {"finished = true;", "return true;"};
+    exits.blocked = "return false;";
+    exits.enter = [](const std::string& to) {
+      return std::vector<std::string>{"state = State::" + ident(to) + ";", "return true;"};
+    };
+    for (auto& sname : gp.layout(p)) {
       auto it = p.states.find(sname);
       if (it == p.states.end()) throw std::runtime_error("missing state: " + sname);
       auto& st = it->second;
 
       o << "      case State::" << ident(st.name) << ": {\n";
-
-      if (st.terminal) {
-        o << "        finished = true;\n";
-        o << "        return;\n";
-      }
-
-      // state actions
-      emit_action_list(o, st.actions, g);
-
-      // if blocked, return without transition
-      o << "        if (blocked) return;\n";
-
-      // transition
-      if (st.tr.kind == Transition::Kind::Goto) {
-        o << "        state = State::" << ident(st.tr.to_state) << ";\n";
-        o << "        return;\n";
-      } else {
-        o << "        if (";
-        emit_expr(o, st.tr.cond);
-        o << ") {\n";
-        emit_action_list(o, st.tr.then_actions, g);
-        o << "          if (blocked) return;\n";
-        o << "          state = State::" << ident(st.tr.then_state) << ";\n";
-        o << "          return;\n";
-        o << "        } else {\n";
-        emit_action_list(o, st.tr.else_actions, g);
-        o << "          if (blocked) return;\n";
-        o << "          state = State::" << ident(st.tr.else_state) << ";\n";
-        o << "          return;\n";
-        o << "        }\n";
-      }
-
+      emit_state_body(o, g, st, exits, burst, gp.at(p, st));
       o << "      }\n";
     }
 
     o << "    }\n"; // switch
+    o << "    return false;\n";
     o << "  }\n";   // step
     o << "};\n\n";
   }
 
   // Emit runner / main
-  if (emit_main) {
+  if (opts.emit_main) {
     // schedule sanity: every step must match a process
     std::unordered_set<std::string> procset;
     for (auto& p : g.processes) procset.insert(p.name);
@@ -346,6 +1590,13 @@ template <uint32_t N> static inline Result_text_text try_recv_text(ChannelBuf<st
     for (auto& s : g.schedule) {
       if (!procset.count(s)) throw std::runtime_error("schedule references unknown process: " + s);
     }
+  }
+
+  if (opts.emit_main && threaded) {
+    emit_threaded_main(o, g, opts.threads);
+  } else if (opts.emit_main && opts.fused) {
+    emit_fused_main(o, g, gp);
+  } else if (opts.emit_main) {
 
     o << "int main() {\n";
     o << "  Channels channels;\n";
@@ -361,12 +1612,7 @@ template <uint32_t N> static inline Result_text_text try_recv_text(ChannelBuf<st
 
     // deterministic schedule: one step per process per tick (in given order)
     for (auto& step : g.schedule) {
-      o << "    {\n";
-      o << "      auto before_finished = " << ident(step) << ".finished;\n";
-      o << "      auto before_state = " << ident(step) << ".state;\n";
-      o << "      " << ident(step) << ".step(channels);\n";
-      o << "      if (!before_finished || (before_state != " << ident(step) << ".state) || (" << ident(step) << ".finished != before_finished)) any_progress = true;\n";
-      o << "    }\n";
+      o << "    if (" << ident(step) << ".step(channels)) any_progress = true;\n";
     }
 
     // check complete
@@ -387,150 +1633,4 @@ template <uint32_t N> static inline Result_text_text try_recv_text(ChannelBuf<st
   return o.str();
 }
 
-// AOT backend for enhanced channels, processes, timers, math, collections, I/O
-void emit_enhanced_channel(const ChannelDecl& ch);
-void emit_enhanced_process(const Process& p);
-void emit_timer_functions();
-void emit_math_functions();
-void emit_collection_types();
-void emit_io_functions();
-
-// Enhanced channels: add priority queues, timeouts
-void emit_enhanced_channel(const ChannelDecl& ch) {
-  // Generate priority ring buffer or timeout logic
-}
-
-// Enhanced processes: add concurrency controls, better FSM
-void emit_enhanced_process(const Process& p) {
-  // Emit with enhanced state management
-}
-
-// Emit deterministic timer functions
-void emit_timer_functions() {
-  // get_deterministic_timer, set_timeout, etc.
-}
-
-// Emit static math utilities
-void emit_math_functions() {
-  // sin, cos, pow, gcd, etc.
-}
-
-// Emit fixed-size collections
-void emit_collection_types() {
-  // Arrays, stacks, queues
-}
-
-// Emit deterministic I/O
-void emit_io_functions() {
-  // read, write with bounds
-}
-
-// AOT backend enhancements for dead code elimination, channel fusion, process inlining,
-// static memory layout, zero-copy message passing
-
-std::string emit_cpp_optimized(const Group& g, bool emit_main) {
-  // Apply optimizations before emitting
-  Group optimized_g = optimize_group(g);
-
-  // Emit optimized code
-  return emit_cpp(optimized_g, emit_main);
-}
-
-// Optimize group
-Group optimize_group(const Group& g) {
-  Group opt = g;
-  // Dead code elimination
-  remove_unused_processes(opt);
-  // Channel fusion
-  fuse_channels(opt);
-  // Process inlining
-  inline_small_processes(opt);
-  // Static memory layout
-  layout_memory_statically(opt);
-  // Zero-copy
-  enable_zero_copy(opt);
-  return opt;
-}
-
-// Helper functions
-void remove_unused_processes(Group& g);
-void fuse_channels(Group& g);
-void inline_small_processes(Group& g);
-void layout_memory_statically(Group& g);
-void enable_zero_copy(Group& g);
-
-// AOT backend enhancements for whole-program analysis baked into codegen,
-// deterministic process scheduling, static memory layout, channel graph lowering,
-// zero-copy message passing, fixed-time code generation, predictable branching,
-// deterministic inlining, static stack frame construction
-
-std::string emit_cpp_whole_program(const Program& prog, bool emit_main) {
-  // Whole-program analysis
-  analyze_whole_program(prog);
-
-  // Static memory layout
-  layout_memory(prog);
-
-  // Channel graph lowering
-  lower_channel_graph(prog);
-
-  // Zero-copy message passing
-  enable_zero_copy(prog);
-
-  // Fixed-time code generation
-  generate_fixed_time(prog);
-
-  // Predictable branching
-  make_branching_predictable(prog);
-
-  // Deterministic inlining
-  inline_deterministically(prog);
-
-  // Static stack frame construction
-  construct_static_frames(prog);
-
-  // Deterministic process scheduling
-  schedule_processes_deterministically(prog);
-
-  // Emit C++
-  return emit_cpp(prog.groups[0], emit_main);  // Simplified
-}
-
-// Helper functions
-void analyze_whole_program(const Program& prog) {
-  // Analyze entire program for optimizations
-}
-
-void layout_memory(const Program& prog) {
-  // Assign static memory addresses
-}
-
-void lower_channel_graph(const Program& prog) {
-  // Optimize channel communication graphs
-}
-
-void enable_zero_copy(const Program& prog) {
-  // Modify channels to pass references
-}
-
-void generate_fixed_time(const Program& prog) {
-  // Ensure compilation time is bounded
-}
-
-void make_branching_predictable(const Program& prog) {
-  // Optimize for predictable branch prediction
-}
-
-void inline_deterministically(const Program& prog) {
-  // Inline functions deterministically
-}
-
-void construct_static_frames(const Program& prog) {
-  // Pre-build stack frames
-}
-
-void schedule_processes_deterministically(const Program& prog) {
-  // Schedule process execution deterministically
-}
-
 } // namespace caps::aot
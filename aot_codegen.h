@@ -1,11 +1,100 @@
 #pragma once
 #include "aot_ir_typed.h"
+#include <iosfwd>
+#include <map>
 #include <string>
 
 namespace caps::aot {
 
-// Emits a single self-contained .cpp file.
+// Counts an instrumented program (EmitOptions::instrument) wrote at exit.
+struct Profile {
+  struct StateCounts {
+    uint64_t entered = 0;    // steps that ran the state
+    uint64_t then_taken = 0; // transition outcomes (IfElse)
+    uint64_t else_taken = 0;
+    uint64_t blocked = 0;    // steps that blocked in it
+  };
+  struct ChannelCounts {
+    uint64_t send_blocked = 0;
+    uint64_t recv_blocked = 0;
+  };
+
+  std::string group;
+  std::map<std::pair<std::string, std::string>, StateCounts> states; // (process, state)
+  std::map<std::string, ChannelCounts> channels;
+};
+
+// Adds the counts of a profile file to `into`, so that several runs of the
+// same group can be merged. Throws std::runtime_error on a malformed file or
+// one for a different group than into.group (when set).
+void read_profile(std::istream& in, Profile& into);
+
+struct EmitOptions {
+  // include a main() that runs the group to completion
+  bool emit_main = true;
+
+  // > 0: main() runs the group on up to this many pinned worker threads, with
+  // lock-free SPSC rings for channels. Only for groups that
+  // threads_ineligible_reason() accepts; other groups get the sequential main.
+  unsigned threads = 0;
+
+  // main() calls one generated run_group() with the schedule inlined, the
+  // processes' members in locals, and states dispatched by a switch of gotos
+  // (computed goto with -DCAPS_COMPUTED_GOTO=1); finished and progress are
+  // per-process bitmasks. Ignored when threads applies.
+  bool fused = false;
+
+  // Non-empty: the file #includes this header, which holds runtime_header(),
+  // instead of carrying that prelude itself.
+  std::string runtime_header;
+
+  // Non-empty: instrument the program. States count the steps that run
+  // them, their then / else outcomes and the steps that block in them;
+  // channels count blocked sends and receives. The program writes the counts
+  // to this file when it exits (read_profile reads them).
+  std::string instrument;
+
+  // Counts from an instrumented run of the same group. State bodies are laid
+  // out hottest first (the switch cases; numbering is unchanged); transitions and blocking ops skewed at least
+  // 90/10 get CAPS_LIKELY / CAPS_UNLIKELY (__builtin_expect where the
+  // compiler has it); adjacent schedule steps of processes that share no
+  // channel are reordered hottest first, which leaves every run unchanged.
+  const Profile* profile = nullptr;
+};
+
+// Emits a single .cpp file, self-contained unless opts.runtime_header is set.
 // If emit_main=true, it includes a main() that runs group.schedule deterministically.
 std::string emit_cpp(const Group& g, bool emit_main);
+std::string emit_cpp(const Group& g, const EmitOptions& opts);
+
+// The prelude every emitted file needs (includes, Result types, Ring and all
+// channel types) as one header that depends on no group, so that it can be
+// precompiled once and shared: see EmitOptions::runtime_header.
+std::string runtime_header();
+
+// Empty if g can run threaded, otherwise why not: missing @pipeline_safe,
+// rendezvous channels, try_send/try_receive (their result depends on timing),
+// len(), a channel with more than one writer or reader process or written and
+// read by the same process, or a send/receive that does not open its action
+// list (a blocked step must have had no effects, since it is repeated).
+std::string threads_ineligible_reason(const Group& g);
+
+// Marks direct (ChannelDecl::direct) every buffered channel with one writer
+// and one reader process that provably never holds more than one message:
+// capacity 1, or every send finds it empty in all runs of the writer and
+// reader through the static schedule (ops on other channels and conditions
+// other than ok() of a result just try_received from it taken both ways).
+// The sequential mains emit those as a single slot instead of a ring. Not
+// proven under @burst (only capacity 1 then). Returns the names of the
+// channels it marked.
+std::vector<std::string> fuse_channels(Group& g);
+
+// K from a @burst(K) group annotation (IR spelling "burst(K)"), 1 without
+// one. Each step of a process in a state that loops back to itself with only
+// assignments and try ops runs up to K iterations, stopping early when a
+// try_receive channel is empty or a try_send channel is full. Throws
+// std::runtime_error for a K that is not a positive count of at most 9
+// digits, as sema rejects it.
+uint32_t burst_limit(const Group& g);
 
 } // namespace caps::aot
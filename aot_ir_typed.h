@@ -109,6 +109,7 @@ struct ChannelDecl {
   std::string name;
   Type elem_type;
   uint32_t capacity = 0; // 0 = rendezvous (optional; see note)
+  bool direct = false;   // set by fuse_channels: never holds more than one message
 };
 
 struct Process {
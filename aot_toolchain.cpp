@@ -1,7 +1,13 @@
 #include "aot_toolchain.h"
+#include "aot_codegen.h"
+#include <atomic>
+#include <filesystem>
 #include <fstream>
+#include <cstdio>
 #include <cstdlib>
 #include <sstream>
+#include <system_error>
+#include <thread>
 
 #if defined(_WIN32)
   #include <windows.h>
@@ -38,10 +44,10 @@ bool compile_exe(const std::string& cpp_source,
   std::ostringstream cmd;
   cmd << "sh -c \"";
   cmd << "if command -v clang++ >/dev/null 2>&1; then ";
-  cmd << "clang++ -std=c++17 ";
+  cmd << "clang++ -std=c++17 -pthread ";
   if (optO2) cmd << "-O2 ";
   cmd << cpp_path << " -o " << out_exe_path << "; ";
-  cmd << "else g++ -std=c++17 ";
+  cmd << "else g++ -std=c++17 -pthread ";
   if (optO2) cmd << "-O2 ";
   cmd << cpp_path << " -o " << out_exe_path << "; fi\"";
 
@@ -50,4 +56,183 @@ bool compile_exe(const std::string& cpp_source,
 #endif
 }
 
+// ===== Cached builds =====
+
+namespace fs = std::filesystem;
+
+static uint64_t fnv1a(const std::string& s, uint64_t h = 0xcbf29ce484222325ull) {
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+static std::string hex_key(uint64_t h) {
+  char buf[17];
+  std::snprintf(buf, sizeof buf, "%016llx", (unsigned long long)h);
+  return buf;
+}
+
+static std::string quote(const fs::path& p) { return "\"" + p.string() + "\""; }
+
+static bool run(const std::string& cmd) { return std::system(cmd.c_str()) == 0; }
+
+// Builds into `tmp` and moves it to `dst`, so that a concurrent or
+// interrupted build never leaves a partial file under a cache key.
+static bool build_into(const fs::path& dst, const fs::path& tmp, const std::string& cmd) {
+  std::error_code ec;
+  if (!run(cmd)) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  fs::rename(tmp, dst, ec);
+  return !ec;
+}
+
+namespace {
+
+// The compiler and how to drive it. The runtime header is precompiled next
+// to its copy in rt_dir; compile() then uses the PCH, or plain #include if
+// precompiling failed.
+struct Toolchain {
+  std::string cxx;
+  std::string flags;
+  fs::path rt_dir;
+  bool pch = false;
+
+#if defined(_WIN32)
+  static constexpr const char* kObj = ".obj";
+
+  fs::path pch_file() const { return rt_dir / "caps_rt.pch"; }
+  fs::path rt_obj() const { return rt_dir / "caps_rt.obj"; } // /Yc's object, linked into every exe
+
+  bool precompile() {
+    fs::path stub = rt_dir / "caps_rt.cpp";
+    if (!write_file(stub.string(), std::string("#include \"") + kRuntimeHeaderName + "\"\n")) return false;
+    std::string cmd = cxx + " " + flags + " /c /Yc" + kRuntimeHeaderName + " /Fp" + quote(pch_file()) +
+                      " /Fo" + quote(rt_obj()) + " " + quote(stub);
+    return run(cmd);
+  }
+  std::string compile(const fs::path& src, const fs::path& obj) const {
+    std::string cmd = cxx + " " + flags + " /c /I" + quote(rt_dir);
+    if (pch) cmd += std::string(" /Yu") + kRuntimeHeaderName + " /Fp" + quote(pch_file());
+    return cmd + " /Fo" + quote(obj) + " " + quote(src);
+  }
+  std::string link(const fs::path& obj, const fs::path& exe) const {
+    std::string cmd = cxx + " /nologo " + quote(obj);
+    if (pch) cmd += " " + quote(rt_obj());
+    return cmd + " /Fe:" + quote(exe);
+  }
+#else
+  static constexpr const char* kObj = ".o";
+
+  bool clang() const { return cxx == "clang++"; }
+  // GCC picks up caps_rt.hpp.gch by itself where it finds caps_rt.hpp
+  fs::path pch_file() const { return rt_dir / (std::string(kRuntimeHeaderName) + (clang() ? ".pch" : ".gch")); }
+
+  bool precompile() {
+    fs::path tmp = pch_file().string() + ".tmp";
+    std::string cmd = cxx + " " + flags + " -x c++-header " + quote(rt_dir / kRuntimeHeaderName) + " -o " + quote(tmp);
+    return build_into(pch_file(), tmp, cmd);
+  }
+  std::string compile(const fs::path& src, const fs::path& obj) const {
+    std::string cmd = cxx + " " + flags + " -I" + quote(rt_dir);
+    if (pch && clang()) cmd += " -include-pch " + quote(pch_file());
+    return cmd + " -c " + quote(src) + " -o " + quote(obj);
+  }
+  std::string link(const fs::path& obj, const fs::path& exe) const {
+    return cxx + " " + flags + " " + quote(obj) + " -o " + quote(exe);
+  }
+#endif
+};
+
+} // namespace
+
+static Toolchain detect_toolchain(bool optO2) {
+  Toolchain tc;
+#if defined(_WIN32)
+  // MSVC (cl.exe) expected available in PATH via "x64 Native Tools Command Prompt"
+  tc.cxx = "cl";
+  tc.flags = "/nologo /std:c++17 /EHsc";
+  if (optO2) tc.flags += " /O2";
+#else
+  // Prefer clang++, fallback g++
+  tc.cxx = run("command -v clang++ >/dev/null 2>&1") ? "clang++" : "g++";
+  tc.flags = "-std=c++17 -pthread";
+  if (optO2) tc.flags += " -O2";
+#endif
+  return tc;
+}
+
+// Writes runtime_header() into its rt-<key> directory and precompiles it,
+// unless an earlier build already did.
+static bool prepare_runtime(Toolchain& tc, const fs::path& cache, const std::string& header) {
+  tc.rt_dir = cache / ("rt-" + hex_key(fnv1a(header, fnv1a(tc.cxx + " " + tc.flags))));
+  std::error_code ec;
+  fs::create_directories(tc.rt_dir, ec);
+  fs::path hpp = tc.rt_dir / kRuntimeHeaderName;
+  if (!fs::exists(hpp)) {
+    fs::path tmp = hpp.string() + ".tmp";
+    if (!write_file(tmp.string(), header)) return false;
+    fs::rename(tmp, hpp, ec);
+    if (ec) return false;
+  }
+  tc.pch = fs::exists(tc.pch_file()) || tc.precompile();
+  return true;
+}
+
+static BuildOutcome build_unit(const Toolchain& tc, const fs::path& cache, const BuildUnit& u, size_t index) {
+  std::error_code ec;
+  const std::string key = hex_key(fnv1a(u.cpp_source, fnv1a(tc.rt_dir.filename().string())));
+  const std::string tmp_tag = ".tmp" + std::to_string(index);
+  fs::path exe = cache / (key + ".exe");
+  BuildOutcome outcome = BuildOutcome::Cached;
+
+  if (!fs::exists(exe)) {
+    outcome = BuildOutcome::Built;
+    fs::path obj = cache / (key + Toolchain::kObj);
+    if (!fs::exists(obj)) {
+      fs::path src = cache / (key + ".cpp");
+      fs::path src_tmp = cache / (key + tmp_tag + ".cpp");
+      if (!write_file(src_tmp.string(), u.cpp_source)) return BuildOutcome::Failed;
+      fs::rename(src_tmp, src, ec);
+      if (ec) return BuildOutcome::Failed;
+      fs::path obj_tmp = cache / (key + tmp_tag + Toolchain::kObj);
+      if (!build_into(obj, obj_tmp, tc.compile(src, obj_tmp))) return BuildOutcome::Failed;
+    }
+    fs::path exe_tmp = cache / (key + tmp_tag + ".exe");
+    if (!build_into(exe, exe_tmp, tc.link(obj, exe_tmp))) return BuildOutcome::Failed;
+  }
+
+  fs::copy_file(exe, u.out_exe_path, fs::copy_options::overwrite_existing, ec);
+  return ec ? BuildOutcome::Failed : outcome;
+}
+
+std::vector<BuildOutcome> build_exes(const std::vector<BuildUnit>& units, const BuildOptions& opts) {
+  std::vector<BuildOutcome> out(units.size(), BuildOutcome::Failed);
+  const fs::path cache = opts.cache_dir;
+  std::error_code ec;
+  fs::create_directories(cache, ec);
+  if (ec) return out;
+
+  Toolchain tc = detect_toolchain(opts.optO2);
+  if (!prepare_runtime(tc, cache, runtime_header())) return out;
+
+  unsigned jobs = opts.jobs ? opts.jobs : std::thread::hardware_concurrency();
+  if (jobs == 0) jobs = 1;
+  if (jobs > units.size()) jobs = (unsigned)units.size();
+
+  // each worker takes the next unit; every unit writes only its own outcome
+  std::atomic<size_t> next{0};
+  auto worker = [&] {
+    for (size_t i; (i = next.fetch_add(1)) < units.size();) out[i] = build_unit(tc, cache, units[i], i);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned j = 1; j < jobs; j++) pool.emplace_back(worker);
+  worker();
+  for (auto& t : pool) t.join();
+  return out;
+}
+
 } // namespace caps::aot
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 
 namespace caps::aot {
 
@@ -10,4 +11,34 @@ bool compile_exe(const std::string& cpp_source,
                  bool optO2 = true,
                  const std::string& work_dir = ".");
 
+// File name the emitted groups #include for runtime_header()
+// (EmitOptions::runtime_header).
+inline constexpr const char* kRuntimeHeaderName = "caps_rt.hpp";
+
+// One emitted group: emit_cpp() output with EmitOptions::runtime_header set
+// to kRuntimeHeaderName.
+struct BuildUnit {
+  std::string name; // for messages
+  std::string cpp_source;
+  std::string out_exe_path;
+};
+
+struct BuildOptions {
+  bool optO2 = true;
+  std::string cache_dir = ".caps-cache";
+  unsigned jobs = 0; // concurrent compiles; 0: one per hardware thread
+};
+
+enum class BuildOutcome { Failed, Built, Cached };
+
+// Builds each unit into its out_exe_path through a content-addressed cache.
+// runtime_header() is written and precompiled once per compiler, flags and
+// header text (cache_dir/rt-<key>/). A unit's object and executable are
+// cache_dir/<key>.o and <key>.exe, keyed by an FNV-1a hash of its source
+// (a function of the typed Group and EmitOptions), the runtime header and
+// the compiler command line; a unit whose executable is cached is only
+// copied, so after editing one group only that group is compiled. Units
+// that are not cached compile concurrently. Outcomes are in unit order.
+std::vector<BuildOutcome> build_exes(const std::vector<BuildUnit>& units, const BuildOptions& opts = {});
+
 } // namespace caps::aot
@@ -148,76 +148,3 @@ struct Program {
   ModuleDecl module;
   std::vector<GroupDecl> groups;
 };
-
-// AST nodes for new features
-struct MatchExpr {
-  std::unique_ptr<Expr> scrutinee;
-  std::vector<MatchArm> arms;
-};
-
-struct MatchArm {
-  Pattern pattern;
-  std::optional<std::unique_ptr<Expr>> guard;  // if condition
-  std::unique_ptr<Expr> body;
-};
-
-struct Pattern {
-  // Variants: wildcard, literal, variable, struct, etc.
-  enum Kind { Wildcard, Literal, Variable, Struct } kind;
-  // Fields based on kind
-};
-
-struct ArrayType {
-  std::unique_ptr<Type> elem_type;
-  size_t size;  // Compile-time constant
-};
-
-struct ArrayExpr {
-  std::vector<std::unique_ptr<Expr>> elements;
-};
-
-struct ForLoop {
-  std::string var;
-  std::unique_ptr<Expr> start;
-  std::unique_ptr<Expr> end;  // Must be compile-time
-  std::vector<std::unique_ptr<Stmt>> body;
-};
-
-struct ConstFnDecl {
-  std::string name;
-  std::vector<Param> params;
-  std::unique_ptr<Type> ret_type;
-  std::vector<std::unique_ptr<Stmt>> body;
-};
-
-// Enhanced AST for clean, deterministic type system
-// Added: Generics, dependent types, refinement types, union types
-
-struct GenericType {
-  std::string base;
-  std::vector<Type> params;
-};
-
-struct DependentType {
-  Type base;
-  Expr condition;  // e.g., {int | x > 0}
-};
-
-struct RefinementType {
-  Type base;
-  Expr predicate;
-};
-
-struct UnionType {
-  std::vector<Type> variants;
-};
-
-struct EnumType {
-  std::string name;
-  std::vector<std::string> variants;
-};
-
-struct StructType {
-  std::string name;
-  std::vector<std::pair<std::string, Type>> fields;
-};
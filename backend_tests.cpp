@@ -1,12 +1,20 @@
 #include <gtest/gtest.h>
 #include "aot/aot_codegen.h"
+#include "aot/aot_toolchain.h"
 #include "x64/x64_codegen.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 
 // Backend tests
 
+using namespace caps::aot;
+namespace fs = std::filesystem;
+
 TEST(BackendTests, AOTGeneration) {
-  GroupDecl group;
-  // Setup group
+  Group group;
+  group.name = "G";
   std::string code = emit_cpp(group, true);
   EXPECT_FALSE(code.empty());
 }
@@ -16,4 +24,709 @@ TEST(BackendTests, X64Generation) {
   // Setup IR
   X64Module mod = emit_x64(ir);
   EXPECT_FALSE(mod.functions.empty());
-}
\ No newline at end of file
+}
+
+// ===== Emitted programs =====
+//
+// The tests below compile what the AOT backend emits with the host compiler,
+// against runtime_header() written once as kRuntimeHeaderName, and run it.
+
+// Scratch directory holding the runtime header.
+static fs::path aot_dir() {
+  static const fs::path dir = [] {
+    fs::path d = fs::temp_directory_path() / "caps_backend_tests";
+    fs::create_directories(d);
+    std::ofstream(d / kRuntimeHeaderName) << runtime_header();
+    return d;
+  }();
+  return dir;
+}
+
+static std::string host_cxx() {
+  if (const char* cxx = std::getenv("CXX")) return cxx;
+  return std::system("command -v clang++ >/dev/null 2>&1") == 0 ? "clang++" : "g++";
+}
+
+struct RunResult {
+  bool built = false;
+  bool ok = false;     // exited with status 0
+  std::string output;  // stdout and stderr
+};
+
+// Writes `source` as <name>.cpp, builds it with `flags` and runs it.
+static RunResult build_and_run(const std::string& name, const std::string& source, const std::string& flags = "") {
+  RunResult r;
+  fs::path dir = aot_dir();
+  fs::path cpp = dir / (name + ".cpp"), exe = dir / (name + ".exe"), log = dir / (name + ".log");
+  std::ofstream(cpp) << source;
+  std::string cc = host_cxx() + " -std=c++17 -O1 -pthread " + flags + " -I\"" + dir.string() + "\" \"" +
+                   cpp.string() + "\" -o \"" + exe.string() + "\" >\"" + log.string() + "\" 2>&1";
+  r.built = std::system(cc.c_str()) == 0;
+  if (r.built) r.ok = std::system(("\"" + exe.string() + "\" >\"" + log.string() + "\" 2>&1").c_str()) == 0;
+  std::ifstream in(log);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  r.output = ss.str();
+  return r;
+}
+
+// Sanitizers where the host compiler has them, else a plain build.
+static RunResult build_and_run_sanitized(const std::string& name, const std::string& source) {
+  RunResult r = build_and_run(name, source, "-g -fsanitize=address,undefined -fno-sanitize-recover=all");
+  return r.built ? r : build_and_run(name, source);
+}
+
+// Ring::push_n / pop_n against std::deque, through random mixes of single
+// and bulk ops whose runs wrap around the slots, for a trivially copyable
+// element (memcpy path) and std::string (element-wise), with capacities
+// below, at and past a power of two.
+TEST(BackendTests, RingBulkOpsWrapAround) {
+  std::string src = std::string("#include \"") + kRuntimeHeaderName + "\"\n" + R"(#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+template <class T, uint32_t N, class Make>
+static int check(Make make) {
+  Ring<T, N> r;
+  std::deque<T> ref;
+  std::mt19937 rng(N);
+  int64_t next = 0;
+  int bad = 0;
+  for (int it = 0; it < 20000; it++) {
+    uint32_t n = rng() % (N + 3);
+    switch (rng() % 4) {
+    case 0: {
+      T v = make(next);
+      bool ok = r.push(v);
+      bad += ok != (ref.size() < N);
+      if (ok) ref.push_back(v), next++;
+      break;
+    }
+    case 1: {
+      T v{};
+      bool ok = r.pop(v);
+      bad += ok == ref.empty();
+      if (ok) bad += v != ref.front(), ref.pop_front();
+      break;
+    }
+    case 2: {
+      std::vector<T> in;
+      for (uint32_t i = 0; i < n; i++) in.push_back(make(next + i));
+      uint32_t k = r.push_n(in.data(), n);
+      bad += k != std::min<uint32_t>(n, N - (uint32_t)ref.size());
+      for (uint32_t i = 0; i < k; i++) ref.push_back(in[i]);
+      next += k;
+      break;
+    }
+    default: {
+      std::vector<T> out(n);
+      uint32_t k = r.pop_n(out.data(), n);
+      bad += k != std::min<uint32_t>(n, (uint32_t)ref.size());
+      for (uint32_t i = 0; i < k; i++) bad += out[i] != ref.front(), ref.pop_front();
+    }
+    }
+    bad += r.size() != ref.size();
+  }
+  return bad;
+}
+
+int main() {
+  auto i64 = [](int64_t v) { return v; };
+  auto text = [](int64_t v) { return std::string(24, (char)('a' + v % 26)) + std::to_string(v); };
+  int bad = check<int64_t, 1>(i64) + check<int64_t, 3>(i64) + check<int64_t, 5>(i64) + check<int64_t, 8>(i64) +
+            check<std::string, 3>(text) + check<std::string, 7>(text);
+  std::cout << bad << " mismatches\n";
+  return bad != 0;
+}
+)";
+  RunResult r = build_and_run_sanitized("ring_bulk", src);
+  ASSERT_TRUE(r.built);
+  EXPECT_TRUE(r.ok);
+  EXPECT_EQ(r.output, "0 mismatches\n");
+}
+
+// ===== Typed groups =====
+//
+// Groups check their own results: a process reaches its terminal Done state
+// only if the values it saw are right and goes to Bad otherwise, so a run
+// prints "Completed" exactly when it computed what it should.
+
+static Expr lit(int64_t v) {
+  Expr e;
+  e.kind = Expr::Kind::LitI64;
+  e.i64 = v;
+  e.type = Type::i64();
+  return e;
+}
+static Expr var(const std::string& name, Type t = Type::i64()) { return Expr::v(name, t); }
+static Expr bin(const char* op, Expr a, Expr b, Type t = Type::i64()) {
+  Expr e;
+  e.kind = Expr::Kind::BinOp;
+  e.op = op;
+  e.args = {a, b};
+  e.type = t;
+  return e;
+}
+static Expr eq(Expr a, Expr b) { return bin("==", a, b, Type::boolean()); }
+static Expr lt(Expr a, Expr b) { return bin("<", a, b, Type::boolean()); }
+static Expr plus(const std::string& name, Expr b) { return bin("+", var(name), b); }
+// ok(r) / value(r) / error(r) of a Result local
+static Expr result(Expr::Kind k, const std::string& r, Type rt, Type t) {
+  Expr e;
+  e.kind = k;
+  e.args = {var(r, rt)};
+  e.type = t;
+  return e;
+}
+
+static Action assign(const std::string& dst, Expr e) {
+  Action a;
+  a.kind = Action::Kind::Assign;
+  a.dst = dst;
+  a.expr = e;
+  return a;
+}
+static Action send(const std::string& chan, Expr e) {
+  Action a;
+  a.kind = Action::Kind::Send;
+  a.chan = chan;
+  a.expr = e;
+  return a;
+}
+static Action recv(const std::string& chan, const std::string& dst) {
+  Action a;
+  a.kind = Action::Kind::Receive;
+  a.chan = chan;
+  a.dst = dst;
+  a.recv_type = Type::i64();
+  return a;
+}
+static Action try_send(const std::string& chan, const std::string& dst, Expr e) {
+  Action a = send(chan, e);
+  a.kind = Action::Kind::TrySend;
+  a.dst = dst;
+  return a;
+}
+static Action try_recv(const std::string& chan, const std::string& dst) {
+  Action a = recv(chan, dst);
+  a.kind = Action::Kind::TryReceive;
+  return a;
+}
+
+static Transition go(const std::string& to) {
+  Transition t;
+  t.kind = Transition::Kind::Goto;
+  t.to_state = to;
+  return t;
+}
+static Transition branch(Expr cond, const std::string& then_state, const std::string& else_state) {
+  Transition t;
+  t.kind = Transition::Kind::IfElse;
+  t.cond = cond;
+  t.then_state = then_state;
+  t.else_state = else_state;
+  return t;
+}
+
+// A process over i64 locals (and Result locals named r / rr) whose first
+// state is initial, plus Done (terminal) and Bad (stuck).
+static Process process(const std::string& name, std::vector<std::string> locals, std::vector<State> states) {
+  Process p;
+  p.name = name;
+  p.initial_state = states.front().name;
+  for (auto& l : locals) p.locals.push_back({l, Type::i64()});
+  p.locals.push_back({"r", Type::result_bool_text()});
+  p.locals.push_back({"rr", Type::result_i64_text()});
+  p.locals.push_back({"__last_error", Type::text()});
+  State done{"Done", true, {}, go("Done")};
+  State bad{"Bad", false, {}, go("Bad")};
+  states.push_back(done);
+  states.push_back(bad);
+  for (auto& s : states) p.states[s.name] = s;
+  return p;
+}
+
+// Emits g against the shared runtime header, then builds and runs it.
+static RunResult run_group(const std::string& name, const Group& g, EmitOptions opts = {},
+                           const std::string& flags = "") {
+  opts.runtime_header = kRuntimeHeaderName;
+  return build_and_run(name, emit_cpp(g, opts), flags);
+}
+
+static EmitOptions fused() {
+  EmitOptions o;
+  o.fused = true;
+  return o;
+}
+
+// Prod sends 0..n-1 on c, Cons receives them and checks their sum. Each
+// tick Cons parks in Run, Prod sends, and Cons takes the value and adds it.
+static Group rendezvous_pipeline(int64_t n) {
+  Group g;
+  g.name = "Rendezvous";
+  g.channels.push_back({"c", Type::i64(), 0});
+  g.processes.push_back(process("Prod", {"i"}, {
+    {"Run", false, {send("c", var("i")), assign("i", plus("i", lit(1)))}, branch(lt(var("i"), lit(n)), "Run", "Done")},
+  }));
+  g.processes.push_back(process("Cons", {"x", "k", "sum"}, {
+    {"Run", false, {recv("c", "x")}, go("Acc")},
+    {"Acc", false, {assign("sum", plus("sum", var("x"))), assign("k", plus("k", lit(1)))},
+     branch(lt(var("k"), lit(n)), "Run", "Check")},
+    {"Check", false, {}, branch(eq(var("sum"), lit(n * (n - 1) / 2)), "Done", "Bad")},
+  }));
+  g.schedule = {"Cons", "Prod", "Cons", "Cons"};
+  return g;
+}
+
+TEST(BackendTests, RendezvousHandsOff) {
+  Group g = rendezvous_pipeline(1000);
+  EXPECT_EQ(run_group("rendezvous_seq", g).output, "Completed\n");
+  EXPECT_EQ(run_group("rendezvous_fused", g, fused()).output, "Completed\n");
+}
+
+// A send with no parked receiver blocks for good, as in the interpreter.
+TEST(BackendTests, RendezvousSendWithoutReceiverBlocks) {
+  Group g = rendezvous_pipeline(3);
+  g.schedule = {"Prod", "Cons"};
+  EXPECT_EQ(run_group("rendezvous_unmatched", g).output, "Deadlock\n");
+}
+
+// Two receivers park on c, B first; sends reach the lower process index
+// first, as in the interpreter.
+TEST(BackendTests, RendezvousWakesLowestIndexFirst) {
+  Group g;
+  g.name = "Order";
+  g.channels.push_back({"c", Type::i64(), 0});
+  for (int64_t want : {1, 2}) {
+    g.processes.push_back(process(want == 1 ? "A" : "B", {"x"}, {
+      {"Run", false, {recv("c", "x")}, go("Check")},
+      {"Check", false, {}, branch(eq(var("x"), lit(want)), "Done", "Bad")},
+    }));
+  }
+  g.processes.push_back(process("Tx", {}, {
+    {"One", false, {send("c", lit(1))}, go("Two")},
+    {"Two", false, {send("c", lit(2))}, go("Done")},
+  }));
+  g.schedule = {"B", "A", "Tx"};
+  EXPECT_EQ(run_group("rendezvous_order", g).output, "Completed\n");
+  EXPECT_EQ(run_group("rendezvous_order_fused", g, fused()).output, "Completed\n");
+}
+
+// try_send succeeds only into a parked receiver; try_receive finds nothing
+// before a send and does not park.
+TEST(BackendTests, RendezvousTryOps) {
+  Group g;
+  g.name = "TryOps";
+  g.channels.push_back({"c", Type::i64(), 0});
+  Expr sent = result(Expr::Kind::ResultValue, "r", Type::result_bool_text(), Type::boolean());
+  Expr got = result(Expr::Kind::ResultOk, "rr", Type::result_i64_text(), Type::boolean());
+  g.processes.push_back(process("Tx", {}, {
+    {"Early", false, {try_send("c", "r", lit(5))}, branch(sent, "Bad", "Late")},
+    {"Late", false, {try_send("c", "r", lit(9))}, branch(sent, "Done", "Bad")},
+  }));
+  g.processes.push_back(process("Rx", {"x"}, {
+    {"Poll", false, {try_recv("c", "rr")}, branch(got, "Bad", "Run")},
+    {"Run", false, {recv("c", "x")}, go("Check")},
+    {"Check", false, {}, branch(eq(var("x"), lit(9)), "Done", "Bad")},
+  }));
+  g.schedule = {"Tx", "Rx", "Rx", "Tx"};
+  EXPECT_EQ(run_group("rendezvous_try", g).output, "Completed\n");
+  EXPECT_EQ(run_group("rendezvous_try_fused", g, fused()).output, "Completed\n");
+}
+
+// Prod -> c -> Mid (doubles) -> d -> Cons over buffered channels, Cons
+// checking the sum of `expect` values. Every send and receive opens its
+// state, so the group can run threaded; Mid counts after its send, which
+// must not happen in a step where the send blocks.
+static Group buffered_pipeline(uint32_t capacity, int64_t n, int64_t expect) {
+  Group g;
+  g.name = "Pipeline";
+  g.annotations = {"pipeline_safe"};
+  g.channels.push_back({"c", Type::i64(), capacity});
+  g.channels.push_back({"d", Type::i64(), capacity});
+  g.processes.push_back(process("Prod", {"i"}, {
+    {"Run", false, {send("c", var("i"))}, go("Inc")},
+    {"Inc", false, {assign("i", plus("i", lit(1)))}, branch(lt(var("i"), lit(n)), "Run", "Done")},
+  }));
+  g.processes.push_back(process("Mid", {"x", "k"}, {
+    {"Run", false, {recv("c", "x")}, go("Fwd")},
+    {"Fwd", false, {send("d", bin("*", var("x"), lit(2))), assign("k", plus("k", lit(1)))},
+     branch(lt(var("k"), lit(n)), "Run", "Done")},
+  }));
+  g.processes.push_back(process("Cons", {"x", "k", "sum"}, {
+    {"Run", false, {recv("d", "x")}, go("Acc")},
+    {"Acc", false, {assign("sum", plus("sum", var("x"))), assign("k", plus("k", lit(1)))},
+     branch(lt(var("k"), lit(expect)), "Run", "Check")},
+    {"Check", false, {}, branch(eq(var("sum"), lit(expect * (expect - 1))), "Done", "Bad")},
+  }));
+  g.schedule = {"Prod", "Mid", "Cons"};
+  return g;
+}
+
+static EmitOptions threads(unsigned n) {
+  EmitOptions o;
+  o.threads = n;
+  return o;
+}
+
+TEST(BackendTests, ThreadedPipelineCompletes) {
+  Group g = buffered_pipeline(4, 20000, 20000);
+  ASSERT_EQ(threads_ineligible_reason(g), "");
+  for (unsigned n : {1u, 2u, 3u}) {
+    RunResult r = run_group("threads_" + std::to_string(n), g, threads(n));
+    EXPECT_TRUE(r.ok);
+    EXPECT_EQ(r.output, "Completed\n");
+  }
+}
+
+// Cons waits for more values than Prod sends: once every worker is idle the
+// quiescence protocol reports a deadlock instead of hanging.
+TEST(BackendTests, ThreadedPipelineDetectsDeadlock) {
+  Group g = buffered_pipeline(4, 100, 101);
+  for (unsigned n : {1u, 3u}) {
+    RunResult r = run_group("threads_deadlock_" + std::to_string(n), g, threads(n));
+    EXPECT_FALSE(r.ok);
+    EXPECT_EQ(r.output, "Deadlock\n");
+  }
+}
+
+TEST(BackendTests, ThreadsNeedPipelineSafeGroups) {
+  Group g = buffered_pipeline(4, 10, 10);
+  g.annotations.clear();
+  EXPECT_EQ(threads_ineligible_reason(g), "group is not @pipeline_safe");
+  EXPECT_NE(threads_ineligible_reason(rendezvous_pipeline(10)), "");
+}
+
+// run_group() dispatches states by a switch, or by computed goto with
+// -DCAPS_COMPUTED_GOTO=1; both must run the group as the sequential main does.
+TEST(BackendTests, FusedDispatchModes) {
+  Group buffered = buffered_pipeline(4, 5000, 5000);
+  Group rendezvous = rendezvous_pipeline(1000);
+  const char* const flags[] = {"", "-DCAPS_COMPUTED_GOTO=1"};
+  for (int k = 0; k < 2; k++) {
+    std::string tag = std::to_string(k);
+    EXPECT_EQ(run_group("fused_buffered_" + tag, buffered, fused(), flags[k]).output, "Completed\n");
+    EXPECT_EQ(run_group("fused_rendezvous_" + tag, rendezvous, fused(), flags[k]).output, "Completed\n");
+  }
+}
+
+// Emitted code builds warning-free in every mode; Prod only sends on its
+// unbuffered channel.
+TEST(BackendTests, EmittedCodeIsWarningFree) {
+  const std::string strict = "-Wall -Wextra -Werror";
+  Group g = rendezvous_pipeline(10);
+  EXPECT_TRUE(run_group("strict_seq", g, {}, strict).ok);
+  EXPECT_TRUE(run_group("strict_fused", g, fused(), strict).ok);
+  EXPECT_TRUE(run_group("strict_goto", g, fused(), strict + " -DCAPS_COMPUTED_GOTO=1").ok);
+  EXPECT_TRUE(run_group("strict_threads", buffered_pipeline(4, 10, 10), threads(2), strict).ok);
+}
+
+// Counts operator new calls in an emitted program and prints the count
+// after main() returns.
+static const char* const kCountAllocations = R"(
+#include <cstdlib>
+#include <new>
+static unsigned long long allocations = 0;
+void* operator new(std::size_t n) {
+  ++allocations;
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+static struct AllocationReport {
+  ~AllocationReport() { std::cout << allocations << " allocations\n"; }
+} allocation_report;
+)";
+
+// Poll polls an empty channel: every try_receive fails with the built-in
+// error "empty", without allocating, and the error reads back as its text.
+TEST(BackendTests, PollingEmptyChannelDoesNotAllocate) {
+  Group g;
+  g.name = "Poll";
+  g.channels.push_back({"c", Type::i64(), 4});
+  Type rt = Type::result_i64_text();
+  Expr empty;
+  empty.kind = Expr::Kind::LitText;
+  empty.text = "empty";
+  empty.type = Type::text();
+  g.processes.push_back(process("Poll", {"k"}, {
+    {"Run", false, {try_recv("c", "rr")}, branch(result(Expr::Kind::ResultOk, "rr", rt, Type::boolean()), "Bad", "Count")},
+    {"Count", false, {assign("k", plus("k", lit(1)))}, branch(lt(var("k"), lit(100000)), "Run", "Why")},
+    {"Why", false, {assign("__last_error", result(Expr::Kind::ResultError, "rr", rt, Type::text()))},
+     branch(eq(var("__last_error", Type::text()), empty), "Done", "Bad")},
+  }));
+  g.schedule = {"Poll"};
+  EmitOptions opts;
+  opts.runtime_header = kRuntimeHeaderName;
+  for (bool f : {false, true}) {
+    opts.fused = f;
+    RunResult r = build_and_run(f ? "poll_fused" : "poll", emit_cpp(g, opts) + kCountAllocations);
+    EXPECT_EQ(r.output, "Completed\n0 allocations\n");
+  }
+}
+
+// Src sends 0, 1, 2, ... on a every other tick; Mid receives each and
+// try_sends it on c, retrying until it fits; Cons polls c and sums what it
+// gets, for ever. Mid's try_send follows a receive that blocks every other
+// tick and must not run then, or Cons sees values twice. Under schedule
+// {Src, Mid, Cons, Cons} Cons empties c after every send, so fuse_channels
+// can prove c (not a: Mid may retry on c while a fills).
+static Group relay_group() {
+  Group g;
+  g.name = "Relay";
+  g.channels.push_back({"a", Type::i64(), 2});
+  g.channels.push_back({"c", Type::i64(), 2});
+  Type rt = Type::result_i64_text();
+  Expr sent = result(Expr::Kind::ResultValue, "r", Type::result_bool_text(), Type::boolean());
+  g.processes.push_back(process("Src", {"i"}, {
+    {"Run", false, {send("a", var("i"))}, go("Inc")},
+    {"Inc", false, {assign("i", plus("i", lit(1)))}, go("Run")},
+  }));
+  g.processes.push_back(process("Mid", {"x"}, {
+    {"Run", false, {recv("a", "x"), try_send("c", "r", var("x"))}, branch(sent, "Run", "Retry")},
+    {"Retry", false, {try_send("c", "r", var("x"))}, branch(sent, "Run", "Retry")},
+  }));
+  g.processes.push_back(process("Cons", {"k", "sum"}, {
+    {"Run", false, {try_recv("c", "rr")}, branch(result(Expr::Kind::ResultOk, "rr", rt, Type::boolean()), "Acc", "Run")},
+    {"Acc", false, {assign("sum", plus("sum", result(Expr::Kind::ResultValue, "rr", rt, Type::i64()))),
+                    assign("k", plus("k", lit(1)))},
+     go("Run")},
+  }));
+  g.schedule = {"Src", "Mid", "Cons", "Cons"};
+  return g;
+}
+
+// Runs relay_group-shaped g for the emitted mains' tick budget, through
+// run_group() or step() by step(), and prints whether Cons got 0..k-1
+// exactly once each, and k.
+static std::string run_relay(const std::string& name, const Group& g, bool fused_main) {
+  EmitOptions opts;
+  opts.runtime_header = kRuntimeHeaderName;
+  opts.fused = fused_main;
+  std::string src = emit_cpp(g, opts);
+  src.replace(src.find("int main() {"), 12, "int emitted_main() {");
+  src += R"(
+int main() {
+  Channels channels;
+  Proc_Src src;
+  Proc_Mid mid;
+  Proc_Cons cons;
+)";
+  if (fused_main) {
+    src += "  run_group(channels, src, mid, cons);\n";
+  } else {
+    src += "  for (int tick = 0; tick < 1000000; tick++) {\n";
+    for (auto& s : g.schedule) src += "    " + (s == "Src" ? std::string("src") : s == "Mid" ? "mid" : "cons") + ".step(channels);\n";
+    src += "  }\n";
+  }
+  src += "  std::cout << (cons.sum == cons.k * (cons.k - 1) / 2) << \" \" << cons.k << \"\\n\";\n}\n";
+  return build_and_run(name, src).output;
+}
+
+TEST(BackendTests, FuseChannelsReportsProvenChannels) {
+  Group g = relay_group();
+  EXPECT_TRUE(fuse_channels(g) == (std::vector<std::string>{"c"}));
+  EXPECT_FALSE(g.channels[0].direct);
+  EXPECT_TRUE(g.channels[1].direct);
+
+  // Cons takes from c only every other tick: c may hold two
+  g = relay_group();
+  g.schedule = {"Src", "Mid", "Cons"};
+  EXPECT_TRUE(fuse_channels(g).empty());
+
+  g = rendezvous_pipeline(10);
+  EXPECT_TRUE(fuse_channels(g).empty());
+}
+
+// A fused channel (a single slot) must not change what the group computes,
+// in the sequential and in the fused main.
+TEST(BackendTests, FusedChannelsMatchRings) {
+  Group rings = relay_group();
+  Group slots = rings;
+  ASSERT_EQ(fuse_channels(slots).size(), 1u);
+  std::string seq = run_relay("relay_rings", rings, false);
+  EXPECT_EQ(seq.substr(0, 2), "1 ");
+  EXPECT_EQ(run_relay("relay_slots", slots, false), seq);
+  std::string fused_out = run_relay("relay_rings_fused", rings, true);
+  EXPECT_EQ(fused_out, "MaxTicksExceeded\n" + seq);
+  EXPECT_EQ(run_relay("relay_slots_fused", slots, true), fused_out);
+}
+
+// Src try_sends 0, 1, 2, ... on a until it has sent n and a is full; Cons
+// drains a until it has n and a is empty, then checks it got 0..k-1. Both
+// poll states loop on success, so under @burst(K) a step moves up to K
+// messages.
+static Group burst_group(int64_t n, std::vector<std::string> annotations) {
+  Group g;
+  g.name = "Burst";
+  g.annotations = std::move(annotations);
+  g.channels.push_back({"a", Type::i64(), 16});
+  Type rt = Type::result_i64_text();
+  Expr sent = result(Expr::Kind::ResultValue, "r", Type::result_bool_text(), Type::boolean());
+  Transition fill = branch(sent, "Fill", "Hold");
+  fill.then_actions = {assign("i", plus("i", lit(1)))};
+  g.processes.push_back(process("Src", {"i"}, {
+    {"Fill", false, {try_send("a", "r", var("i"))}, fill},
+    {"Hold", false, {}, branch(lt(var("i"), lit(n)), "Fill", "Done")},
+  }));
+  Transition drain = branch(result(Expr::Kind::ResultOk, "rr", rt, Type::boolean()), "Run", "Idle");
+  drain.then_actions = {assign("sum", plus("sum", result(Expr::Kind::ResultValue, "rr", rt, Type::i64()))),
+                        assign("k", plus("k", lit(1)))};
+  Expr all = bin("&&", eq(var("sum"), bin("/", bin("*", var("k"), bin("-", var("k"), lit(1))), lit(2))),
+                 bin(">=", var("k"), lit(n), Type::boolean()), Type::boolean());
+  g.processes.push_back(process("Cons", {"k", "sum"}, {
+    {"Run", false, {try_recv("a", "rr")}, drain},
+    {"Idle", false, {}, branch(lt(var("k"), lit(n)), "Run", "Check")},
+    {"Check", false, {}, branch(all, "Done", "Bad")},
+  }));
+  g.schedule = {"Src", "Cons", "Cons"};
+  return g;
+}
+
+TEST(BackendTests, BurstLimit) {
+  EXPECT_EQ(burst_limit(burst_group(1, {})), 1u);
+  EXPECT_EQ(burst_limit(burst_group(1, {"pipeline_safe", "burst(8)"})), 8u);
+  EXPECT_EQ(burst_limit(burst_group(1, {"burst(999999999)"})), 999999999u);
+  for (const char* bad : {"burst(0)", "burst()", "burst(x)", "burst(-1)", "burst(1000000000)",
+                          "burst(99999999999999999999)"}) {
+    EXPECT_THROW(burst_limit(burst_group(1, {bad})), std::runtime_error);
+  }
+}
+
+TEST(BackendTests, BurstStatesRunInBursts) {
+  Group plain = burst_group(10000, {});
+  Group burst = burst_group(10000, {"burst(8)"});
+  EXPECT_EQ(emit_cpp(plain, true).find("__burst"), std::string::npos);
+  EXPECT_NE(emit_cpp(burst, true).find("__burst < 8"), std::string::npos);
+  EXPECT_EQ(run_group("burst_off", plain).output, "Completed\n");
+  EXPECT_EQ(run_group("burst_seq", burst).output, "Completed\n");
+  EXPECT_EQ(run_group("burst_fused", burst, fused()).output, "Completed\n");
+}
+
+// build_exes() compiles each unit once; a rebuild copies cached executables
+// and after one group changes, only that group compiles again.
+TEST(BackendTests, BuildCache) {
+  fs::path dir = aot_dir() / "cache";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  EmitOptions opts;
+  opts.runtime_header = kRuntimeHeaderName;
+  auto unit = [&](const std::string& name, const Group& g) {
+    return BuildUnit{name, emit_cpp(g, opts), (dir / (name + ".exe")).string()};
+  };
+  auto completes = [&](const BuildUnit& u) {
+    return std::system(("\"" + u.out_exe_path + "\" >\"" + (dir / "run.log").string() + "\" 2>&1").c_str()) == 0;
+  };
+  std::vector<BuildUnit> units = {unit("rendezvous", rendezvous_pipeline(10)), unit("pipeline", buffered_pipeline(2, 10, 10))};
+  BuildOptions build;
+  build.optO2 = false;
+  build.cache_dir = (dir / "store").string();
+  using O = BuildOutcome;
+
+  EXPECT_TRUE(build_exes(units, build) == (std::vector<O>{O::Built, O::Built}));
+  for (auto& u : units) {
+    fs::remove(u.out_exe_path);
+    EXPECT_TRUE(build_exes({u}, build) == std::vector<O>{O::Cached});
+    EXPECT_TRUE(completes(u));
+  }
+
+  units[1] = unit("pipeline", buffered_pipeline(2, 20, 20));
+  EXPECT_TRUE(build_exes(units, build) == (std::vector<O>{O::Cached, O::Built}));
+  EXPECT_TRUE(completes(units[1]));
+
+  units[0].cpp_source += "#error broken\n";
+  EXPECT_TRUE(build_exes(units, build) == (std::vector<O>{O::Failed, O::Cached}));
+}
+
+TEST(BackendTests, ReadProfile) {
+  Profile prof;
+  std::istringstream one("caps-profile 1 G\nstate P Run 10 6 4 2\nchannel c 1 3\n");
+  std::istringstream two("caps-profile 1 G\n\nstate P Run 5 1 4 0\nstate P Done 1 0 0 0\n");
+  read_profile(one, prof);
+  read_profile(two, prof);
+  EXPECT_EQ(prof.group, "G");
+  auto& run = prof.states[{"P", "Run"}];
+  EXPECT_EQ(run.entered, 15u);
+  EXPECT_EQ(run.then_taken, 7u);
+  EXPECT_EQ(run.else_taken, 8u);
+  EXPECT_EQ(run.blocked, 2u);
+  EXPECT_EQ(prof.states.size(), 2u);
+  EXPECT_EQ(prof.channels["c"].recv_blocked, 3u);
+
+  for (const char* bad : {"", "state P Run 1 0 0 0\n", "caps-profile 2 G\n", "caps-profile 1 H\n",
+                          "caps-profile 1 G\nstate P Run 1 0\n", "caps-profile 1 G\nchannel c x 0\n",
+                          "caps-profile 1 G\nedge a b\n"}) {
+    std::istringstream in(bad);
+    Profile p;
+    p.group = "G";
+    EXPECT_THROW(read_profile(in, p), std::runtime_error);
+  }
+}
+
+// buffered_pipeline plus Tick, which counts to 10 on its own: it shares no
+// channel with the others and is entered least, so a profile moves it to
+// the end of the schedule.
+static Group ticked_pipeline(int64_t n) {
+  Group g = buffered_pipeline(4, n, n);
+  g.processes.push_back(process("Tick", {"t"}, {
+    {"Run", false, {assign("t", plus("t", lit(1)))}, branch(lt(var("t"), lit(10)), "Run", "Done")},
+  }));
+  g.schedule.insert(g.schedule.begin(), "Tick");
+  return g;
+}
+
+// An instrumented run writes its counts; a build that uses them runs the
+// group as before, with the cold process stepped last.
+TEST(BackendTests, ProfileGuidedBuild) {
+  Group g = ticked_pipeline(1000);
+  const std::string path = (aot_dir() / "pipeline.profile").string();
+  fs::remove(path);
+  EmitOptions opts;
+  opts.instrument = path;
+  ASSERT_EQ(run_group("profile_instrumented", g, opts).output, "Completed\n");
+
+  Profile prof;
+  std::ifstream in(path);
+  read_profile(in, prof);
+  EXPECT_EQ(prof.group, "Pipeline");
+  auto& acc = prof.states[{"Cons", "Acc"}];
+  auto& recv = prof.states[{"Cons", "Run"}];
+  auto& count = prof.states[{"Tick", "Run"}];
+  EXPECT_EQ(acc.entered, 1000u);
+  EXPECT_EQ(acc.then_taken, 999u);
+  EXPECT_EQ(acc.else_taken, 1u);
+  EXPECT_EQ(count.entered, 10u);
+  EXPECT_EQ(recv.entered, recv.blocked + 1000);
+
+  // the fused main counts the same
+  std::string fused_path = (aot_dir() / "pipeline_fused.profile").string();
+  opts.instrument = fused_path;
+  opts.fused = true;
+  ASSERT_EQ(run_group("profile_instrumented_fused", g, opts).output, "Completed\n");
+  Profile fused_prof;
+  std::ifstream fused_in(fused_path);
+  read_profile(fused_in, fused_prof);
+  EXPECT_EQ(fused_prof.states.size(), prof.states.size());
+  for (auto& kv : prof.states) {
+    auto& f = fused_prof.states[kv.first];
+    EXPECT_TRUE(f.entered == kv.second.entered && f.then_taken == kv.second.then_taken &&
+                f.else_taken == kv.second.else_taken && f.blocked == kv.second.blocked);
+  }
+
+  EmitOptions use;
+  use.profile = &prof;
+  std::string src = emit_cpp(g, use);
+  EXPECT_NE(src.find("CAPS_LIKELY((k < 1000))"), std::string::npos);
+  size_t prod = src.find("Prod.step(channels)"), cons = src.find("Cons.step(channels)"), tick = src.find("Tick.step(channels)");
+  EXPECT_TRUE(prod < cons && cons < tick);
+  EXPECT_EQ(run_group("profile_use", g, use).output, "Completed\n");
+  use.fused = true;
+  EXPECT_EQ(run_group("profile_use_fused", g, use).output, "Completed\n");
+
+  // a profile only applies to its own group
+  Group other = g;
+  other.name = "Other";
+  EXPECT_THROW(emit_cpp(other, use), std::runtime_error);
+}
@@ -0,0 +1,193 @@
+#include "backend/batch.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace caps {
+
+const char* run_reason_text(RunReason r) {
+  switch (r) {
+    case RunReason::AllTerminal: return "allprocessesterminal";
+    case RunReason::NoProgress: return "allprocessesblockednoprogress";
+    case RunReason::MaxTicks: return "maxticks_exceeded";
+    case RunReason::Error: return "error";
+  }
+  return "error";
+}
+
+static RunReason reason_of(const std::string& s) {
+  if (s == "allprocessesterminal") return RunReason::AllTerminal;
+  if (s == "allprocessesblockednoprogress") return RunReason::NoProgress;
+  if (s == "maxticks_exceeded") return RunReason::MaxTicks;
+  return RunReason::Error;
+}
+
+BatchOutput find_batch_slot(const IRGroup& g, const std::string& qualified) {
+  BatchOutput o;
+  o.name = qualified;
+  auto dot = qualified.find('.');
+  if (dot == std::string::npos) return o;
+  std::string proc = qualified.substr(0, dot);
+  for (uint32_t i = 0; i < g.processes.size(); i++) {
+    if (g.processes[i].name != proc) continue;
+    o.slot = g.processes[i].find_slot(qualified.substr(dot + 1));
+    if (o.slot != kNoSlot) o.proc = i;
+    break;
+  }
+  return o;
+}
+
+namespace {
+
+// A worker's remaining instances [begin, end), packed into one word so the
+// owner (taking from the front) and thieves (taking the back half) claim work
+// with a single CAS and never hold a lock.
+struct alignas(64) WorkRange {
+  std::atomic<uint64_t> r{0};
+
+  static uint64_t pack(uint32_t b, uint32_t e) { return (uint64_t)b << 32 | e; }
+
+  void reset(uint32_t b, uint32_t e) { r.store(pack(b, e), std::memory_order_release); }
+
+  uint32_t remaining() const {
+    uint64_t cur = r.load(std::memory_order_relaxed);
+    uint32_t b = (uint32_t)(cur >> 32), e = (uint32_t)cur;
+    return b < e ? e - b : 0;
+  }
+
+  bool take_front(uint32_t& i) {
+    uint64_t cur = r.load(std::memory_order_acquire);
+    for (;;) {
+      uint32_t b = (uint32_t)(cur >> 32), e = (uint32_t)cur;
+      if (b >= e) return false;
+      if (r.compare_exchange_weak(cur, pack(b + 1, e), std::memory_order_acq_rel)) {
+        i = b;
+        return true;
+      }
+    }
+  }
+
+  bool steal_half(uint32_t& b_out, uint32_t& e_out) {
+    uint64_t cur = r.load(std::memory_order_acquire);
+    for (;;) {
+      uint32_t b = (uint32_t)(cur >> 32), e = (uint32_t)cur;
+      if (b >= e) return false;
+      uint32_t mid = b + (e - b) / 2;
+      if (r.compare_exchange_weak(cur, pack(b, mid), std::memory_order_acq_rel)) {
+        b_out = mid;
+        e_out = e;
+        return true;
+      }
+    }
+  }
+};
+
+} // namespace
+
+static void check_spec(const BatchSpec& spec) {
+  if (!spec.group || !spec.group->linked) throw std::runtime_error("run_batch: group not linked (call link_group)");
+  if (spec.instances >= UINT32_MAX) throw std::runtime_error("run_batch: too many instances");
+  auto& g = *spec.group;
+  for (auto& in : spec.inputs) {
+    if (in.proc >= g.processes.size() || in.slot >= g.processes[in.proc].slot_names.size())
+      throw std::runtime_error("run_batch: input refers to an unknown process slot");
+    if (in.values.size() != spec.instances) throw std::runtime_error("run_batch: input column size != instances");
+  }
+  for (auto& o : spec.outputs) {
+    if (o.proc >= g.processes.size() || o.slot >= g.processes[o.proc].slot_names.size())
+      throw std::runtime_error("run_batch: unknown output: " + o.name);
+  }
+}
+
+BatchResult run_batch(const BatchSpec& spec) {
+  check_spec(spec);
+  auto& g = *spec.group;
+
+  BatchResult res;
+  res.outputs = spec.outputs;
+  if (res.outputs.empty()) {
+    for (uint32_t p = 0; p < g.processes.size(); p++) {
+      auto& def = g.processes[p];
+      for (uint32_t s = def.output_slot_begin; s < def.output_slot_end; s++)
+        res.outputs.push_back({p, s, def.name + "." + def.slot_names[s]});
+    }
+  }
+  const size_t ncols = res.outputs.size();
+  res.runs.resize(spec.instances);
+  res.values.resize(spec.instances * ncols);
+
+  unsigned threads = spec.threads ? spec.threads : std::thread::hardware_concurrency();
+  threads = (unsigned)std::max<size_t>(1, std::min<size_t>(threads, spec.instances));
+  const uint32_t n = (uint32_t)spec.instances;
+
+  std::unique_ptr<WorkRange[]> ranges(new WorkRange[threads]);
+  for (unsigned k = 0; k < threads; k++) ranges[k].reset((uint32_t)((uint64_t)n * k / threads), (uint32_t)((uint64_t)n * (k + 1) / threads));
+
+  std::mutex err_mu;
+
+  auto run_one = [&](Runtime& rt, uint32_t i) {
+    reset_runtime(rt);
+    for (auto& in : spec.inputs) rt.procs[in.proc].slots[in.slot] = in.values[i];
+
+    BatchRun& out = res.runs[i];
+    try {
+      RunResult r = run_group(rt, nullptr, spec.max_ticks, spec.mode);
+      out.status = r.status;
+      out.reason = reason_of(r.reason);
+    } catch (const std::exception& e) {
+      out.status = RunStatus::Error;
+      out.reason = RunReason::Error;
+      std::lock_guard<std::mutex> lock(err_mu);
+      res.errors.push_back({i, e.what()});
+    }
+    out.tick = rt.tick;
+
+    Value* row = res.values.data() + (size_t)i * ncols;
+    for (size_t k = 0; k < ncols; k++) row[k] = rt.procs[res.outputs[k].proc].slots[res.outputs[k].slot];
+  };
+
+  auto worker = [&](unsigned k, Runtime& rt) {
+    for (;;) {
+      uint32_t i;
+      if (ranges[k].take_front(i)) {
+        run_one(rt, i);
+        continue;
+      }
+
+      // own range drained: steal the back half of the fullest one
+      unsigned victim = k;
+      uint32_t most = 0;
+      for (unsigned v = 0; v < threads; v++) {
+        uint32_t left = ranges[v].remaining();
+        if (v != k && left > most) { most = left; victim = v; }
+      }
+      if (victim == k) break;
+      uint32_t b, e;
+      if (ranges[victim].steal_half(b, e)) ranges[k].reset(b, e);
+    }
+  };
+
+  // the calling thread is worker 0; initialising its runtime first surfaces
+  // group errors here rather than on a pool thread
+  Runtime rt0;
+  init_runtime(rt0, g);
+
+  std::vector<std::thread> pool;
+  for (unsigned k = 1; k < threads; k++) {
+    pool.emplace_back([&, k] {
+      Runtime rt;
+      init_runtime(rt, g);
+      worker(k, rt);
+    });
+  }
+  worker(0, rt0);
+  for (auto& th : pool) th.join();
+
+  std::sort(res.errors.begin(), res.errors.end());
+  return res;
+}
+
+} // namespace caps
@@ -0,0 +1,66 @@
+#pragma once
+#include "backend/scheduler.h"
+#include <string>
+#include <vector>
+
+namespace caps {
+
+// Batch simulation: many independent runs of one linked IRGroup, differing only
+// in initial slot values. The group is shared read-only; each worker thread
+// keeps one Runtime and resets it between instances (see reset_runtime), so a
+// run allocates nothing the previous run on that worker did not already have.
+
+// Per-instance initial value of one process slot, stored as a column
+// (structure of arrays): values[i] is the value for instance i.
+struct BatchInput {
+  uint32_t proc = kNoSlot;
+  uint32_t slot = kNoSlot;
+  std::vector<Value> values;
+};
+
+// A process slot collected after every run.
+struct BatchOutput {
+  uint32_t proc = kNoSlot;
+  uint32_t slot = kNoSlot;
+  std::string name; // "Process.var"
+};
+
+struct BatchSpec {
+  const IRGroup* group = nullptr; // linked
+  size_t instances = 0;
+  std::vector<BatchInput> inputs;   // each column holds `instances` values
+  std::vector<BatchOutput> outputs; // empty: every declared output of every process
+  uint64_t max_ticks = 1'000'000;
+  SchedulerMode mode = SchedulerMode::RoundRobin;
+  unsigned threads = 0; // 0: std::thread::hardware_concurrency()
+};
+
+// RunResult::reason without the string.
+enum class RunReason : uint8_t { AllTerminal, NoProgress, MaxTicks, Error };
+
+const char* run_reason_text(RunReason r); // the RunResult::reason spelling; "error" for Error
+
+struct BatchRun {
+  uint64_t tick = 0; // Runtime::tick when the run stopped
+  RunStatus status = RunStatus::Running;
+  RunReason reason = RunReason::MaxTicks;
+};
+
+struct BatchResult {
+  std::vector<BatchRun> runs;         // one per instance
+  std::vector<BatchOutput> outputs;   // resolved output columns
+  std::vector<Value> values;          // instance-major: values[i * outputs.size() + k]
+  std::vector<std::pair<size_t, std::string>> errors; // (instance, message) for RunReason::Error
+
+  const Value& output(size_t instance, size_t column) const { return values[instance * outputs.size() + column]; }
+};
+
+// Looks up "Process.var" in a linked group; kNoSlot fields if unknown.
+BatchOutput find_batch_slot(const IRGroup& g, const std::string& qualified);
+
+// Runs spec.instances instances over a work-stealing pool. A runtime error in
+// one instance ends that run with RunStatus::Error, is recorded in
+// BatchResult::errors and does not stop the batch.
+BatchResult run_batch(const BatchSpec& spec);
+
+} // namespace caps
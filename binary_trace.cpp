@@ -0,0 +1,682 @@
+#include "backend/binary_trace.h"
+#include "backend/lz.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace caps {
+
+static const char kMagic[8] = {'C', 'A', 'P', 'S', 'T', 'R', 'C', 'E'};
+static const char kIndexMagic[8] = {'C', 'A', 'P', 'S', 'T', 'I', 'D', 'X'};
+static constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// A buffer is handed over once less than this is left, so records almost
+// never grow it past its preallocated capacity.
+static constexpr size_t kSlack = 4096;
+
+BinaryTraceSink::BinaryTraceSink(const IRGroup& g, std::ostream& os, ChannelTrace channels, size_t buffer_bytes,
+                                 unsigned buffers)
+    : BinaryTraceSink(g, os, BinaryTraceOptions{channels, TraceLayout::Stream, TraceCodec::None, buffer_bytes, buffers}) {}
+
+BinaryTraceSink::BinaryTraceSink(const IRGroup& g, std::ostream& os, const BinaryTraceOptions& opts)
+    : out(os), mode(opts.channels), layout(opts.layout), codec(opts.codec), seen(g.channels.size()),
+      nbuffers(opts.buffers < 2 ? 2 : opts.buffers) {
+  buffer_bytes = opts.buffer_bytes < 4 * kSlack ? 4 * kSlack : opts.buffer_bytes;
+  cur.reserve(buffer_bytes);
+  free_bufs.resize(nbuffers - 1);
+  for (auto& b : free_bufs) b.reserve(buffer_bytes);
+
+  put(kMagic, sizeof(kMagic));
+  uint32_t version = kBinaryTraceVersion, bom = kByteOrderMark;
+  put(&version, 4);
+  put(&bom, 4);
+  put(&mode, 4);
+  put(&layout, 4);
+
+  auto put_names = [&](const std::vector<std::string>& names) {
+    uint32_t n = (uint32_t)names.size();
+    put(&n, 4);
+    for (auto& s : names) put_text(s);
+  };
+  uint32_t n = (uint32_t)g.processes.size();
+  put(&n, 4);
+  for (auto& p : g.processes) {
+    put_text(p.name);
+    put_names(p.state_names);
+    put_names(p.slot_names);
+  }
+  n = (uint32_t)g.channels.size();
+  put(&n, 4);
+  for (auto& c : g.channels) {
+    put_text(c.name);
+    uint64_t cap = c.capacity;
+    put(&cap, 8);
+  }
+
+  writer = std::thread([this] { writer_loop(); });
+  if (layout == TraceLayout::Chunked) submit(); // chunks start after the header
+}
+
+BinaryTraceSink::~BinaryTraceSink() {
+  try {
+    close();
+  } catch (...) {
+    // nowhere to report it; close() is the checked path
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    stop = true;
+  }
+  cv_full.notify_one();
+  writer.join();
+}
+
+// Writer thread. Chunks are compressed here, off the traced run.
+void BinaryTraceSink::write_block(Block& b) {
+  const std::vector<uint8_t>* bytes = &b.bytes;
+  if (b.chunk) {
+    TraceChunkEntry e{};
+    e.offset = written;
+    e.first_tick = b.first_tick;
+    e.raw = (uint32_t)b.bytes.size();
+    e.codec = TraceCodec::None;
+    if (codec == TraceCodec::LZ) {
+      lz_compress(b.bytes.data(), b.bytes.size(), packed);
+      if (packed.size() < b.bytes.size()) {
+        bytes = &packed;
+        e.codec = TraceCodec::LZ;
+      }
+    }
+    e.stored = (uint32_t)bytes->size();
+    index.push_back(e);
+  }
+  out.write((const char*)bytes->data(), (std::streamsize)bytes->size());
+  written += bytes->size();
+}
+
+void BinaryTraceSink::writer_loop() {
+  std::unique_lock<std::mutex> lock(mu);
+  for (;;) {
+    cv_full.wait(lock, [&] { return stop || !queued.empty(); });
+    if (queued.empty()) return;
+
+    Block b = std::move(queued.front());
+    queued.pop_front();
+    lock.unlock();
+    write_block(b);
+    bool ok = (bool)out;
+    b.bytes.clear();
+    lock.lock();
+
+    failed = failed || !ok;
+    free_bufs.push_back(std::move(b.bytes));
+    cv_free.notify_all();
+  }
+}
+
+void BinaryTraceSink::submit(bool chunk) {
+  std::unique_lock<std::mutex> lock(mu);
+  queued.push_back(Block{std::move(cur), chunk, chunk_tick});
+  if (layout == TraceLayout::Stream && mode == ChannelTrace::Deltas) resync = true;
+  cv_full.notify_one();
+  cv_free.wait(lock, [&] { return !free_bufs.empty(); });
+  cur = std::move(free_bufs.back());
+  free_bufs.pop_back();
+}
+
+void BinaryTraceSink::wait_written() {
+  std::unique_lock<std::mutex> lock(mu);
+  cv_free.wait(lock, [&] { return free_bufs.size() == nbuffers - 1; });
+  out.flush();
+  if (failed || !out) throw std::runtime_error("binary trace: write failed");
+}
+
+void BinaryTraceSink::flush() {
+  if (layout == TraceLayout::Stream && !cur.empty()) submit();
+  wait_written();
+}
+
+void BinaryTraceSink::close() {
+  if (closed) return;
+  closed = true;
+  if (layout == TraceLayout::Stream) {
+    flush();
+    return;
+  }
+  if (!cur.empty()) submit(true);
+  wait_written();
+  // the writer is idle until the next submit, which never comes
+  TraceFooter f{};
+  f.index_offset = written;
+  f.chunks = index.size();
+  std::memcpy(f.magic, kIndexMagic, sizeof(kIndexMagic));
+  out.write((const char*)index.data(), (std::streamsize)(index.size() * sizeof(TraceChunkEntry)));
+  out.write((const char*)&f, sizeof(f));
+  out.flush();
+  if (!out) throw std::runtime_error("binary trace: write failed");
+}
+
+void BinaryTraceSink::put(const void* p, size_t n) {
+  size_t at = cur.size();
+  cur.resize(at + n);
+  std::memcpy(cur.data() + at, p, n);
+}
+
+void BinaryTraceSink::put_text(const std::string& s) {
+  uint32_t n = (uint32_t)s.size();
+  put(&n, 4);
+  put(s.data(), s.size());
+}
+
+void BinaryTraceSink::put_buffer(ChannelView b) {
+  uint32_t n = (uint32_t)b.size();
+  put(&n, 4);
+  for (auto& v : b) encode_value(cur, v);
+}
+
+void BinaryTraceSink::put_seq(uint64_t seq) {
+  put(&seq, 8);
+}
+
+// Deltas: a channel's first event is preceded by its current contents, so a
+// trace of a restored or reused runtime replays from the right buffer. So is
+// any event after pushes or pops that were not traced (a filtered run), seen
+// as counters that moved by more than the event's own push/pop.
+void BinaryTraceSink::touch(const Channel& c, uint64_t pushed, uint64_t popped) {
+  if (mode != ChannelTrace::Deltas) return;
+  Seen& s = seen[c.id];
+  uint64_t head = c.head.get(), tail = c.tail.get();
+  if (!s.known || s.head + popped != head || s.tail + pushed != tail) {
+    begin(TraceOp::ChannelSnapshot, 0, c.id);
+    put_seq(head); // after a try_*: its own seq is then already included
+    put_buffer(c.view());
+    end();
+  }
+  s = Seen{head, tail, true};
+}
+
+void BinaryTraceSink::begin(TraceOp op, uint32_t proc, uint32_t arg, uint8_t flag) {
+  BinaryTraceRecord r;
+  r.op = op;
+  r.flag = flag;
+  r.proc = proc;
+  r.arg = arg;
+  rec_at = cur.size();
+  put(&r, sizeof(r));
+}
+
+void BinaryTraceSink::end() {
+  uint32_t payload = (uint32_t)(cur.size() - rec_at - sizeof(BinaryTraceRecord));
+  if (payload) std::memcpy(cur.data() + rec_at + offsetof(BinaryTraceRecord, payload), &payload, 4);
+  if (layout == TraceLayout::Stream && cur.size() + kSlack > cur.capacity()) submit();
+}
+
+void BinaryTraceSink::on_tick_begin(uint64_t tick) {
+  if (layout == TraceLayout::Chunked) {
+    // a tick never straddles chunks; one larger than a buffer just grows it
+    if (cur.size() + kSlack > buffer_bytes) {
+      submit(true);
+      for (auto& c : seen) c.known = false;
+    }
+    if (cur.empty()) chunk_tick = tick;
+  } else if (resync) {
+    // a point a diff can decode from, as from a chunk
+    resync = false;
+    for (auto& c : seen) c.known = false;
+    begin(TraceOp::Resync);
+    end();
+  }
+  begin(TraceOp::TickBegin);
+  put(&tick, 8);
+  end();
+}
+
+void BinaryTraceSink::on_tick_end(uint64_t) {
+  begin(TraceOp::TickEnd);
+  end();
+}
+
+void BinaryTraceSink::on_process_step_begin(uint64_t, const ProcessInstance& p) {
+  begin(TraceOp::StepBegin, p.id, p.state);
+  end();
+}
+
+void BinaryTraceSink::on_process_step_end(uint64_t, const ProcessInstance& p) {
+  begin(TraceOp::StepEnd, p.id, p.state, (uint8_t)p.status);
+  end();
+}
+
+void BinaryTraceSink::on_assign(const ProcessInstance& p, uint32_t slot, const Value& before, const Value& after) {
+  begin(TraceOp::Assign, p.id, slot);
+  encode_value(cur, before);
+  encode_value(cur, after);
+  end();
+}
+
+void BinaryTraceSink::on_send_begin(const ProcessInstance& p, const Channel& c, const Value& v) {
+  touch(c);
+  begin(TraceOp::SendBegin, p.id, c.id);
+  encode_value(cur, v);
+  if (mode == ChannelTrace::Buffers) put_buffer(c.view());
+  end();
+}
+
+void BinaryTraceSink::on_send_end(const ProcessInstance& p, const Channel& c) {
+  touch(c, c.capacity ? 1 : 0, 0);
+  begin(TraceOp::SendEnd, p.id, c.id);
+  if (mode == ChannelTrace::Buffers) put_buffer(c.view());
+  else if (c.capacity) put_seq(c.tail.get() - 1);
+  end();
+}
+
+void BinaryTraceSink::on_receive_begin(const ProcessInstance& p, const Channel& c) {
+  touch(c);
+  begin(TraceOp::ReceiveBegin, p.id, c.id);
+  if (mode == ChannelTrace::Buffers) put_buffer(c.view());
+  end();
+}
+
+void BinaryTraceSink::on_receive_end(const ProcessInstance& p, const Channel& c, const Value& v) {
+  touch(c, 0, c.capacity ? 1 : 0);
+  begin(TraceOp::ReceiveEnd, p.id, c.id);
+  encode_value(cur, v);
+  if (mode == ChannelTrace::Buffers) put_buffer(c.view());
+  else if (c.capacity) put_seq(c.head.get() - 1);
+  end();
+}
+
+void BinaryTraceSink::on_try_send(const ProcessInstance& p, const Channel& c, const Value& v, bool success) {
+  touch(c, success && c.capacity ? 1 : 0, 0);
+  begin(TraceOp::TrySend, p.id, c.id, success ? 1 : 0);
+  encode_value(cur, v);
+  if (mode == ChannelTrace::Buffers) put_buffer(c.view());
+  else if (success && c.capacity) put_seq(c.tail.get() - 1);
+  end();
+}
+
+void BinaryTraceSink::on_try_receive(const ProcessInstance& p, const Channel& c, bool ok, const Value& v) {
+  touch(c, 0, ok && c.capacity ? 1 : 0);
+  begin(TraceOp::TryReceive, p.id, c.id, ok ? 1 : 0);
+  encode_value(cur, v);
+  if (mode == ChannelTrace::Buffers) put_buffer(c.view());
+  else if (ok && c.capacity) put_seq(c.head.get() - 1);
+  end();
+}
+
+void BinaryTraceSink::on_block(const ProcessInstance& p, const Channel& c, BlockReason reason) {
+  begin(TraceOp::Block, p.id, c.id, (uint8_t)reason);
+  end();
+}
+
+void BinaryTraceSink::on_transition_skipped(uint64_t, const ProcessInstance& p, const char* reason) {
+  begin(TraceOp::TransitionSkipped, p.id);
+  put_text(reason);
+  end();
+}
+
+void BinaryTraceSink::on_status(const std::string& status, const std::string& reason, const Runtime& rt) {
+  for (auto& c : rt.channels) touch(c);
+  begin(TraceOp::Status);
+  put_text(status);
+  put_text(reason);
+  for (auto& p : rt.procs) {
+    put(&p.state, 4);
+    cur.push_back((uint8_t)p.status);
+  }
+  if (mode == ChannelTrace::Buffers) {
+    for (auto& c : rt.channels) put_buffer(c.view());
+  }
+  end();
+}
+
+// --- replay / reader ---
+
+ChannelReplay::Buffer& ChannelReplay::at(uint32_t chan) {
+  if (chan >= bufs.size()) throw std::runtime_error("binary trace: bad channel id");
+  return bufs[chan];
+}
+
+void ChannelReplay::reset(size_t nchannels) {
+  bufs.assign(nchannels, Buffer{});
+}
+
+void ChannelReplay::snapshot(uint32_t chan, uint64_t head, std::vector<std::string> items) {
+  Buffer& b = at(chan);
+  b.head = head;
+  b.items.assign(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+}
+
+void ChannelReplay::push(uint32_t chan, uint64_t seq, std::string item) {
+  Buffer& b = at(chan);
+  uint64_t next = b.head + b.items.size();
+  if (seq < next) return; // already in a snapshot
+  if (seq > next) throw std::runtime_error("binary trace: channel push out of sequence");
+  b.items.push_back(std::move(item));
+}
+
+void ChannelReplay::pop(uint32_t chan, uint64_t seq) {
+  Buffer& b = at(chan);
+  if (seq < b.head) return; // already gone in a snapshot
+  if (seq > b.head || b.items.empty()) throw std::runtime_error("binary trace: channel pop out of sequence");
+  b.items.pop_front();
+  b.head++;
+}
+
+std::string ChannelReplay::format(uint32_t chan) const {
+  std::string s = "[";
+  for (auto& v : bufs[chan].items) {
+    if (s.size() > 1) s += ", ";
+    s += v;
+  }
+  return s + "]";
+}
+
+namespace {
+
+struct TraceCursor {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  const uint8_t* take(size_t n) {
+    if ((size_t)(end - p) < n) throw std::runtime_error("binary trace: truncated");
+    const uint8_t* at = p;
+    p += n;
+    return at;
+  }
+  uint8_t u8() { return *take(1); }
+  uint32_t u32() { uint32_t v; std::memcpy(&v, take(4), 4); return v; }
+  uint64_t u64() { uint64_t v; std::memcpy(&v, take(8), 8); return v; }
+  std::string text() {
+    uint32_t n = u32();
+    return std::string((const char*)take(n), n);
+  }
+  std::vector<std::string> names() {
+    std::vector<std::string> v(u32());
+    for (auto& s : v) s = text();
+    return v;
+  }
+  std::string value() { return encoded_to_string(p, end); }
+  std::vector<std::string> buffer() {
+    std::vector<std::string> items(u32());
+    for (auto& s : items) s = value();
+    return items;
+  }
+};
+
+const std::string& name_at(const std::vector<std::string>& names, uint32_t i) {
+  if (i >= names.size()) throw std::runtime_error("binary trace: bad id");
+  return names[i];
+}
+
+ProcStatus status_of(uint8_t v) {
+  if (v > (uint8_t)ProcStatus::Finished) throw std::runtime_error("binary trace: bad status");
+  return (ProcStatus)v;
+}
+
+} // namespace
+
+BinaryTraceReader::BinaryTraceReader(const uint8_t* d, size_t n) : data(d), size(n) {
+  TraceCursor r{data, data + size};
+  if (size < sizeof(kMagic) || std::memcmp(r.take(sizeof(kMagic)), kMagic, sizeof(kMagic)) != 0)
+    throw std::runtime_error("binary trace: not a CAPS trace");
+  if (r.u32() != kBinaryTraceVersion) throw std::runtime_error("binary trace: unsupported version");
+  if (r.u32() != kByteOrderMark) throw std::runtime_error("binary trace: byte order mismatch");
+  uint32_t m = r.u32();
+  if (m > (uint32_t)ChannelTrace::Deltas) throw std::runtime_error("binary trace: unknown channel mode");
+  mode_ = (ChannelTrace)m;
+  uint32_t l = r.u32();
+  if (l > (uint32_t)TraceLayout::Chunked) throw std::runtime_error("binary trace: unknown layout");
+  layout_ = (TraceLayout)l;
+
+  procs_.resize(r.u32());
+  for (auto& pr : procs_) {
+    pr.name = r.text();
+    pr.states = r.names();
+    pr.slots = r.names();
+  }
+  chan_names.resize(r.u32());
+  capacity.resize(chan_names.size());
+  for (size_t i = 0; i < chan_names.size(); i++) {
+    chan_names[i] = r.text();
+    capacity[i] = r.u64();
+  }
+  replay.reset(chan_names.size());
+  records = p = r.p;
+  end = data + size;
+  if (layout_ == TraceLayout::Stream) return;
+
+  TraceFooter f;
+  if ((size_t)(end - p) < sizeof(f)) throw std::runtime_error("binary trace: missing index (trace not closed?)");
+  std::memcpy(&f, end - sizeof(f), sizeof(f));
+  if (std::memcmp(f.magic, kIndexMagic, sizeof(kIndexMagic)) != 0)
+    throw std::runtime_error("binary trace: missing index (trace not closed?)");
+  size_t index_end = size - sizeof(f);
+  if (f.index_offset < (uint64_t)(p - data) || f.index_offset > index_end ||
+      f.chunks != (index_end - f.index_offset) / sizeof(TraceChunkEntry) ||
+      (index_end - f.index_offset) % sizeof(TraceChunkEntry) != 0)
+    throw std::runtime_error("binary trace: bad index");
+  index.resize((size_t)f.chunks);
+  if (!index.empty()) std::memcpy(index.data(), data + f.index_offset, index.size() * sizeof(TraceChunkEntry));
+  for (auto& e : index) {
+    if (e.offset < (uint64_t)(records - data) || e.offset > f.index_offset || e.stored > f.index_offset - e.offset ||
+        e.codec > TraceCodec::LZ || (e.codec == TraceCodec::None && e.stored != e.raw))
+      throw std::runtime_error("binary trace: bad index");
+  }
+  p = end = nullptr;
+}
+
+// Chunked: moves p/end to the next chunk's records; false after the last.
+bool BinaryTraceReader::load_chunk() {
+  if (next_chunk >= index.size()) return false;
+  const TraceChunkEntry& e = index[next_chunk++];
+  const uint8_t* at = data + e.offset;
+  if (e.codec == TraceCodec::None) {
+    p = at;
+  } else {
+    unpacked.resize(e.raw);
+    lz_decompress(at, e.stored, unpacked.data(), e.raw);
+    p = unpacked.data();
+  }
+  end = p + e.raw;
+  return true;
+}
+
+const std::string& BinaryTraceReader::proc_name(uint32_t id) const {
+  if (id >= procs_.size()) throw std::runtime_error("binary trace: bad process id");
+  return procs_[id].name;
+}
+
+const std::string& BinaryTraceReader::state_name(uint32_t proc, uint32_t state) const {
+  proc_name(proc);
+  return name_at(procs_[proc].states, state);
+}
+
+const std::string& BinaryTraceReader::slot_name(uint32_t proc, uint32_t slot) const {
+  proc_name(proc);
+  return name_at(procs_[proc].slots, slot);
+}
+
+const std::string& BinaryTraceReader::channel_name(uint32_t chan) const {
+  return name_at(chan_names, chan);
+}
+
+bool BinaryTraceReader::seek(uint64_t tick) {
+  replay.reset(chan_names.size());
+  pending_send.clear();
+  held = false;
+  if (layout_ == TraceLayout::Stream) {
+    p = records;
+  } else {
+    // the last chunk starting at or before tick; chunks are in tick order
+    auto after = std::upper_bound(index.begin(), index.end(), tick,
+                                  [](uint64_t t, const TraceChunkEntry& e) { return t < e.first_tick; });
+    next_chunk = after == index.begin() ? 0 : (size_t)(after - index.begin()) - 1;
+    p = end = nullptr;
+  }
+  while (next()) {
+    if (ev.rec.op == TraceOp::TickBegin && ev.tick >= tick) {
+      held = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t BinaryTraceReader::resync_before(size_t offset) const {
+  const uint8_t* at = records;
+  const TraceOp resync = mode_ == ChannelTrace::Deltas ? TraceOp::Resync : TraceOp::TickBegin;
+  BinaryTraceRecord rec;
+  // only records starting before offset: their op is the same in both traces
+  for (const uint8_t* q = records; q < data + offset && (size_t)(end - q) >= sizeof(rec);) {
+    std::memcpy(&rec, q, sizeof(rec));
+    if (rec.op == resync) at = q;
+    if ((size_t)(end - q) - sizeof(rec) < rec.payload) break;
+    q += sizeof(rec) + rec.payload;
+  }
+  return (size_t)(at - data);
+}
+
+void BinaryTraceReader::seek_record(size_t offset) {
+  if (layout_ != TraceLayout::Stream || offset < (size_t)(records - data) || offset > size)
+    throw std::runtime_error("binary trace: bad record offset");
+  replay.reset(chan_names.size());
+  pending_send.clear();
+  held = false;
+  p = data + offset;
+}
+
+bool BinaryTraceReader::next() {
+  if (held) {
+    held = false;
+    return true;
+  }
+  while (p == end) {
+    if (!load_chunk()) return false;
+  }
+  read_record();
+  return true;
+}
+
+void BinaryTraceReader::read_record() {
+  TraceCursor r{p, end};
+  std::memcpy(&ev.rec, r.take(sizeof(ev.rec)), sizeof(ev.rec));
+  TraceCursor pl{r.take(ev.rec.payload), r.p};
+  rec_data = p;
+  rec_size = (size_t)(r.p - p);
+  p = r.p;
+
+  const auto& rec = ev.rec;
+  const bool deltas = mode_ == ChannelTrace::Deltas;
+  auto buffered = [&] {
+    channel_name(rec.arg);
+    return capacity[rec.arg] != 0;
+  };
+  auto buffer = [&] { replay.snapshot(rec.arg, 0, pl.buffer()); };
+
+  switch (rec.op) {
+    case TraceOp::TickBegin: ev.tick = pl.u64(); break;
+    case TraceOp::TickEnd: break;
+    case TraceOp::StepBegin: state_name(rec.proc, rec.arg); break;
+    case TraceOp::StepEnd: state_name(rec.proc, rec.arg); status_of(rec.flag); break;
+    case TraceOp::Assign:
+      slot_name(rec.proc, rec.arg);
+      ev.before = pl.value();
+      ev.value = pl.value();
+      break;
+    case TraceOp::SendBegin:
+      ev.value = pl.value();
+      if (!deltas) buffer();
+      else pending_send = ev.value;
+      break;
+    case TraceOp::SendEnd:
+      if (!deltas) buffer();
+      else if (buffered()) replay.push(rec.arg, pl.u64(), pending_send);
+      break;
+    case TraceOp::ReceiveBegin:
+      if (!deltas) buffer();
+      break;
+    case TraceOp::ReceiveEnd:
+      ev.value = pl.value();
+      if (!deltas) buffer();
+      else if (buffered()) replay.pop(rec.arg, pl.u64());
+      break;
+    case TraceOp::TrySend:
+      ev.value = pl.value();
+      if (!deltas) buffer();
+      else if (rec.flag && buffered()) replay.push(rec.arg, pl.u64(), ev.value);
+      break;
+    case TraceOp::TryReceive:
+      ev.value = pl.value();
+      if (!deltas) buffer();
+      else if (rec.flag && buffered()) replay.pop(rec.arg, pl.u64());
+      break;
+    case TraceOp::Block:
+      channel_name(rec.arg);
+      if (rec.flag > (uint8_t)BlockReason::ChannelEmpty) throw std::runtime_error("binary trace: bad block reason");
+      break;
+    case TraceOp::TransitionSkipped: ev.text[0] = pl.text(); break;
+    case TraceOp::Status:
+      ev.text[0] = pl.text();
+      ev.text[1] = pl.text();
+      ev.states.resize(procs_.size());
+      for (uint32_t i = 0; i < procs_.size(); i++) {
+        uint32_t state = pl.u32();
+        state_name(i, state);
+        ev.states[i] = {state, status_of(pl.u8())};
+      }
+      if (!deltas) {
+        for (uint32_t c = 0; c < chan_names.size(); c++) replay.snapshot(c, 0, pl.buffer());
+      }
+      break;
+    case TraceOp::ChannelSnapshot: {
+      channel_name(rec.arg);
+      uint64_t head = pl.u64();
+      replay.snapshot(rec.arg, head, pl.buffer());
+      break;
+    }
+    case TraceOp::Resync: break;
+    default: throw std::runtime_error("binary trace: unknown record");
+  }
+  if (pl.p != pl.end) throw std::runtime_error("binary trace: bad record payload");
+}
+
+void format_trace_event(const BinaryTraceReader& r, TextTraceFormat& fmt) {
+  const ChannelReplay& bufs = r.channels();
+  const TraceEvent& ev = r.event();
+  auto& rec = ev.rec;
+  switch (rec.op) {
+    case TraceOp::TickBegin: fmt.tick_begin(ev.tick); break;
+    case TraceOp::TickEnd: fmt.tick_end(); break;
+    case TraceOp::StepBegin: fmt.step_begin(r.proc_name(rec.proc), r.state_name(rec.proc, rec.arg)); break;
+    case TraceOp::StepEnd: fmt.step_end(r.state_name(rec.proc, rec.arg), (ProcStatus)rec.flag); break;
+    case TraceOp::Assign: fmt.assign(r.slot_name(rec.proc, rec.arg), ev.before, ev.value); break;
+    case TraceOp::SendBegin: fmt.send_begin(r.channel_name(rec.arg), ev.value, bufs.format(rec.arg)); break;
+    case TraceOp::SendEnd: fmt.send_end(bufs.format(rec.arg)); break;
+    case TraceOp::ReceiveBegin: fmt.receive_begin(r.channel_name(rec.arg), bufs.format(rec.arg)); break;
+    case TraceOp::ReceiveEnd: fmt.receive_end(ev.value, bufs.format(rec.arg)); break;
+    case TraceOp::TrySend: fmt.try_send(r.channel_name(rec.arg), ev.value, rec.flag != 0, bufs.format(rec.arg)); break;
+    case TraceOp::TryReceive: fmt.try_receive(r.channel_name(rec.arg), rec.flag != 0, ev.value, bufs.format(rec.arg)); break;
+    case TraceOp::Block: fmt.block((BlockReason)rec.flag, r.channel_name(rec.arg)); break;
+    case TraceOp::TransitionSkipped: fmt.transition_skipped(ev.text[0]); break;
+    case TraceOp::Status:
+      fmt.status_begin(ev.text[0], ev.text[1]);
+      for (uint32_t i = 0; i < ev.states.size(); i++)
+        fmt.status_proc(r.proc_name(i), r.state_name(i, ev.states[i].first), ev.states[i].second);
+      fmt.status_channels();
+      for (uint32_t c = 0; c < r.channel_names().size(); c++) fmt.status_channel(r.channel_name(c), bufs.format(c));
+      fmt.status_end();
+      break;
+    case TraceOp::ChannelSnapshot:
+    case TraceOp::Resync: break; // not TextTrace events
+  }
+}
+
+void decode_binary_trace(const uint8_t* data, size_t size, std::ostream& out) {
+  BinaryTraceReader r(data, size);
+  TextTraceFormat fmt{out};
+  while (r.next()) format_trace_event(r, fmt);
+}
+
+} // namespace caps
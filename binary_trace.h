@@ -0,0 +1,328 @@
+#pragma once
+#include "backend/trace.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace caps {
+
+// Binary trace: the TraceSink events as fixed-size records keyed by process,
+// channel, slot and state ids instead of names, for tracing in production.
+//
+// File layout (native byte order, checked by the byte-order mark):
+//   "CAPSTRCE" | u32 version | u32 byte-order mark | u32 ChannelTrace
+//   | u32 TraceLayout
+//   | u32 nprocs, per process: name, u32 nstates + names, u32 nslots + names
+//   | u32 nchannels, per channel: name, u64 capacity
+//   | Stream: records: BinaryTraceRecord, then `payload` bytes
+//   | Chunked: chunks (records, stored per TraceCodec), TraceChunkEntry per
+//     chunk, TraceFooter
+// Strings are u32 length + bytes. Payloads hold what the record cannot:
+// values (encode_value), channel buffers (u32 count + values) and sequence
+// numbers (u64).
+constexpr uint32_t kBinaryTraceVersion = 4;
+
+// How channel contents are recorded.
+enum class ChannelTrace : uint32_t {
+  // Every channel event carries the whole buffer, as TextTrace prints it:
+  // O(buffered values) per event.
+  Buffers,
+  // Events carry only what they push or pop, as the element's sequence number
+  // (its position in everything ever sent on the channel, i.e. Channel::tail
+  // at the push). A ChannelSnapshot precedes a channel's first event (in the
+  // trace, a chunk or after a Resync), and any event after untraced traffic
+  // (run_group with a TraceFilter).
+  // ChannelReplay rebuilds the buffers.
+  Deltas,
+};
+
+enum class TraceLayout : uint32_t {
+  // One record stream; finding tick N means reading up to it. Records can be
+  // decoded from any TickBegin (Buffers) or Resync (Deltas), one of which
+  // follows every buffer written.
+  Stream,
+  // Records cut into chunks at tick boundaries, each decodable on its own
+  // (Deltas: channels are snapshotted afresh in every chunk), with an index
+  // of the chunks' first ticks at the end of the file.
+  Chunked,
+};
+
+enum class TraceCodec : uint32_t { None, LZ }; // lz.h
+
+struct TraceChunkEntry {
+  uint64_t offset;     // from the start of the trace
+  uint64_t first_tick; // of the chunk's first TickBegin (or the run's first tick)
+  uint32_t stored;     // bytes in the file
+  uint32_t raw;        // bytes of records
+  TraceCodec codec;    // None if compression did not pay off
+  uint32_t reserved;
+};
+static_assert(sizeof(TraceChunkEntry) == 32, "TraceChunkEntry is a fixed 32 bytes");
+
+struct TraceFooter {
+  uint64_t index_offset; // of the first TraceChunkEntry
+  uint64_t chunks;
+  char magic[8];         // "CAPSTIDX"
+};
+static_assert(sizeof(TraceFooter) == 24, "TraceFooter is a fixed 24 bytes");
+
+// [B] only with ChannelTrace::Buffers, [D] only with Deltas and a buffered
+// channel (capacity > 0).
+enum class TraceOp : uint8_t {
+  TickBegin,         // payload: u64 tick
+  TickEnd,
+  StepBegin,         // arg: state before
+  StepEnd,           // arg: state after, flag: ProcStatus
+  Assign,            // arg: slot; payload: before, after
+  SendBegin,         // arg: channel; payload: value, [B] buffer
+  SendEnd,           // payload: [B] buffer, [D] u64 seq pushed (the SendBegin value)
+  ReceiveBegin,      // payload: [B] buffer
+  ReceiveEnd,        // payload: value, [B] buffer, [D] u64 seq popped
+  TrySend,           // flag: success; payload: value, [B] buffer, [D] u64 seq pushed if success
+  TryReceive,        // flag: ok; payload: value, [B] buffer, [D] u64 seq popped if ok
+  Block,             // flag: BlockReason
+  TransitionSkipped, // payload: reason
+  Status,            // payload: status, reason, per process u32 state + u8 status, [B] per channel buffer
+  ChannelSnapshot,   // arg: channel; payload: u64 head seq, buffer
+  Resync,            // [D] Stream: before a TickBegin; every channel is snapshotted afresh after it
+};
+
+struct BinaryTraceRecord {
+  TraceOp op;
+  uint8_t flag = 0;
+  uint16_t reserved = 0;
+  uint32_t proc = 0;    // ProcessInstance::id
+  uint32_t arg = 0;     // Channel::id, slot or state id
+  uint32_t payload = 0; // bytes following the record
+};
+static_assert(sizeof(BinaryTraceRecord) == 16, "BinaryTraceRecord is a fixed 16 bytes");
+
+struct BinaryTraceOptions {
+  ChannelTrace channels = ChannelTrace::Deltas;
+  TraceLayout layout = TraceLayout::Stream;
+  TraceCodec codec = TraceCodec::None; // Chunked only
+  size_t buffer_bytes = 1 << 20;       // also the chunk size
+  unsigned buffers = 4;
+};
+
+// Records go into one of a few preallocated buffers; a full buffer is handed
+// to a background thread that writes it to the stream (compressing chunks)
+// while the run carries on in the next one. The run only waits if every
+// buffer is still queued.
+class BinaryTraceSink : public TraceSink {
+public:
+  // Writes the header for g (linked) to out. out must outlive the sink and is
+  // written by the background thread until close() returns.
+  BinaryTraceSink(const IRGroup& g, std::ostream& out, const BinaryTraceOptions& opts);
+  BinaryTraceSink(const IRGroup& g, std::ostream& out, ChannelTrace channels = ChannelTrace::Deltas,
+                  size_t buffer_bytes = 1 << 20, unsigned buffers = 4);
+  ~BinaryTraceSink() override; // closes
+
+  BinaryTraceSink(const BinaryTraceSink&) = delete;
+  BinaryTraceSink& operator=(const BinaryTraceSink&) = delete;
+
+  // Writes out everything recorded so far (Chunked: every completed chunk).
+  // Throws std::runtime_error if the stream failed.
+  void flush();
+
+  // Writes out the rest and, for a Chunked trace, the index. Nothing may be
+  // traced afterwards. Throws std::runtime_error if the stream failed.
+  void close();
+
+  void on_tick_begin(uint64_t tick) override;
+  void on_tick_end(uint64_t tick) override;
+
+  void on_process_step_begin(uint64_t tick, const ProcessInstance& p) override;
+  void on_process_step_end(uint64_t tick, const ProcessInstance& p) override;
+
+  void on_assign(const ProcessInstance& p, uint32_t slot, const Value& before, const Value& after) override;
+
+  void on_send_begin(const ProcessInstance& p, const Channel& c, const Value& v) override;
+  void on_send_end(const ProcessInstance& p, const Channel& c) override;
+
+  void on_receive_begin(const ProcessInstance& p, const Channel& c) override;
+  void on_receive_end(const ProcessInstance& p, const Channel& c, const Value& v) override;
+
+  void on_try_send(const ProcessInstance& p, const Channel& c, const Value& v, bool success) override;
+  void on_try_receive(const ProcessInstance& p, const Channel& c, bool ok, const Value& v) override;
+
+  void on_block(const ProcessInstance& p, const Channel& c, BlockReason reason) override;
+
+  void on_transition_skipped(uint64_t tick, const ProcessInstance& p, const char* reason) override;
+
+  void on_status(const std::string& status, const std::string& reason, const Runtime& rt) override;
+
+private:
+  struct Block {
+    std::vector<uint8_t> bytes;
+    bool chunk = false; // Chunked: a chunk to index (else header bytes)
+    uint64_t first_tick = 0;
+  };
+
+  void begin(TraceOp op, uint32_t proc = 0, uint32_t arg = 0, uint8_t flag = 0);
+  void end();
+  void put(const void* p, size_t n);
+  void put_text(const std::string& s);
+  void put_buffer(ChannelView b);
+  void put_seq(uint64_t seq);
+  void touch(const Channel& c, uint64_t pushed = 0, uint64_t popped = 0);
+  void submit(bool chunk = false);
+  void wait_written();
+  void write_block(Block& b);
+  void writer_loop();
+
+  std::ostream& out;
+  ChannelTrace mode;
+  TraceLayout layout;
+  TraceCodec codec;
+  size_t buffer_bytes;
+  struct Seen {
+    uint64_t head = 0, tail = 0; // Channel counters as of the last traced event
+    bool known = false;          // a snapshot was written
+  };
+  std::vector<Seen> seen; // Deltas: by channel id
+  bool resync = false;    // Stream, Deltas: a buffer was handed over since the last Resync
+  size_t rec_at = 0; // offset of the open record in cur
+  std::vector<uint8_t> cur;
+  uint64_t chunk_tick = 0; // first tick of the chunk in cur
+  bool closed = false;
+
+  std::mutex mu;
+  std::condition_variable cv_full; // writer: a buffer was queued, or stop
+  std::condition_variable cv_free; // run: a buffer was written
+  std::deque<Block> queued;
+  std::vector<std::vector<uint8_t>> free_bufs;
+  unsigned nbuffers;
+  bool stop = false;
+  bool failed = false;
+  std::thread writer;
+
+  // writer thread only (and close, once it is idle)
+  uint64_t written = 0;
+  std::vector<uint8_t> packed;
+  std::vector<TraceChunkEntry> index;
+};
+
+// Channel buffers rebuilt from a trace, one formatted value (to_string) per
+// element, oldest first. Pushes and pops carry sequence numbers, so one that
+// a later snapshot already includes is skipped and a missing one is an error.
+class ChannelReplay {
+public:
+  void reset(size_t nchannels);
+
+  void snapshot(uint32_t chan, uint64_t head, std::vector<std::string> items);
+  void push(uint32_t chan, uint64_t seq, std::string item);
+  void pop(uint32_t chan, uint64_t seq);
+
+  const std::deque<std::string>& items(uint32_t chan) const { return bufs[chan].items; }
+  uint64_t head(uint32_t chan) const { return bufs[chan].head; }
+  std::string format(uint32_t chan) const; // "[a, b]" as TextTrace prints a buffer
+
+private:
+  struct Buffer {
+    uint64_t head = 0; // sequence number of items.front()
+    std::deque<std::string> items;
+  };
+  Buffer& at(uint32_t chan);
+  std::vector<Buffer> bufs;
+};
+
+// One decoded record; values are formatted with to_string.
+struct TraceEvent {
+  BinaryTraceRecord rec;
+  uint64_t tick = 0;    // of the enclosing TickBegin
+  std::string value;    // Send*/Receive*/Try* value, Assign after
+  std::string before;   // Assign
+  std::string text[2];  // TransitionSkipped: reason; Status: status, reason
+  std::vector<std::pair<uint32_t, ProcStatus>> states; // Status: per process
+};
+
+// Reads a binary trace record by record, in either ChannelTrace mode and
+// either TraceLayout (data is typically a MappedFile; stored chunks are read
+// in place, compressed ones through a scratch buffer). channels() holds every
+// buffer as of the current record (after its push or pop), which is the
+// buffer TextTrace printed for it.
+class BinaryTraceReader {
+public:
+  struct Proc {
+    std::string name;
+    std::vector<std::string> states;
+    std::vector<std::string> slots;
+  };
+
+  // Parses the header (and a Chunked trace's index); throws
+  // std::runtime_error if it is not a CAPS trace. data must outlive the
+  // reader.
+  BinaryTraceReader(const uint8_t* data, size_t size);
+
+  // Advances to the next record; false at the end of the trace.
+  bool next();
+
+  // Positions the reader so that next() yields the TickBegin of the first
+  // tick >= tick; false if the trace ends before it. Chunked traces jump to
+  // the chunk holding it; Stream traces are read from the start.
+  bool seek(uint64_t tick);
+
+  // Stream: the offset of the last record before byte `offset` (of the
+  // trace) that decoding can start from (the first record, a TickBegin or,
+  // with Deltas, a Resync), found by walking record headers only.
+  size_t resync_before(size_t offset) const;
+  // Stream: positions the reader so that next() yields the record at
+  // `offset`, one that resync_before returned.
+  void seek_record(size_t offset);
+
+  const TraceEvent& event() const { return ev; }
+  // The current record as stored: BinaryTraceRecord, then its payload.
+  const uint8_t* record_data() const { return rec_data; }
+  size_t record_size() const { return rec_size; }
+  const ChannelReplay& channels() const { return replay; }
+  ChannelTrace mode() const { return mode_; }
+  TraceLayout layout() const { return layout_; }
+  const std::vector<TraceChunkEntry>& chunks() const { return index; } // Chunked
+
+  const std::vector<Proc>& procs() const { return procs_; }
+  const std::vector<std::string>& channel_names() const { return chan_names; }
+  const std::string& proc_name(uint32_t id) const;
+  const std::string& state_name(uint32_t proc, uint32_t state) const;
+  const std::string& slot_name(uint32_t proc, uint32_t slot) const;
+  const std::string& channel_name(uint32_t chan) const;
+
+private:
+  bool load_chunk();
+  void read_record();
+
+  const uint8_t* data;
+  size_t size;
+  const uint8_t* records = nullptr; // Stream: first record
+  const uint8_t* p = nullptr;
+  const uint8_t* end = nullptr;
+  ChannelTrace mode_ = ChannelTrace::Buffers;
+  TraceLayout layout_ = TraceLayout::Stream;
+  std::vector<TraceChunkEntry> index;
+  size_t next_chunk = 0;
+  std::vector<uint8_t> unpacked; // the current compressed chunk
+  bool held = false; // seek: next() yields ev again
+  const uint8_t* rec_data = nullptr;
+  size_t rec_size = 0;
+  std::vector<Proc> procs_;
+  std::vector<std::string> chan_names;
+  std::vector<uint64_t> capacity;
+  ChannelReplay replay;
+  TraceEvent ev;
+  std::string pending_send; // Deltas: SendBegin value, pushed by SendEnd
+};
+
+// Prints the current event of r as TextTrace would have (nothing for
+// records TextTrace has no line for).
+void format_trace_event(const BinaryTraceReader& r, TextTraceFormat& fmt);
+
+// Rebuilds the text trace from a binary one, byte-for-byte what TextTrace
+// would have printed for the same run. Throws std::runtime_error on a
+// malformed trace.
+void decode_binary_trace(const uint8_t* data, size_t size, std::ostream& out);
+
+} // namespace caps
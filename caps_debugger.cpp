@@ -1,17 +1,51 @@
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <map>
 
+#include "backend/binary_trace.h"
+#include "backend/mapped_file.h"
+
 // CAPS Debugger Tool
-// Simple debugger for CAPS.
+// Simple debugger for CAPS. Given a binary trace (BinaryTraceSink; a Chunked
+// one seeks without reading the ticks before), it can jump to any tick.
 
 std::map<std::string, bool> breakpoints;
 
-void run_debugger() {
+// Prints the tick the reader is positioned at (next() yields its TickBegin).
+static bool print_tick(caps::BinaryTraceReader& r) {
+  caps::TextTraceFormat fmt{std::cout};
+  bool any = false;
+  while (r.next()) {
+    any = true;
+    caps::format_trace_event(r, fmt);
+    if (r.event().rec.op == caps::TraceOp::TickEnd) break;
+  }
+  return any;
+}
+
+static void print_info(const caps::BinaryTraceReader& r) {
+  std::cout << "processes: " << r.procs().size() << ", channels: " << r.channel_names().size() << "\n";
+  if (r.layout() == caps::TraceLayout::Stream) {
+    std::cout << "layout: stream (seeking reads from the start)\n";
+    return;
+  }
+  size_t stored = 0, raw = 0;
+  for (auto& c : r.chunks()) {
+    stored += c.stored;
+    raw += c.raw;
+  }
+  std::cout << "layout: chunked, " << r.chunks().size() << " chunks, " << raw << " bytes of records in " << stored
+            << " stored\n";
+  if (!r.chunks().empty()) std::cout << "first tick: " << r.chunks().front().first_tick << "\n";
+}
+
+void run_debugger(caps::BinaryTraceReader* trace) {
   std::string cmd;
   while (true) {
     std::cout << "(caps_debug) ";
-    std::getline(std::cin, cmd);
+    if (!std::getline(std::cin, cmd)) break;
     if (cmd == "quit") break;
     if (cmd.substr(0, 6) == "break ") {
       std::string bp = cmd.substr(6);
@@ -22,6 +56,14 @@ void run_debugger() {
       for (const auto& bp : breakpoints) {
         if (bp.second) std::cout << "Hit breakpoint: " << bp.first << "\n";
       }
+    } else if (trace && cmd.substr(0, 5) == "seek ") {
+      uint64_t tick = std::strtoull(cmd.c_str() + 5, nullptr, 10);
+      if (!trace->seek(tick)) std::cout << "Trace ends before tick " << tick << "\n";
+      else print_tick(*trace);
+    } else if (trace && cmd == "next") {
+      if (!print_tick(*trace)) std::cout << "End of trace\n";
+    } else if (trace && cmd == "info") {
+      print_info(*trace);
     } else {
       std::cout << "Unknown command\n";
     }
@@ -30,6 +72,22 @@ void run_debugger() {
 
 int main(int argc, char* argv[]) {
   std::cout << "CAPS Debugger\n";
-  run_debugger();
+  if (argc > 2) {
+    std::cerr << "usage: caps_debugger [trace.bin]\n";
+    return 1;
+  }
+  try {
+    caps::MappedFile file;
+    std::unique_ptr<caps::BinaryTraceReader> trace;
+    if (argc == 2) {
+      file = caps::MappedFile(argv[1]);
+      trace = std::make_unique<caps::BinaryTraceReader>(file.data(), file.size());
+      std::cout << "Trace " << argv[1] << " (seek N, next, info)\n";
+    }
+    run_debugger(trace.get());
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
   return 0;
-}
\ No newline at end of file
+}
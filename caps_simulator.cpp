@@ -1,19 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <vector>
+
+#include "util/str.h"
+#include "util/diag.h"
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "sema/sema.h"
+#include "backend/ir.h"
+#include "backend/batch.h"
+#include "tools/sim_bridge.h"
 
 // CAPS Simulator
-// Simulates process graphs.
+// Simulates process graphs: runs one group many times with varied initial
+// values (what-if analysis) on the run_batch engine.
+
+struct SimVar {
+  std::string name; // "Process.var"
+  int64_t lo = 0;
+  int64_t hi = 0;   // lo == hi for --set
+};
+
+struct SimOptions {
+  std::string input_file;
+  std::string group;          // default: first group
+  size_t runs = 0;            // default: size of the largest sweep, or 1
+  unsigned threads = 0;
+  uint64_t max_ticks = 1'000'000;
+  bool quiet = false;
+  std::vector<SimVar> vars;
+  std::vector<std::string> outputs;
+};
+
+static void print_usage() {
+  std::cerr <<
+    "usage: caps_simulator [--group=<name>] [--runs=N] [--threads=N] [--max-ticks=N]\n"
+    "                      [--set=P.var=V] [--sweep=P.var=LO:HI] [--out=P.var] [--quiet] <file.caps>\n"
+    "\n"
+    "  --set=P.var=V          Initial value of P.var in every run\n"
+    "  --sweep=P.var=LO:HI    Run i starts with P.var = LO + i mod (HI-LO+1)\n"
+    "  --out=P.var            Report P.var (default: every declared output)\n"
+    "  --quiet                Summary only, no per-run lines\n";
+}
 
-void simulate(const std::string& file) {
-  std::cout << "Simulating " << file << ": All processes terminate deterministically.\n";
+static bool parse_var(const std::string& spec, bool sweep, SimVar& v) {
+  auto eq = spec.rfind('=');
+  if (eq == std::string::npos) return false;
+  v.name = spec.substr(0, eq);
+  std::string val = spec.substr(eq + 1);
+  auto colon = val.find(':');
+  if (sweep != (colon != std::string::npos)) return false;
+  v.lo = std::strtoll(val.c_str(), nullptr, 10);
+  v.hi = sweep ? std::strtoll(val.c_str() + colon + 1, nullptr, 10) : v.lo;
+  return v.hi >= v.lo;
+}
+
+static bool parse_args(int argc, char** argv, SimOptions& opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto value = [&](const char* flag) { return a.substr(std::string(flag).size()); };
+
+    if (a == "--quiet") { opt.quiet = true; continue; }
+    if (a.rfind("--group=", 0) == 0) { opt.group = value("--group="); continue; }
+    if (a.rfind("--runs=", 0) == 0) { opt.runs = std::strtoull(value("--runs=").c_str(), nullptr, 10); continue; }
+    if (a.rfind("--threads=", 0) == 0) { opt.threads = (unsigned)std::strtoul(value("--threads=").c_str(), nullptr, 10); continue; }
+    if (a.rfind("--max-ticks=", 0) == 0) { opt.max_ticks = std::strtoull(value("--max-ticks=").c_str(), nullptr, 10); continue; }
+    if (a.rfind("--out=", 0) == 0) { opt.outputs.push_back(value("--out=")); continue; }
+
+    bool sweep = a.rfind("--sweep=", 0) == 0;
+    if (sweep || a.rfind("--set=", 0) == 0) {
+      SimVar v;
+      if (!parse_var(value(sweep ? "--sweep=" : "--set="), sweep, v)) {
+        std::cerr << "error: bad " << a << "\n";
+        return false;
+      }
+      opt.vars.push_back(v);
+      continue;
+    }
+
+    if (!a.empty() && a[0] == '-') {
+      std::cerr << "unknown option: " << a << "\n";
+      return false;
+    }
+    opt.input_file = a;
+  }
+  return !opt.input_file.empty();
+}
+
+// Engine: builds the input columns and runs the batch. Returns the exit code.
+// Declared initializers are seeded first so --set/--sweep override them.
+int simulate(const caps::IRGroup& g, const std::vector<LocalInit>& inits, const SimOptions& opt, std::ostream& os) {
+  caps::BatchSpec spec;
+  spec.group = &g;
+  spec.threads = opt.threads;
+  spec.max_ticks = opt.max_ticks;
+
+  spec.instances = opt.runs;
+  if (!spec.instances) {
+    spec.instances = 1;
+    for (auto& v : opt.vars) spec.instances = std::max<size_t>(spec.instances, (size_t)(v.hi - v.lo + 1));
+  }
+
+  for (auto& l : inits) {
+    caps::BatchOutput at = caps::find_batch_slot(g, l.name);
+    caps::BatchInput in;
+    in.proc = at.proc;
+    in.slot = at.slot;
+    in.values.assign(spec.instances, l.value);
+    spec.inputs.push_back(std::move(in));
+  }
+
+  for (auto& v : opt.vars) {
+    caps::BatchOutput at = caps::find_batch_slot(g, v.name);
+    if (at.proc == caps::kNoSlot) {
+      std::cerr << "error: unknown variable " << v.name << "\n";
+      return 1;
+    }
+    caps::BatchInput in;
+    in.proc = at.proc;
+    in.slot = at.slot;
+    in.values.reserve(spec.instances);
+    uint64_t span = (uint64_t)(v.hi - v.lo) + 1;
+    for (size_t i = 0; i < spec.instances; i++) in.values.push_back(caps::Value::i(v.lo + (int64_t)(i % span)));
+    spec.inputs.push_back(std::move(in));
+  }
+
+  for (auto& o : opt.outputs) {
+    spec.outputs.push_back(caps::find_batch_slot(g, o));
+    if (spec.outputs.back().proc == caps::kNoSlot) {
+      std::cerr << "error: unknown output " << o << "\n";
+      return 1;
+    }
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  caps::BatchResult res = caps::run_batch(spec);
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  size_t counts[4] = {0, 0, 0, 0};
+  for (size_t i = 0; i < res.runs.size(); i++) {
+    auto& r = res.runs[i];
+    counts[(int)r.reason]++;
+    if (opt.quiet) continue;
+    os << "run " << i << ": " << caps::run_reason_text(r.reason) << " tick=" << r.tick;
+    for (size_t k = 0; k < res.outputs.size(); k++) os << " " << res.outputs[k].name << "=" << caps::to_string(res.output(i, k));
+    os << "\n";
+  }
+  for (auto& e : res.errors) os << "run " << e.first << ": error: " << e.second << "\n";
+
+  os << "Simulated " << res.runs.size() << " runs of group " << g.name << " in " << secs << "s: "
+     << counts[(int)caps::RunReason::AllTerminal] << " completed, "
+     << counts[(int)caps::RunReason::NoProgress] << " deadlocked, "
+     << counts[(int)caps::RunReason::MaxTicks] << " hit max ticks, "
+     << counts[(int)caps::RunReason::Error] << " failed\n";
+  return counts[(int)caps::RunReason::Error] ? 3 : 0;
 }
 
 int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    std::cerr << "Usage: caps_simulator <file.caps>\n";
+  SimOptions opt;
+  if (!parse_args(argc, argv, opt)) {
+    print_usage();
+    return 1;
+  }
+
+  std::string src;
+  try {
+    src = read_file_to_string(opt.input_file);
+  } catch (const std::exception& e) {
+    std::cerr << "read error: " << e.what() << "\n";
     return 1;
   }
 
-  simulate(argv[1]);
-  return 0;
-}
\ No newline at end of file
+  // front end: parse + sema, then the checked group as runtime IR
+  Diag diag;
+  Lexer lex(src, diag);
+  Parser parser(lex, diag);
+  Program prog = parser.parse_program();
+  Sema sema(diag);
+  sema.check(prog);
+  if (diag.has_errors()) {
+    diag.print_all(std::cerr);
+    return 2;
+  }
+
+  const GroupDecl* decl = nullptr;
+  for (auto& g : prog.groups) {
+    if (opt.group.empty() || g.name == opt.group) { decl = &g; break; }
+  }
+  if (!decl) {
+    std::cerr << "error: no group " << (opt.group.empty() ? "found" : "named " + opt.group) << "\n";
+    return 1;
+  }
+
+  try {
+    caps::IRGroup g = to_ir_group(*decl);
+    caps::link_group(g);
+    return simulate(g, local_inits(*decl), opt, std::cout);
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
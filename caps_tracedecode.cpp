@@ -0,0 +1,34 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "backend/binary_trace.h"
+#include "backend/mapped_file.h"
+
+// CAPS Trace Decoder
+// Turns a binary trace (BinaryTraceSink) back into the text trace format.
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "usage: caps_tracedecode <trace.bin> [out.txt]\n";
+    return 1;
+  }
+
+  try {
+    caps::MappedFile in(argv[1]);
+    if (argc == 3) {
+      std::ofstream out(argv[2], std::ios::binary);
+      if (!out) {
+        std::cerr << "error: cannot write " << argv[2] << "\n";
+        return 1;
+      }
+      caps::decode_binary_trace(in.data(), in.size(), out);
+    } else {
+      caps::decode_binary_trace(in.data(), in.size(), std::cout);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -1,4 +1,18 @@
 #include "backend/channel.h"
 namespace caps {
+
+void Channel::init(const std::string& n, size_t cap, size_t nprocs) {
+  name = n;
+  capacity = cap;
+  size_t slots = 1;
+  while (slots < cap) slots <<= 1;
+  ring.assign(slots, Value::unset());
+  mask = slots - 1;
+  head.set(0);
+  tail.set(0);
+  recv_waiters.reset(nprocs);
+  send_waiters.reset(nprocs);
+}
+
 // no extra logic; exec layer manipulates buffers deterministically
 }
@@ -1,19 +1,151 @@
 #pragma once
 #include "backend/value.h"
-#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <vector>
 
 namespace caps {
 
+// Read-only view of a channel buffer in FIFO order (oldest first).
+// Handed to TraceSink instead of the container itself.
+struct ChannelView {
+  const Value* data = nullptr;
+  uint64_t mask = 0;
+  uint64_t head = 0;
+  size_t count = 0;
+
+  struct iterator {
+    const ChannelView* view;
+    size_t i;
+
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Value*;
+    using reference = const Value&;
+
+    const Value& operator*() const { return (*view)[i]; }
+    const Value* operator->() const { return &(*view)[i]; }
+    iterator& operator++() { ++i; return *this; }
+    iterator operator++(int) { iterator t = *this; ++i; return t; }
+    bool operator==(const iterator& o) const { return i == o.i; }
+    bool operator!=(const iterator& o) const { return i != o.i; }
+  };
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const Value& operator[](size_t i) const { return data[(head + i) & mask]; }
+  iterator begin() const { return {this, 0}; }
+  iterator end() const { return {this, count}; }
+};
+
+// Index of the lowest set bit; m != 0.
+inline uint32_t lowest_bit(uint64_t m) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (uint32_t)__builtin_ctzll(m);
+#else
+  uint32_t i = 0;
+  for (; !(m & 1); m >>= 1) i++;
+  return i;
+#endif
+}
+
+// Processes parked on a channel, one bit per process index. Woken lowest
+// index first, the order the former linear scan over Runtime::procs found
+// them in, so traces do not depend on the order processes blocked. park is
+// O(1); wake scans one word per 64 processes. Sized once by Channel::init.
+struct WaitQueue {
+  std::vector<uint64_t> bits;
+  uint32_t count = 0;
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+
+  void park(uint32_t id) {
+    bits[id >> 6] |= uint64_t(1) << (id & 63);
+    count++;
+  }
+  uint32_t wake() {
+    size_t w = 0;
+    while (!bits[w]) w++;
+    uint32_t id = (uint32_t)(w * 64 + lowest_bit(bits[w]));
+    bits[w] &= bits[w] - 1;
+    count--;
+    return id;
+  }
+  // lowest index first
+  template <class F>
+  void for_each(F f) const {
+    for (size_t w = 0; w < bits.size(); w++) {
+      for (uint64_t m = bits[w]; m; m &= m - 1) f((uint32_t)(w * 64 + lowest_bit(m)));
+    }
+  }
+  void reset(size_t nprocs) { bits.assign((nprocs + 63) / 64, 0); count = 0; }
+  void clear() { std::fill(bits.begin(), bits.end(), 0); count = 0; }
+};
+
+// Free-running ring counter. Atomic so the pipelined scheduler can read one end
+// of a channel while the other thread moves it; acquire/release are plain
+// loads/stores on x86, so the single-threaded schedulers pay nothing for it.
+struct RingCounter {
+  std::atomic<uint64_t> n{0};
+
+  RingCounter() = default;
+  RingCounter(const RingCounter& o) : n(o.get()) {}
+  RingCounter& operator=(const RingCounter& o) { set(o.get()); return *this; }
+
+  uint64_t get() const { return n.load(std::memory_order_acquire); }
+  void set(uint64_t v) { n.store(v, std::memory_order_release); }
+};
+
 struct Channel {
   std::string name;
+  uint32_t id = 0; // index in Runtime::channels
   size_t capacity = 0; // 0 = synchronous (unbuffered)
-  std::deque<Value> buffer;
+
+  // Preallocated power-of-two ring (>= capacity), sized once by init().
+  // head/tail are free-running counters; slot = counter & mask. Values are
+  // moved in and out, so steady-state traffic never touches the allocator.
+  // Only the receiver advances head and only the sender advances tail.
+  std::vector<Value> ring;
+  uint64_t mask = 0;
+  RingCounter head;
+  RingCounter tail;
+
+  // blocked processes (by process index), see exec_action
+  WaitQueue recv_waiters;
+  WaitQueue send_waiters;
 
   // Deterministic FIFO. For capacity==0, we treat it as "must pair send/recv in same tick step".
   // The scheduler implements pairing logic by checking recv-ready/send-ready; for simplicity,
   // we model cap==0 as "no buffer", send blocks if buffer is 'occupied' (never) and if no receiver step occurs.
   // In this reference runtime, cap==0 behaves like cap==0 buffer: send blocks unless a receiver is waiting.
+
+  void init(const std::string& n, size_t cap, size_t nprocs = 0);
+
+  size_t size() const { return (size_t)(tail.get() - head.get()); }
+  bool empty() const { return head.get() == tail.get(); }
+  bool full() const { return size() >= capacity; }
+
+  // callers check full()/empty() first; the slot is written before tail is published
+  void push(Value&& v) {
+    uint64_t t = tail.get();
+    ring[t & mask] = std::move(v);
+    tail.set(t + 1);
+  }
+  Value pop() {
+    uint64_t h = head.get();
+    Value v = std::move(ring[h & mask]);
+    head.set(h + 1);
+    return v;
+  }
+  const Value& back() const { return ring[(tail.get() - 1) & mask]; }
+
+  ChannelView view() const { uint64_t h = head.get(); return {ring.data(), mask, h, (size_t)(tail.get() - h)}; }
 };
 
 } // namespace caps
@@ -0,0 +1,210 @@
+#include "backend/checkpoint.h"
+#include "backend/mapped_file.h"
+#include "backend/scheduler.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace caps {
+
+static const char kMagic[8] = {'C', 'A', 'P', 'S', 'C', 'K', 'P', 'T'};
+static constexpr uint32_t kByteOrderMark = 0x01020304;
+
+static uint64_t fnv1a(const void* p, size_t n, uint64_t h = 0xcbf29ce484222325ull) {
+  auto* b = (const uint8_t*)p;
+  for (size_t i = 0; i < n; i++) {
+    h ^= b[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+namespace {
+
+struct Writer {
+  std::vector<uint8_t>& out;
+
+  void bytes(const void* p, size_t n) {
+    size_t at = out.size();
+    out.resize(at + n);
+    if (n) std::memcpy(out.data() + at, p, n);
+  }
+  void u8(uint8_t v) { out.push_back(v); }
+  void u32(uint32_t v) { bytes(&v, 4); }
+  void u64(uint64_t v) { bytes(&v, 8); }
+
+  void value(const Value& v) { encode_value(out, v); }
+};
+
+// Bounds-checked cursor over a snapshot; decodes in place, no staging copy.
+struct Reader {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  const uint8_t* take(size_t n) {
+    if ((size_t)(end - p) < n) throw std::runtime_error("checkpoint: truncated");
+    const uint8_t* at = p;
+    p += n;
+    return at;
+  }
+  uint8_t u8() { return *take(1); }
+  uint32_t u32() { uint32_t v; std::memcpy(&v, take(4), 4); return v; }
+  uint64_t u64() { uint64_t v; std::memcpy(&v, take(8), 8); return v; }
+
+  Value value() { return decode_value(p, end); }
+};
+
+} // namespace
+
+uint64_t group_fingerprint(const IRGroup& g) {
+  uint64_t h = fnv1a(g.name.data(), g.name.size());
+  auto mix_str = [&](const std::string& s) {
+    uint32_t n = (uint32_t)s.size();
+    h = fnv1a(&n, 4, h);
+    h = fnv1a(s.data(), s.size(), h);
+  };
+  auto mix_u64 = [&](uint64_t v) { h = fnv1a(&v, 8, h); };
+
+  for (auto& c : g.channels) {
+    mix_str(c.name);
+    mix_u64(c.capacity);
+  }
+  for (auto& p : g.processes) {
+    mix_str(p.name);
+    for (auto& s : p.slot_names) mix_str(s);
+    for (auto& s : p.state_names) mix_str(s);
+    mix_u64(p.initial_state_id);
+  }
+  for (uint32_t id : g.schedule.step_ids) mix_u64(id);
+  return h;
+}
+
+void save_checkpoint(const Runtime& rt, std::vector<uint8_t>& out) {
+  if (!rt.group) throw std::runtime_error("runtime not initialized");
+  out.clear();
+  Writer w{out};
+
+  w.bytes(kMagic, sizeof(kMagic));
+  w.u32(kCheckpointVersion);
+  w.u32(kByteOrderMark);
+  w.u64(group_fingerprint(*rt.group));
+  w.u64(rt.tick);
+  w.u64(rt.schedule_pos);
+  w.u64(rt.steps_since_progress);
+
+  w.u32((uint32_t)rt.channels.size());
+  for (auto& c : rt.channels) {
+    ChannelView v = c.view();
+    w.u32((uint32_t)v.size());
+    for (auto& x : v) w.value(x);
+    for (auto* q : {&c.recv_waiters, &c.send_waiters}) {
+      w.u32((uint32_t)q->size());
+      q->for_each([&](uint32_t id) { w.u32(id); });
+    }
+  }
+
+  w.u32((uint32_t)rt.procs.size());
+  for (auto& p : rt.procs) {
+    w.u32(p.state);
+    w.u8((uint8_t)p.status);
+    w.u32(p.blocked_chan);
+    w.u8(p.blocked_is_send ? 1 : 0);
+    w.u32(p.blocked_mailbox);
+    w.u32(p.divert_state);
+    w.u32((uint32_t)p.slots.size());
+    w.bytes(p.mail_ready.data(), p.mail_ready.size());
+    for (auto& v : p.slots) w.value(v);
+  }
+
+  w.u64(fnv1a(out.data(), out.size()));
+}
+
+void write_checkpoint_file(const Runtime& rt, const std::string& path) {
+  thread_local std::vector<uint8_t> buf;
+  save_checkpoint(rt, buf);
+
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    if (!f) throw std::runtime_error("cannot write checkpoint: " + tmp);
+    f.write((const char*)buf.data(), (std::streamsize)buf.size());
+    if (!f) throw std::runtime_error("cannot write checkpoint: " + tmp);
+  }
+#ifdef _WIN32
+  std::remove(path.c_str()); // rename does not replace on Windows
+#endif
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) throw std::runtime_error("cannot write checkpoint: " + path);
+}
+
+void restore_checkpoint(Runtime& rt, const IRGroup& g, const uint8_t* data, size_t size) {
+  if (size < sizeof(kMagic) + 8 + 8 || std::memcmp(data, kMagic, sizeof(kMagic)) != 0)
+    throw std::runtime_error("checkpoint: not a CAPS checkpoint");
+
+  uint64_t sum;
+  std::memcpy(&sum, data + size - 8, 8);
+  if (fnv1a(data, size - 8) != sum) throw std::runtime_error("checkpoint: checksum mismatch");
+
+  Reader r{data + sizeof(kMagic), data + size - 8};
+  if (r.u32() != kCheckpointVersion) throw std::runtime_error("checkpoint: unsupported version");
+  if (r.u32() != kByteOrderMark) throw std::runtime_error("checkpoint: byte order mismatch");
+  if (r.u64() != group_fingerprint(g)) throw std::runtime_error("checkpoint: written for a different group");
+
+  init_runtime(rt, g);
+  rt.tick = r.u64();
+  rt.schedule_pos = (size_t)r.u64();
+  rt.steps_since_progress = r.u64();
+
+  auto proc_id = [&](uint32_t id) {
+    if (id >= rt.procs.size()) throw std::runtime_error("checkpoint: bad process id");
+    return id;
+  };
+  std::vector<bool> parked(rt.procs.size());
+
+  if (r.u32() != rt.channels.size()) throw std::runtime_error("checkpoint: channel count mismatch");
+  for (auto& c : rt.channels) {
+    uint32_t n = r.u32();
+    if (n > c.capacity) throw std::runtime_error("checkpoint: channel overflow: " + c.name);
+    for (uint32_t i = 0; i < n; i++) c.push(r.value());
+    for (auto* q : {&c.recv_waiters, &c.send_waiters}) {
+      uint32_t k = r.u32();
+      for (uint32_t i = 0; i < k; i++) {
+        uint32_t id = proc_id(r.u32());
+        if (parked[id]) throw std::runtime_error("checkpoint: process parked twice");
+        parked[id] = true;
+        q->park(id);
+      }
+    }
+  }
+
+  if (r.u32() != rt.procs.size()) throw std::runtime_error("checkpoint: process count mismatch");
+  for (auto& p : rt.procs) {
+    p.state = r.u32();
+    if (p.state >= p.state_table.size()) throw std::runtime_error("checkpoint: bad state for " + p.name);
+    uint8_t st = r.u8();
+    if (st > (uint8_t)ProcStatus::Finished) throw std::runtime_error("checkpoint: bad status for " + p.name);
+    p.status = (ProcStatus)st;
+    p.blocked_chan = r.u32();
+    p.blocked_is_send = r.u8() != 0;
+    p.blocked_mailbox = r.u32();
+    p.divert_state = r.u32();
+    if (r.u32() != p.slots.size()) throw std::runtime_error("checkpoint: slot count mismatch for " + p.name);
+    std::memcpy(p.mail_ready.data(), r.take(p.mail_ready.size()), p.mail_ready.size());
+    for (auto& v : p.slots) v = r.value();
+  }
+
+  if (r.p != r.end) throw std::runtime_error("checkpoint: trailing data");
+}
+
+void restore_checkpoint_file(Runtime& rt, const IRGroup& g, const std::string& path) {
+  MappedFile f(path);
+  restore_checkpoint(rt, g, f.data(), f.size());
+}
+
+void checkpoint_every(Runtime& rt, uint64_t every_ticks, const std::string& path) {
+  rt.checkpoint_every = every_ticks;
+  if (every_ticks) rt.on_checkpoint = [path](const Runtime& r) { write_checkpoint_file(r, path); };
+  else rt.on_checkpoint = nullptr;
+}
+
+} // namespace caps
@@ -0,0 +1,45 @@
+#pragma once
+#include "backend/runtime.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caps {
+
+// Binary snapshot of a Runtime: tick, schedule position, channel contents and
+// waiters, and every process's state, status, blocking info and slots.
+//
+// Layout (native byte order; the byte-order mark rejects a snapshot taken on
+// a machine of the other endianness):
+//   "CAPSCKPT" | u32 version | u32 byte-order mark | u64 group fingerprint
+//   | u64 tick, schedule_pos, steps_since_progress
+//   | channels | processes | u64 FNV-1a checksum of everything before it
+// Values use encode_value (value.h).
+constexpr uint32_t kCheckpointVersion = 2;
+
+// Hash of the group's shape (names, capacities, slot and state layout). A
+// snapshot only restores into a runtime for a group with the same fingerprint.
+uint64_t group_fingerprint(const IRGroup& g);
+
+// Serialises rt into out, replacing its contents. Reuses out's capacity, so a
+// caller keeping one buffer per snapshot slot (e.g. debugger rewind) does not
+// allocate in steady state.
+void save_checkpoint(const Runtime& rt, std::vector<uint8_t>& out);
+
+// Writes a snapshot to path via a temporary file and rename, so a crash while
+// writing leaves the previous checkpoint intact.
+void write_checkpoint_file(const Runtime& rt, const std::string& path);
+
+// Re-initialises rt for g and loads the snapshot. Scalars are decoded straight
+// from the buffer; only text and aggregates are copied. Throws
+// std::runtime_error on a bad magic, version, fingerprint or checksum.
+void restore_checkpoint(Runtime& rt, const IRGroup& g, const uint8_t* data, size_t size);
+
+// restore_checkpoint from a memory-mapped file.
+void restore_checkpoint_file(Runtime& rt, const IRGroup& g, const std::string& path);
+
+// Makes run_group write a checkpoint to path at the end of every tick that is a
+// multiple of every_ticks (0 turns it off).
+void checkpoint_every(Runtime& rt, uint64_t every_ticks, const std::string& path);
+
+} // namespace caps
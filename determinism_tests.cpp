@@ -1,5 +1,19 @@
 #include <gtest/gtest.h>
+#include "lexer/lexer.h"
+#include "parser/parser.h"
 #include "sema/sema.h"
+#include "tools/sim_bridge.h"
+#include "backend/ir.h"
+#include "backend/scheduler.h"
+#include "backend/parallel_scheduler.h"
+#include "backend/jit.h"
+#include "backend/batch.h"
+#include "backend/binary_trace.h"
+#include "backend/checkpoint.h"
+#include "backend/result.h"
+#include "backend/trace_diff.h"
+#include <cstdio>
+#include <sstream>
 
 // Determinism tests
 
@@ -13,4 +27,900 @@ TEST(DeterminismTests, ExecutionOrder) {
 TEST(DeterminismTests, OutputConsistency) {
   // Test consistent outputs
   EXPECT_TRUE(true);  // Placeholder
-}
\ No newline at end of file
+}
+
+// one-state process looping on a single action
+static caps::IRProcess loop_proc(const char* name, caps::IRAction a) {
+  caps::IRProcess p;
+  p.name = name;
+  p.initial_state = "S";
+  if (!a.dst.empty()) p.local_names = {a.dst};
+  caps::IRState& s = p.states["S"];
+  s.name = "S";
+  s.actions = {a};
+  s.transition.kind = caps::IRTransition::Kind::Goto;
+  s.transition.to_state = "S";
+  return p;
+}
+
+// sender -> rendezvous channel -> receiver, plus a process parked forever
+static caps::IRGroup rendezvous_group() {
+  using namespace caps;
+  IRGroup g;
+  g.name = "G";
+  g.channels.push_back({"sync", 0});
+  g.channels.push_back({"idle", 1});
+
+  IRAction send; send.kind = IRAction::Kind::Send; send.chan = "sync";
+  send.expr.kind = IRExpr::Kind::LitInt; send.expr.lit_i = 7;
+  IRAction recv; recv.kind = IRAction::Kind::Receive; recv.chan = "sync"; recv.dst = "x";
+  IRAction wait = recv; wait.chan = "idle";
+
+  g.processes = {loop_proc("Tx", send), loop_proc("Rx", recv), loop_proc("Idle", wait)};
+  g.schedule.steps = {"Rx", "Idle", "Tx", "Rx"};
+  link_group(g);
+  return g;
+}
+
+static std::string trace_run(const caps::IRGroup& g, caps::SchedulerMode mode) {
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  std::ostringstream os;
+  caps::TextTrace t(os);
+  caps::RunResult r = caps::run_group(rt, &t, 50, mode);
+  os << (int)r.status << " " << r.reason;
+  return os.str();
+}
+
+TEST(DeterminismTests, ReadyQueueMatchesRoundRobin) {
+  caps::IRGroup g = rendezvous_group();
+  EXPECT_EQ(trace_run(g, caps::SchedulerMode::RoundRobin), trace_run(g, caps::SchedulerMode::ReadyQueue));
+}
+
+static caps::IRExpr lit(int64_t v) { caps::IRExpr e; e.kind = caps::IRExpr::Kind::LitInt; e.lit_i = v; return e; }
+static caps::IRExpr var(const char* n) { return caps::IRExpr::var(n); }
+
+static caps::IRExpr bin(const char* op, caps::IRExpr a, caps::IRExpr b) {
+  caps::IRExpr e; e.kind = caps::IRExpr::Kind::BinOp; e.op = op; e.args = {a, b}; return e;
+}
+
+static caps::IRExpr field(caps::IRExpr base, const char* f) {
+  caps::IRExpr e; e.kind = caps::IRExpr::Kind::Field; e.field = f; e.args = {base}; return e;
+}
+
+static caps::IRAction act(caps::IRAction::Kind k, const char* chan, const char* dst, caps::IRExpr e = {}) {
+  caps::IRAction a; a.kind = k; a.chan = chan; a.dst = dst; a.expr = e; return a;
+}
+
+static caps::IRState& add_state(caps::IRProcess& p, const char* name, std::vector<caps::IRAction> acts, const char* to) {
+  caps::IRState& s = p.states[name];
+  s.name = name;
+  s.actions = std::move(acts);
+  s.transition.kind = caps::IRTransition::Kind::Goto;
+  s.transition.to_state = to;
+  return s;
+}
+
+static void branch(caps::IRState& s, caps::IRExpr cond, std::vector<caps::IRAction> then_acts, const char* then_state,
+                   const char* else_state) {
+  s.transition.kind = caps::IRTransition::Kind::IfElse;
+  s.transition.cond = cond;
+  s.transition.then_actions = std::move(then_acts);
+  s.transition.then_state = then_state;
+  s.transition.else_state = else_state;
+}
+
+// Src -try_send-> a -> Mid -> b -> Sink, Src and Mid stepping every other tick.
+// Src sends 0 .. count-1.
+// Polling: Mid/Sink use try_receive, `a` fills up and Src sees try_send
+// failures; runs to max_ticks. Blocking: Mid/Sink receive in step with Src and
+// block once it is done, ending in a deadlock.
+static caps::IRGroup pipeline_group(bool blocking, int64_t count = 200) {
+  using namespace caps;
+  using K = IRAction::Kind;
+  IRGroup g;
+  g.name = "P";
+  g.annotations = {"pipeline_safe"};
+  g.channels.push_back({"a", 3});
+  g.channels.push_back({"b", 8});
+
+  IRProcess src; src.name = "Src"; src.initial_state = "Init"; src.local_names = {"n", "r"};
+  add_state(src, "Init", {act(K::Assign, "", "n", lit(0))}, "Send");
+  branch(add_state(src, "Send", {act(K::TrySend, "a", "r", var("n"))}, ""), field(var("r"), "value"),
+         {act(K::Assign, "", "n", bin("+", var("n"), lit(1)))}, "Check", "Send");
+  branch(add_state(src, "Check", {}, ""), bin("<", var("n"), lit(count)), {}, "Send", "Done");
+  add_state(src, "Done", {}, "Done").terminal = true;
+
+  IRProcess mid; mid.name = "Mid"; mid.local_names = {"rr", "x"};
+  if (blocking) {
+    mid.initial_state = "Rest";
+    add_state(mid, "Take", {act(K::Receive, "a", "x"), act(K::Send, "b", "", bin("*", var("x"), lit(2)))}, "Rest");
+  } else {
+    mid.initial_state = "Take";
+    branch(add_state(mid, "Take", {act(K::TryReceive, "a", "rr")}, ""), field(var("rr"), "ok"),
+           {act(K::Send, "b", "", bin("*", field(var("rr"), "value"), lit(2)))}, "Rest", "Rest");
+  }
+  add_state(mid, "Rest", {}, "Take");
+
+  IRProcess sink; sink.name = "Sink"; sink.initial_state = "Init"; sink.local_names = {"sum", "prev", "inorder", "rr", "v"};
+  IRExpr t; t.kind = IRExpr::Kind::LitBool; t.lit_b = true;
+  add_state(sink, "Init", {act(K::Assign, "", "sum", lit(0)), act(K::Assign, "", "prev", lit(-1)),
+                           act(K::Assign, "", "inorder", t)}, "Loop");
+  std::vector<IRAction> consume = {
+    act(K::Assign, "", "inorder", bin("&&", var("inorder"), bin("<", var("prev"), var("v")))),
+    act(K::Assign, "", "sum", bin("+", var("sum"), var("v"))),
+    act(K::Assign, "", "prev", var("v"))};
+  if (blocking) {
+    consume.insert(consume.begin(), act(K::Receive, "b", "v"));
+    add_state(sink, "Loop", consume, "Rest");
+    add_state(sink, "Rest", {}, "Loop");
+  } else {
+    consume.insert(consume.begin(), act(K::Assign, "", "v", field(var("rr"), "value")));
+    branch(add_state(sink, "Loop", {act(K::TryReceive, "b", "rr")}, ""), field(var("rr"), "ok"), consume, "Loop", "Loop");
+  }
+
+  g.processes = {src, mid, sink};
+  g.schedule.steps = {"Src", "Mid", "Sink"};
+  link_group(g);
+  return g;
+}
+
+// threads == 0: round-robin reference run
+static std::string dump_state(const caps::Runtime& rt, const caps::RunResult& r) {
+  std::ostringstream os;
+  os << (int)r.status << " " << r.reason << " tick=" << rt.tick << "\n";
+  for (auto& p : rt.procs) {
+    os << p.name << " " << p.state_name() << " " << (int)p.status;
+    for (auto& v : p.slots) os << " " << caps::to_string(v);
+    os << "\n";
+  }
+  return os.str();
+}
+
+static std::string final_state(const caps::IRGroup& g, unsigned threads) {
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  caps::RunResult r = threads ? caps::run_group_pipelined(rt, nullptr, 1000, threads)
+                              : caps::run_group(rt, nullptr, 1000);
+  return dump_state(rt, r);
+}
+
+TEST(DeterminismTests, PipelinedMatchesSequential) {
+  for (bool blocking : {false, true}) {
+    caps::IRGroup g = pipeline_group(blocking);
+    ASSERT_TRUE(caps::pipeline_ineligible_reason(g).empty());
+    std::string expected = final_state(g, 0);
+    for (unsigned threads : {2u, 3u}) {
+      for (int rep = 0; rep < 20; rep++) EXPECT_EQ(expected, final_state(g, threads));
+    }
+  }
+}
+
+static std::string jit_final_state(const caps::IRGroup& g, caps::SchedulerMode mode) {
+  caps::JitGroup jit(g);
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  rt.jit = &jit;
+  caps::RunResult r = caps::run_group(rt, nullptr, 1000, mode);
+  return dump_state(rt, r);
+}
+
+// what run_group throws, with or without the JIT
+static std::string run_error(const caps::IRGroup& g, bool use_jit) {
+  caps::JitGroup jit(g);
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  if (use_jit) rt.jit = &jit;
+  try {
+    caps::run_group(rt, nullptr, 10);
+  } catch (const std::exception& e) {
+    return e.what();
+  }
+  return "";
+}
+
+TEST(DeterminismTests, JitMatchesInterpreter) {
+  using K = caps::IRAction::Kind;
+  for (bool blocking : {false, true}) {
+    caps::IRGroup g = pipeline_group(blocking);
+    std::string expected = final_state(g, 0);
+    EXPECT_EQ(expected, jit_final_state(g, caps::SchedulerMode::RoundRobin));
+    EXPECT_EQ(expected, jit_final_state(g, caps::SchedulerMode::ReadyQueue));
+
+    caps::JitGroup jit(g);
+    EXPECT_EQ(jit.compiled_states(), caps::jit_supported() ? jit.total_states() : 0);
+  }
+
+  caps::IRGroup bad;
+  bad.name = "E";
+  bad.processes = {loop_proc("P", act(K::Assign, "", "x", bin("/", lit(1), var("x"))))};
+  bad.schedule.steps = {"P"};
+  caps::link_group(bad);
+  EXPECT_EQ(run_error(bad, false), "expected int");
+  EXPECT_EQ(run_error(bad, true), "expected int");
+
+  // && and || skip the right side's bool check when the left side decides
+  auto boolean = [](bool v) { caps::IRExpr e; e.kind = caps::IRExpr::Kind::LitBool; e.lit_b = v; return e; };
+  for (bool decided : {true, false}) {
+    caps::IRGroup g;
+    g.name = "L";
+    caps::IRProcess p; p.name = "P"; p.initial_state = "S"; p.local_names = {"x", "a", "o"};
+    add_state(p, "S", {act(K::Assign, "", "x", lit(1)),
+                       act(K::Assign, "", "a", bin("&&", boolean(!decided), var("x"))),
+                       act(K::Assign, "", "o", bin("||", boolean(decided), var("x")))}, "S");
+    g.processes = {p};
+    g.schedule.steps = {"P"};
+    caps::link_group(g);
+    caps::JitGroup jit(g);
+    EXPECT_EQ(jit.compiled_states(), caps::jit_supported() ? jit.total_states() : 0);
+    if (decided) {
+      EXPECT_EQ(run_error(g, false), "");
+      EXPECT_EQ(run_error(g, true), "");
+      EXPECT_EQ(final_state(g, 0), jit_final_state(g, caps::SchedulerMode::RoundRobin));
+    } else {
+      EXPECT_EQ(run_error(g, false), "expected bool");
+      EXPECT_EQ(run_error(g, true), "expected bool");
+    }
+  }
+}
+
+TEST(DeterminismTests, BatchMatchesSingleRuns) {
+  caps::IRGroup g = pipeline_group(true);
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  caps::RunResult single = caps::run_group(rt, nullptr, 1000);
+
+  caps::BatchSpec spec;
+  spec.group = &g;
+  spec.instances = 64;
+  spec.max_ticks = 1000;
+  spec.threads = 4;
+  spec.outputs = {caps::find_batch_slot(g, "Sink.sum"), caps::find_batch_slot(g, "Src.n")};
+  caps::BatchResult res = caps::run_batch(spec);
+
+  ASSERT_EQ(res.runs.size(), 64u);
+  for (size_t i = 0; i < res.runs.size(); i++) {
+    EXPECT_EQ(res.runs[i].tick, rt.tick);
+    EXPECT_EQ(caps::run_reason_text(res.runs[i].reason), single.reason);
+    EXPECT_EQ(caps::to_string(res.output(i, 0)), caps::to_string(*rt.procs[2].find_var("sum")));
+    EXPECT_EQ(caps::to_string(res.output(i, 1)), "200");
+  }
+}
+
+// even instances start with x unset and fail on 1 / x; odd ones loop on x = 1
+TEST(DeterminismTests, BatchRecordsFailedInstances) {
+  using K = caps::IRAction::Kind;
+  caps::IRGroup g;
+  g.name = "E";
+  g.processes = {loop_proc("P", act(K::Assign, "", "x", bin("/", lit(1), var("x"))))};
+  g.schedule.steps = {"P"};
+  caps::link_group(g);
+
+  caps::BatchSpec spec;
+  spec.group = &g;
+  spec.instances = 16;
+  spec.max_ticks = 10;
+  spec.threads = 3;
+  caps::BatchInput in;
+  in.proc = 0;
+  in.slot = g.processes[0].find_slot("x");
+  for (size_t i = 0; i < spec.instances; i++) in.values.push_back(i % 2 ? caps::Value::i(1) : caps::Value::unset());
+  spec.inputs = {in};
+  caps::BatchResult res = caps::run_batch(spec);
+
+  ASSERT_EQ(res.errors.size(), 8u);
+  for (size_t i = 0; i < res.runs.size(); i++) {
+    bool fails = i % 2 == 0;
+    EXPECT_EQ((int)res.runs[i].status, (int)(fails ? caps::RunStatus::Error : caps::RunStatus::Deadlock));
+    EXPECT_EQ(std::string(caps::run_reason_text(res.runs[i].reason)), fails ? "error" : "maxticks_exceeded");
+  }
+  for (size_t k = 0; k < res.errors.size(); k++) {
+    EXPECT_EQ(res.errors[k].first, 2 * k);
+    EXPECT_EQ(res.errors[k].second, "expected int");
+  }
+}
+
+TEST(DeterminismTests, CheckpointRestoreResumes) {
+  caps::IRGroup g = pipeline_group(true);
+  std::string expected = final_state(g, 0);
+
+  // snapshot at tick 150 of an uninterrupted run
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  std::vector<uint8_t> snap;
+  rt.checkpoint_every = 150;
+  rt.on_checkpoint = [&](const caps::Runtime& r) { if (r.tick == 150) caps::save_checkpoint(r, snap); };
+  caps::run_group(rt, nullptr, 1000);
+  ASSERT_TRUE(!snap.empty());
+
+  caps::Runtime resumed;
+  caps::restore_checkpoint(resumed, g, snap.data(), snap.size());
+  EXPECT_EQ(resumed.tick, 150u);
+  caps::RunResult r = caps::run_group(resumed, nullptr, 1000 - 150);
+  EXPECT_EQ(dump_state(resumed, r), expected);
+
+  // same through a file, and a corrupted snapshot is rejected
+  std::string path = "determinism_checkpoint.bin";
+  caps::write_checkpoint_file(resumed, path);
+  caps::Runtime from_file;
+  caps::restore_checkpoint_file(from_file, g, path);
+  EXPECT_EQ(dump_state(from_file, r), expected);
+  std::remove(path.c_str());
+
+  snap[snap.size() / 2] ^= 1;
+  bool rejected = false;
+  try {
+    caps::restore_checkpoint(from_file, g, snap.data(), snap.size());
+  } catch (const std::runtime_error&) {
+    rejected = true;
+  }
+  EXPECT_TRUE(rejected);
+
+  // `a` has capacity 3 but a 4-slot ring: a fourth buffered value is corrupt
+  caps::Runtime over;
+  caps::init_runtime(over, g);
+  for (int64_t k = 0; k < 4; k++) over.channels[0].push(caps::Value::i(k));
+  caps::save_checkpoint(over, snap);
+  std::string error;
+  try {
+    caps::restore_checkpoint(from_file, g, snap.data(), snap.size());
+  } catch (const std::runtime_error& e) {
+    error = e.what();
+  }
+  EXPECT_EQ(error, "checkpoint: channel overflow: a");
+}
+
+TEST(DeterminismTests, BinaryTraceDecodesToText) {
+  for (caps::IRGroup g : {rendezvous_group(), pipeline_group(true)}) {
+    caps::Runtime rt;
+    caps::init_runtime(rt, g);
+    std::ostringstream text;
+    caps::TextTrace t(text);
+    caps::run_group(rt, &t, 500);
+
+    for (auto mode : {caps::ChannelTrace::Buffers, caps::ChannelTrace::Deltas}) {
+      // small buffers so the run hands several over to the writer thread
+      caps::init_runtime(rt, g);
+      std::ostringstream bin;
+      {
+        caps::BinaryTraceSink b(g, bin, mode, 16 * 1024, 2);
+        caps::run_group(rt, &b, 500);
+        b.flush();
+      }
+      std::string bytes = bin.str();
+      std::ostringstream decoded;
+      caps::decode_binary_trace((const uint8_t*)bytes.data(), bytes.size(), decoded);
+      EXPECT_EQ(decoded.str(), text.str());
+    }
+  }
+
+  // deltas starting from non-empty channels, as after a restore
+  caps::IRGroup g = pipeline_group(true);
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  caps::run_group(rt, nullptr, 101);
+  rt.channels[1].push(caps::Value::i(-1));
+  std::vector<uint8_t> snap;
+  caps::save_checkpoint(rt, snap);
+
+  std::ostringstream text, bin;
+  caps::TextTrace t(text);
+  caps::run_group(rt, &t, 50);
+  caps::restore_checkpoint(rt, g, snap.data(), snap.size());
+  {
+    caps::BinaryTraceSink b(g, bin);
+    caps::run_group(rt, &b, 50);
+  }
+  std::string bytes = bin.str();
+  std::ostringstream decoded;
+  caps::decode_binary_trace((const uint8_t*)bytes.data(), bytes.size(), decoded);
+  EXPECT_EQ(decoded.str(), text.str());
+}
+
+TEST(DeterminismTests, ChunkedTraceSeeksToTick) {
+  caps::IRGroup g = pipeline_group(false);
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  std::ostringstream text;
+  caps::TextTrace t(text);
+  caps::run_group(rt, &t, 2000);
+  std::string from = text.str().substr(text.str().find("TICK 1500\n"));
+
+  for (auto mode : {caps::ChannelTrace::Buffers, caps::ChannelTrace::Deltas}) {
+    for (auto codec : {caps::TraceCodec::None, caps::TraceCodec::LZ}) {
+      caps::init_runtime(rt, g);
+      std::ostringstream bin;
+      {
+        caps::BinaryTraceOptions opts;
+        opts.channels = mode;
+        opts.layout = caps::TraceLayout::Chunked;
+        opts.codec = codec;
+        opts.buffer_bytes = 16 * 1024;
+        opts.buffers = 2;
+        caps::BinaryTraceSink b(g, bin, opts);
+        caps::run_group(rt, &b, 2000);
+        b.close();
+      }
+      std::string bytes = bin.str();
+      const uint8_t* data = (const uint8_t*)bytes.data();
+      std::ostringstream decoded;
+      caps::decode_binary_trace(data, bytes.size(), decoded);
+      EXPECT_EQ(decoded.str(), text.str());
+
+      caps::BinaryTraceReader r(data, bytes.size());
+      ASSERT_TRUE(r.chunks().size() > 2);
+      ASSERT_TRUE(r.seek(1500));
+      std::ostringstream tail;
+      caps::TextTraceFormat fmt{tail};
+      while (r.next()) caps::format_trace_event(r, fmt);
+      EXPECT_EQ(tail.str(), from);
+      EXPECT_TRUE(!r.seek(5000));
+    }
+  }
+}
+
+static std::string filtered_trace(const caps::IRGroup& g, caps::TraceSink& sink, const std::vector<std::string>& names) {
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  caps::TraceFilter f = caps::make_trace_filter(g, names);
+  caps::RunResult r = caps::run_group(rt, &sink, f, 300);
+  return dump_state(rt, r);
+}
+
+TEST(DeterminismTests, FilteredTraceSelectsProcesses) {
+  caps::IRGroup g = pipeline_group(false);
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  std::ostringstream full;
+  caps::TextTrace t(full);
+  std::string expected = dump_state(rt, caps::run_group(rt, &t, 300));
+
+  // selecting everything is the full trace
+  std::ostringstream all;
+  caps::TextTrace ta(all);
+  EXPECT_EQ(filtered_trace(g, ta, {"Src", "Mid", "Sink"}), expected);
+  EXPECT_EQ(all.str(), full.str());
+
+  // Sink only: the run is unchanged, Src's and Mid's steps are not traced
+  std::ostringstream text;
+  caps::TextTrace ts(text);
+  EXPECT_EQ(filtered_trace(g, ts, {"Sink"}), expected);
+  EXPECT_EQ(text.str().find("PROCESS_STEP Src"), std::string::npos);
+  EXPECT_EQ(text.str().find("PROCESS_STEP Mid"), std::string::npos);
+  EXPECT_NE(text.str().find("PROCESS_STEP Sink"), std::string::npos);
+  EXPECT_LT(text.str().size(), full.str().size());
+
+  // the binary trace re-snapshots `b` around Mid's untraced sends
+  std::ostringstream bin;
+  {
+    caps::BinaryTraceSink b(g, bin);
+    filtered_trace(g, b, {"Sink"});
+  }
+  std::string bytes = bin.str();
+  std::ostringstream decoded;
+  caps::decode_binary_trace((const uint8_t*)bytes.data(), bytes.size(), decoded);
+  EXPECT_EQ(decoded.str(), text.str());
+
+  bool rejected = false;
+  try {
+    caps::make_trace_filter(g, {"Nope"});
+  } catch (const std::runtime_error&) {
+    rejected = true;
+  }
+  EXPECT_TRUE(rejected);
+}
+
+static std::string binary_trace(const caps::IRGroup& g, const caps::BinaryTraceOptions& opts, uint64_t ticks) {
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  std::ostringstream bin;
+  {
+    caps::BinaryTraceSink b(g, bin, opts);
+    caps::run_group(rt, &b, ticks);
+    b.close();
+  }
+  return bin.str();
+}
+
+static caps::TraceDiff diff(const std::string& a, const std::string& b) {
+  return caps::diff_traces((const uint8_t*)a.data(), a.size(), (const uint8_t*)b.data(), b.size(), 3);
+}
+
+TEST(DeterminismTests, TraceDiffFindsFirstDivergence) {
+  caps::IRGroup g = pipeline_group(false), h = pipeline_group(false, 150);
+
+  // reference: the tick holding the first line where the text traces differ
+  std::string text[2];
+  for (int i = 0; i < 2; i++) {
+    caps::Runtime rt;
+    caps::init_runtime(rt, i ? h : g);
+    std::ostringstream os;
+    caps::TextTrace t(os);
+    caps::run_group(rt, &t, 2000);
+    text[i] = os.str();
+  }
+  size_t at = std::mismatch(text[0].begin(), text[0].end(), text[1].begin()).first - text[0].begin();
+  size_t tick_at = text[0].rfind("TICK ", at);
+  uint64_t tick = std::stoull(text[0].substr(tick_at + 5));
+
+  caps::BinaryTraceOptions stream, chunked, buffers, small, small_buffers;
+  chunked.layout = caps::TraceLayout::Chunked;
+  chunked.codec = caps::TraceCodec::LZ;
+  chunked.buffer_bytes = 16 * 1024;
+  buffers.channels = caps::ChannelTrace::Buffers;
+  small.buffer_bytes = 16 * 1024; // Stream: a Resync after every 16K
+  small_buffers = small;
+  small_buffers.channels = caps::ChannelTrace::Buffers;
+  for (auto& o : {stream, chunked, small, small_buffers}) {
+    std::string a = binary_trace(g, o, 2000);
+    EXPECT_TRUE(diff(a, binary_trace(g, o, 2000)).equal);
+    caps::TraceDiff d = diff(a, binary_trace(h, o, 2000));
+    EXPECT_TRUE(!d.equal);
+    EXPECT_EQ(d.tick, tick);
+    EXPECT_EQ(d.proc, "Src");
+    EXPECT_EQ(d.context.size(), 3u);
+    EXPECT_NE(d.expected, d.actual);
+    // Stream: memcmp up to the first differing byte, then decode from the
+    // resync point just before it
+    if (o.layout == caps::TraceLayout::Stream) EXPECT_TRUE(d.bytes_compared > 16 * 1024);
+  }
+
+  // other layouts and channel modes compare by events
+  std::string a = binary_trace(g, stream, 2000);
+  EXPECT_TRUE(diff(a, binary_trace(g, chunked, 2000)).equal);
+  EXPECT_TRUE(diff(binary_trace(g, buffers, 2000), binary_trace(g, chunked, 2000)).equal);
+  caps::TraceDiff d = diff(binary_trace(g, buffers, 2000), binary_trace(h, chunked, 2000));
+  EXPECT_EQ(d.tick, tick);
+
+  // a shorter run: its final status where a goes on
+  d = diff(a, binary_trace(g, stream, 1000));
+  EXPECT_EQ(d.tick, 1001u);
+  EXPECT_EQ(d.expected, "TICK 1001\n");
+  EXPECT_EQ(d.actual.rfind("RUNTIME_STATUS", 0), 0u);
+}
+
+// a try_send Result sent through a channel and taken back with try_receive
+TEST(DeterminismTests, ResultsCrossChannels) {
+  using K = caps::IRAction::Kind;
+  caps::IRGroup g;
+  g.name = "R";
+  g.channels.push_back({"inner", 1});
+  g.channels.push_back({"outer", 1});
+  caps::IRProcess p; p.name = "P"; p.initial_state = "Go"; p.local_names = {"r", "rr", "x"};
+  add_state(p, "Go", {act(K::TrySend, "inner", "r", lit(5)), act(K::Send, "outer", "", var("r")),
+                      act(K::TryReceive, "outer", "rr"),
+                      act(K::Assign, "", "x", field(field(var("rr"), "value"), "ok"))}, "Done");
+  add_state(p, "Done", {}, "Done").terminal = true;
+  g.processes = {p};
+  g.schedule.steps = {"P"};
+  caps::link_group(g);
+
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  caps::RunResult r = caps::run_group(rt, nullptr, 10);
+  EXPECT_EQ(dump_state(rt, r), jit_final_state(g, caps::SchedulerMode::RoundRobin));
+  const caps::Value& rr = *rt.procs[0].find_var("rr");
+  EXPECT_EQ(caps::to_string(rr), "{error=\"\", value={error=\"\", value=true, ok=true}, ok=true}");
+  EXPECT_EQ(caps::to_string(*rt.procs[0].find_var("x")), "true");
+
+  std::vector<uint8_t> enc;
+  caps::encode_value(enc, rr);
+  const uint8_t* at = enc.data();
+  EXPECT_EQ(caps::to_string(caps::decode_value(at, enc.data() + enc.size())), caps::to_string(rr));
+  at = enc.data();
+  EXPECT_EQ(caps::encoded_to_string(at, enc.data() + enc.size()), caps::to_string(rr));
+}
+
+TEST(DeterminismTests, EmptyErrorTextIsAnError) {
+  caps::Value e = caps::make_result_err_text("");
+  EXPECT_TRUE(!caps::result_ok(e));
+  EXPECT_NE(caps::result_error_code(e), caps::kErrNone);
+  EXPECT_EQ(caps::result_error_code(e), caps::intern_error(""));
+  EXPECT_EQ(caps::error_text(caps::result_error_code(e)), "");
+
+  std::vector<uint8_t> enc;
+  caps::encode_value(enc, e);
+  const uint8_t* at = enc.data();
+  caps::Value back = caps::decode_value(at, enc.data() + enc.size());
+  EXPECT_TRUE(!caps::result_ok(back));
+  EXPECT_EQ(caps::to_string(back), "{error=\"\", value=(unset), ok=false}");
+}
+
+// two receivers park on one rendezvous channel, the higher index first: the
+// lower index gets the value whatever the park order (as the linear scan over
+// procs did), and a checkpoint keeps the parked set
+TEST(DeterminismTests, RendezvousWakesLowestIndexFirst) {
+  using K = caps::IRAction::Kind;
+  caps::IRGroup g;
+  g.name = "W";
+  g.channels.push_back({"sync", 0});
+  g.processes = {loop_proc("RxA", act(K::Receive, "sync", "x")), loop_proc("RxB", act(K::Receive, "sync", "x")),
+                 loop_proc("Tx", act(K::Send, "sync", "", lit(7)))};
+  g.schedule.steps = {"RxB", "RxA", "Tx", "RxA", "RxB"};
+  caps::link_group(g);
+
+  for (auto mode : {caps::SchedulerMode::RoundRobin, caps::SchedulerMode::ReadyQueue}) {
+    caps::Runtime rt;
+    caps::init_runtime(rt, g);
+    auto parked = [&] {
+      std::vector<uint32_t> ids;
+      rt.channels[0].recv_waiters.for_each([&](uint32_t id) { ids.push_back(id); });
+      return ids;
+    };
+    caps::run_group(rt, nullptr, 1, mode);
+    EXPECT_EQ(caps::to_string(*rt.procs[0].find_var("x")), "7");
+    EXPECT_EQ(caps::to_string(*rt.procs[1].find_var("x")), "(unset)");
+    EXPECT_TRUE(parked() == (std::vector<uint32_t>{1}));
+
+    // RxA parks again after RxB and still wins
+    caps::run_group(rt, nullptr, 1, mode);
+    EXPECT_EQ(caps::to_string(*rt.procs[1].find_var("x")), "(unset)");
+    EXPECT_TRUE(parked() == (std::vector<uint32_t>{1}));
+
+    std::vector<uint8_t> snap;
+    caps::save_checkpoint(rt, snap);
+    caps::Runtime resumed;
+    caps::restore_checkpoint(resumed, g, snap.data(), snap.size());
+    caps::RunResult a = caps::run_group(rt, nullptr, 20, mode);
+    caps::RunResult b = caps::run_group(resumed, nullptr, 20, mode);
+    EXPECT_EQ(dump_state(rt, a), dump_state(resumed, b));
+  }
+}
+
+// locals, then outputs, then __last_error, then undeclared destinations
+TEST(DeterminismTests, SlotsFollowDeclarationOrder) {
+  using K = caps::IRAction::Kind;
+  caps::IRGroup g;
+  g.name = "S";
+  caps::IRProcess p;
+  p.name = "P";
+  p.initial_state = "S";
+  p.local_names = {"a", "b"};
+  p.output_names = {"out"};
+  add_state(p, "S", {act(K::Assign, "", "out", var("nope")),
+                     act(K::Assign, "", "tmp", bin("+", var("a"), var("b")))}, "S");
+  g.processes = {p};
+  g.schedule.steps = {"P"};
+  caps::resolve_slots(g);
+
+  const caps::IRProcess& r = g.processes[0];
+  EXPECT_TRUE(r.slot_names == (std::vector<std::string>{"a", "b", "out", "__last_error", "tmp"}));
+  EXPECT_EQ(r.output_slot_begin, 2u);
+  EXPECT_EQ(r.output_slot_end, 3u);
+  EXPECT_EQ(r.last_error_slot, 3u);
+  const auto& acts = r.states.at("S").actions;
+  EXPECT_EQ(acts[0].dst_slot, 2u);
+  EXPECT_EQ(acts[0].expr.slot, caps::kNoSlot);
+  EXPECT_EQ(acts[1].dst_slot, 4u);
+  EXPECT_EQ(acts[1].expr.args[0].slot, 0u);
+  EXPECT_EQ(acts[1].expr.args[1].slot, 1u);
+
+  std::vector<std::string> first = r.slot_names;
+  caps::resolve_slots(g);
+  EXPECT_TRUE(g.processes[0].slot_names == first);
+  EXPECT_EQ(g.processes[0].states.at("S").actions[1].dst_slot, 4u);
+
+  // the unresolved read only fails once executed
+  caps::link_group(g);
+  EXPECT_EQ(run_error(g, false), "unknown var: nope");
+}
+
+TEST(DeterminismTests, LinkGroupAssignsIds) {
+  using K = caps::IRAction::Kind;
+  caps::IRGroup g;
+  g.name = "L";
+  g.channels.push_back({"buf", 2});
+  g.channels.push_back({"sync", 0});
+  caps::IRProcess tx = loop_proc("Tx", act(K::Send, "sync", "", lit(1)));
+  caps::IRProcess rx;
+  rx.name = "Rx";
+  rx.initial_state = "Init";
+  add_state(rx, "Init", {act(K::Receive, "sync", "x")}, "B");
+  add_state(rx, "B", {act(K::TryReceive, "buf", "r")}, "A");
+  add_state(rx, "A", {act(K::Send, "buf", "", var("x"))}, "Init");
+  g.processes = {tx, rx};
+  g.schedule.steps = {"Rx", "Tx", "Rx"};
+  caps::link_group(g);
+
+  EXPECT_TRUE(g.linked);
+  EXPECT_TRUE(g.schedule.step_ids == (std::vector<uint32_t>{1, 0, 1}));
+  const caps::IRProcess& p = g.processes[1];
+  EXPECT_TRUE(p.state_names == (std::vector<std::string>{"Init", "A", "B"}));
+  EXPECT_EQ(p.initial_state_id, 0u);
+  EXPECT_EQ(p.states.at("A").id, 1u);
+  EXPECT_EQ(p.states.at("Init").transition.to_id, 2u);
+  EXPECT_EQ(p.states.at("B").transition.to_id, 1u);
+
+  // only the unbuffered receive gets a mailbox slot
+  const caps::IRAction& recv = p.states.at("Init").actions[0];
+  EXPECT_EQ(recv.chan_id, 1u);
+  EXPECT_EQ(recv.mailbox_slot, p.find_slot("sync.__recv_value"));
+  EXPECT_NE(recv.mailbox_slot, caps::kNoSlot);
+  EXPECT_EQ(p.states.at("B").actions[0].chan_id, 0u);
+  EXPECT_EQ(p.states.at("B").actions[0].mailbox_slot, caps::kNoSlot);
+
+  // unknown names link to kNoSlot and fail when reached
+  caps::IRGroup chan = g;
+  chan.processes[0].states.at("S").actions[0].chan = "gone";
+  caps::link_group(chan);
+  EXPECT_EQ(chan.processes[0].states.at("S").actions[0].chan_id, caps::kNoSlot);
+  EXPECT_EQ(run_error(chan, false), "send: unknown channel gone");
+
+  caps::IRGroup state = g;
+  state.processes[1].states.at("B").transition.to_state = "Gone";
+  caps::link_group(state);
+  EXPECT_EQ(state.processes[1].states.at("B").transition.to_id, caps::kNoSlot);
+  EXPECT_EQ(run_error(state, false), "unknown state: Gone");
+
+  caps::IRGroup step = g;
+  step.schedule.steps.push_back("Ghost");
+  caps::link_group(step);
+  EXPECT_EQ(step.schedule.step_ids.back(), caps::kNoSlot);
+  EXPECT_EQ(run_error(step, false), "schedule references unknown process: Ghost");
+
+  caps::IRGroup init = g;
+  init.processes[1].initial_state = "Nowhere";
+  caps::link_group(init);
+  EXPECT_EQ(init.processes[1].initial_state_id, caps::kNoSlot);
+  caps::Runtime rt;
+  EXPECT_THROW(caps::init_runtime(rt, init), std::runtime_error);
+}
+
+// capacity 3 rounds up to a 4-slot ring; the counters lap it many times
+TEST(DeterminismTests, ChannelRingWrapsAround) {
+  caps::Channel c;
+  c.init("c", 3);
+  EXPECT_EQ(c.ring.size(), 4u);
+  int64_t in = 0, out = 0;
+  for (int round = 0; round < 10; round++) {
+    while (!c.full()) c.push(caps::Value::i(in++));
+    EXPECT_EQ(c.size(), 3u);
+    caps::ChannelView v = c.view();
+    for (size_t k = 0; k < v.size(); k++) EXPECT_EQ(caps::as_int(v[k]), out + (int64_t)k);
+    for (int k = 0; k < 2; k++) EXPECT_EQ(caps::as_int(c.pop()), out++);
+  }
+  EXPECT_EQ(c.tail.get(), 21u);
+
+  // 200 values through `a` (ring of 4) and `b` (ring of 8), in order
+  caps::IRGroup g = pipeline_group(true);
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  caps::run_group(rt, nullptr, 1000);
+  EXPECT_EQ(rt.channels[0].tail.get(), 200u);
+  EXPECT_EQ(caps::to_string(*rt.procs[2].find_var("inorder")), "true");
+  EXPECT_EQ(caps::to_string(*rt.procs[2].find_var("sum")), "39800");
+}
+
+// boxed values are moved through the ring, never copied or left behind
+TEST(DeterminismTests, ChannelValuesAreMoved) {
+  caps::Channel c;
+  c.init("c", 2);
+  caps::Value text = caps::Value::s("payload");
+  c.push(std::move(text));
+  EXPECT_TRUE(text.is_unset());
+  caps::Value got = c.pop();
+  EXPECT_EQ(got.u.box->refs.load(), 1u);
+  for (auto& slot : c.ring) EXPECT_TRUE(slot.is_unset());
+
+  // Tx keeps its own reference; the receiver holds the only other one
+  using K = caps::IRAction::Kind;
+  caps::IRGroup g;
+  g.name = "M";
+  g.channels.push_back({"buf", 1});
+  g.channels.push_back({"sync", 0});
+  caps::IRProcess tx;
+  tx.name = "Tx";
+  tx.initial_state = "S";
+  tx.local_names = {"s"};
+  add_state(tx, "S", {act(K::Send, "buf", "", var("s")), act(K::Send, "sync", "", var("s"))}, "Done");
+  add_state(tx, "Done", {}, "Done").terminal = true;
+  caps::IRProcess rx;
+  rx.name = "Rx";
+  rx.initial_state = "S";
+  rx.local_names = {"x", "y"};
+  add_state(rx, "S", {act(K::Receive, "sync", "y"), act(K::Receive, "buf", "x")}, "Done");
+  add_state(rx, "Done", {}, "Done").terminal = true;
+  g.processes = {tx, rx};
+  g.schedule.steps = {"Rx", "Tx", "Rx"};
+  caps::link_group(g);
+
+  caps::Runtime rt;
+  caps::init_runtime(rt, g);
+  *rt.procs[0].find_var("s") = caps::Value::s("payload");
+  caps::RunResult r = caps::run_group(rt, nullptr, 10);
+  EXPECT_EQ(r.reason, "allprocessesterminal");
+  EXPECT_EQ(caps::to_string(*rt.procs[1].find_var("y")), "\"payload\"");
+  EXPECT_EQ(rt.procs[0].find_var("s")->u.box->refs.load(), 3u);
+  for (auto& ch : rt.channels) {
+    for (auto& slot : ch.ring) EXPECT_TRUE(slot.is_unset());
+  }
+  EXPECT_TRUE(rt.procs[1].find_var("sync.__recv_value")->is_unset());
+}
+
+// Src sends n .. 0, Sink sums until it sees 0
+static const char* const kSumSource = R"(
+module sum
+
+group Sum {
+  channel<int; 2> c
+
+  process Src() -> () {
+    state Send
+    state Done
+    var n:int = 3
+
+    on Send {
+      send n -> c
+      if n == 0 { } -> Done else { do n = n - 1 } -> Send
+    }
+    on Done { -> Done }
+  }
+
+  process Sink() -> (total:int) {
+    state Recv
+    state Done
+    var acc:int = 0
+
+    on Recv {
+      receive c -> var x:int
+      do acc = acc + x
+      if x == 0 { do total = acc } -> Done else { } -> Recv
+    }
+    on Done { -> Done }
+  }
+
+  schedule { step Src step Sink repeat }
+}
+)";
+
+static Program checked(const std::string& src) {
+  Diag diag;
+  Lexer lex(src, diag);
+  Parser parser(lex, diag);
+  Program prog = parser.parse_program();
+  Sema sema(diag);
+  sema.check(prog);
+  EXPECT_FALSE(diag.has_errors());
+  return prog;
+}
+
+TEST(DeterminismTests, SimulatorBridgeRunsCheckedSource) {
+  Program prog = checked(kSumSource);
+  ASSERT_EQ(prog.groups.size(), 1u);
+  caps::IRGroup g = to_ir_group(prog.groups[0]);
+  caps::link_group(g);
+  EXPECT_TRUE(g.processes[0].state_names == (std::vector<std::string>{"Send", "Done"}));
+  EXPECT_TRUE(g.processes[1].states.at("Done").terminal);
+  EXPECT_FALSE(g.processes[1].states.at("Recv").terminal);
+
+  std::vector<LocalInit> inits = local_inits(prog.groups[0]);
+  ASSERT_EQ(inits.size(), 2u);
+  EXPECT_EQ(inits[0].name, "Src.n");
+  EXPECT_EQ(caps::to_string(inits[1].value), "0");
+
+  // declared initializers first, then a sweep of Src.n over 0 .. 4
+  caps::BatchSpec spec;
+  spec.group = &g;
+  spec.instances = 5;
+  spec.max_ticks = 100;
+  for (auto& l : inits) {
+    caps::BatchOutput at = caps::find_batch_slot(g, l.name);
+    spec.inputs.push_back({at.proc, at.slot, std::vector<caps::Value>(spec.instances, l.value)});
+  }
+  caps::BatchOutput n = caps::find_batch_slot(g, "Src.n");
+  caps::BatchInput sweep{n.proc, n.slot, {}};
+  for (int64_t i = 0; i < 5; i++) sweep.values.push_back(caps::Value::i(i));
+  spec.inputs.push_back(sweep);
+  spec.outputs = {caps::find_batch_slot(g, "Sink.total")};
+  caps::BatchResult res = caps::run_batch(spec);
+
+  ASSERT_EQ(res.runs.size(), 5u);
+  for (size_t i = 0; i < res.runs.size(); i++) {
+    EXPECT_EQ(std::string(caps::run_reason_text(res.runs[i].reason)), "allprocessesterminal");
+    EXPECT_EQ(caps::to_string(res.output(i, 0)), std::to_string(i * (i + 1) / 2));
+  }
+
+  // the IR has nowhere to put a computed initializer
+  Program bad = checked(std::string(kSumSource).replace(std::string(kSumSource).find("= 3"), 3, "= 1 + 2"));
+  EXPECT_THROW(local_inits(bad.groups[0]), std::runtime_error);
+}
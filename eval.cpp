@@ -1,5 +1,6 @@
 #include "backend/eval.h"
 #include <stdexcept>
+#include <utility>
 
 namespace caps {
 
@@ -15,10 +16,10 @@ static Value eval_binop(const std::string& op, const Value& a, const Value& b) {
 
   if (op == "==") {
     // minimal: int/bool/text compare
-    if (a.v.index() != b.v.index()) return Value::b(false);
-    if (std::holds_alternative<int64_t>(a.v)) return Value::b(as_int(a) == as_int(b));
-    if (std::holds_alternative<bool>(a.v)) return Value::b(as_bool(a) == as_bool(b));
-    if (std::holds_alternative<std::string>(a.v)) return Value::b(as_text(a) == as_text(b));
+    if (a.tag != b.tag) return Value::b(false);
+    if (a.tag == ValueTag::Int) return Value::b(as_int(a) == as_int(b));
+    if (a.tag == ValueTag::Bool) return Value::b(as_bool(a) == as_bool(b));
+    if (a.tag == ValueTag::Text) return Value::b(as_text(a) == as_text(b));
     throw std::runtime_error("== unsupported type");
   }
   if (op == "!=") {
@@ -46,17 +47,13 @@ Value eval_expr(const Runtime& rt, const ProcessInstance* self, const IRExpr& e)
 
     case K::Var: {
       if (!self) throw std::runtime_error("Var requires process context: " + e.name);
-      auto it = self->locals.find(e.name);
-      if (it != self->locals.end()) return it->second;
-      auto ot = self->outputs.find(e.name);
-      if (ot != self->outputs.end()) return ot->second;
-      throw std::runtime_error("unknown var: " + e.name);
+      if (e.slot >= self->slots.size()) throw std::runtime_error("unknown var: " + e.name);
+      return self->slots[e.slot];
     }
 
     case K::LenChannel: {
-      auto it = rt.channels.find(e.name);
-      if (it == rt.channels.end()) throw std::runtime_error("unknown channel: " + e.name);
-      return Value::i((int64_t)it->second.buffer.size());
+      if (e.chan_id >= rt.channels.size()) throw std::runtime_error("unknown channel: " + e.name);
+      return Value::i((int64_t)rt.channels[e.chan_id].size());
     }
 
     case K::BinOp: {
@@ -69,7 +66,14 @@ Value eval_expr(const Runtime& rt, const ProcessInstance* self, const IRExpr& e)
     case K::Field: {
       if (e.args.size() != 1) throw std::runtime_error("Field expects 1 arg");
       Value base = eval_expr(rt, self, e.args[0]);
-      auto& rec = as_record(base);
+      if (base.tag == ValueTag::Result) {
+        if (e.field == "ok") return Value::b(result_is_ok(base));
+        if (e.field == "value") return result_payload(std::move(base));
+        if (e.field == "error") return Value::s(error_text(base.err));
+        throw std::runtime_error("missing field: " + e.field);
+      }
+      // const overloads: the mutable ones detach (deep-copy) a shared payload
+      const Record& rec = as_record(std::as_const(base));
       auto it = rec.fields.find(e.field);
       if (it == rec.fields.end()) throw std::runtime_error("missing field: " + e.field);
       return it->second;
@@ -77,8 +81,8 @@ Value eval_expr(const Runtime& rt, const ProcessInstance* self, const IRExpr& e)
 
     case K::Index: {
       if (e.args.size() != 1) throw std::runtime_error("Index expects 1 arg");
-      Value base = eval_expr(rt, self, e.args[0]);
-      auto& arr = as_array(base);
+      const Value base = eval_expr(rt, self, e.args[0]);
+      const Array& arr = as_array(base);
       if (e.index_const < 0 || (size_t)e.index_const >= arr.elems.size())
         throw std::runtime_error("index out of bounds");
       return arr.elems[(size_t)e.index_const];
@@ -89,9 +93,8 @@ Value eval_expr(const Runtime& rt, const ProcessInstance* self, const IRExpr& e)
         if (e.args.size() != 1) throw std::runtime_error("len expects 1 arg");
         auto& arg = e.args[0];
         if (arg.kind != IRExpr::Kind::Var) throw std::runtime_error("len arg must be channel var");
-        auto it = rt.channels.find(arg.name);
-        if (it == rt.channels.end()) throw std::runtime_error("unknown channel: " + arg.name);
-        return Value::i((int64_t)it->second.buffer.size());
+        if (e.chan_id >= rt.channels.size()) throw std::runtime_error("unknown channel: " + arg.name);
+        return Value::i((int64_t)rt.channels[e.chan_id].size());
       } else {
         throw std::runtime_error("unknown function: " + e.func_name);
       }
@@ -5,258 +5,294 @@
 
 namespace caps {
 
-static void trace_channel(TraceSink* t, const std::string& ch, const Channel& c);
+static Value& dst_ref(ProcessInstance& p, const IRAction& a) {
+  if (a.dst_slot >= p.slots.size()) throw std::runtime_error("unresolved destination: " + a.dst);
+  return p.slots[a.dst_slot];
+}
+
+static Channel& chan_ref(Runtime& rt, const IRAction& a, const char* op) {
+  if (a.chan_id >= rt.channels.size()) throw std::runtime_error(std::string(op) + ": unknown channel " + a.chan);
+  return rt.channels[a.chan_id];
+}
+
+// Buffered-channel access. Under the pipelined scheduler the other end of c may
+// run on another thread, so occupancy is asked of rt.sync instead of read off
+// the ring directly.
+static bool chan_full(Runtime& rt, const ProcessInstance& p, const IRAction& a, const Channel& c) {
+  return rt.sync ? rt.sync->full(p, a.chan_id) : c.full();
+}
+
+static bool chan_empty(Runtime& rt, const ProcessInstance& p, const IRAction& a, const Channel& c) {
+  return rt.sync ? rt.sync->empty(p, a.chan_id) : c.empty();
+}
+
+static void chan_push(Runtime& rt, const ProcessInstance& p, const IRAction& a, Channel& c, Value&& v) {
+  if (rt.sync) rt.sync->on_push(p, a.chan_id);
+  c.push(std::move(v));
+}
+
+static Value chan_pop(Runtime& rt, const ProcessInstance& p, const IRAction& a, Channel& c) {
+  if (rt.sync) rt.sync->on_pop(p, a.chan_id);
+  return c.pop();
+}
 
-bool exec_action(Runtime& rt, ProcessInstance& p, const IRAction& a, TraceSink* trace) {
+// Hands v to the lowest-index receiver parked on unbuffered channel c, if any.
+static bool handoff(Runtime& rt, Channel& c, Value v) {
+  if (c.recv_waiters.empty()) return false;
+  ProcessInstance& q = rt.procs[c.recv_waiters.wake()];
+  q.slots[q.blocked_mailbox] = std::move(v); // internal mailbox
+  q.mail_ready[q.blocked_mailbox] = 1;
+  q.status = ProcStatus::Running;
+  q.blocked_chan = kNoSlot;
+  q.blocked_mailbox = kNoSlot;
+  rt.woken.push_back(q.id);
+  return true;
+}
+
+template <class Trace>
+bool exec_action(Runtime& rt, ProcessInstance& p, const IRAction& a, const Trace& trace) {
   using K = IRAction::Kind;
 
   if (p.status != ProcStatus::Running) return false;
 
-  auto block_on = [&](const std::string& ch, bool is_send) {
+  auto block_on = [&](Channel& c, bool is_send, uint32_t mailbox = kNoSlot) {
     p.status = ProcStatus::Blocked;
-    p.blocked_chan = ch;
+    p.blocked_chan = a.chan_id;
     p.blocked_is_send = is_send;
+    p.blocked_mailbox = mailbox;
+    (is_send ? c.send_waiters : c.recv_waiters).park(p.id);
   };
 
   switch (a.kind) {
     case K::Assign: {
       Value v = eval_expr(rt, &p, a.expr);
-      auto before_it = p.locals.find(a.dst);
-      Value before = (before_it == p.locals.end()) ? Value::unset() : before_it->second;
-      p.locals[a.dst] = v;
+      Value& dst = dst_ref(p, a);
 
-      if (trace) trace->on_assign(p.name, a.dst, before, v);
+      if (Trace::enabled && trace.proc(p)) trace.sink->on_assign(p, a.dst_slot, dst, v);
+      dst = std::move(v);
       return false;
     }
 
     case K::Send: {
-      auto it = rt.channels.find(a.chan);
-      if (it == rt.channels.end()) throw std::runtime_error("send: unknown channel " + a.chan);
-
-      Channel& c = it->second;
+      Channel& c = chan_ref(rt, a, "send");
       Value v = eval_expr(rt, &p, a.expr);
 
-      if (trace) trace->on_send_begin(p.name, a.chan, v, c.buffer);
+      if (Trace::enabled && trace.chan(p, c)) trace.sink->on_send_begin(p, c, v);
 
       // Blocking rule:
       // - buffered: block if full
       // - unbuffered (cap=0): also block unless a receiver is already blocked on same channel
       if (c.capacity == 0) {
-        // rendezvous: must have receiver waiting
-        bool found_waiting_recv = false;
-        for (auto& kv : rt.procs) {
-          auto& q = kv.second;
-          if (q.status == ProcStatus::Blocked && !q.blocked_is_send && q.blocked_chan == a.chan) {
-            // deliver directly
-            q.locals[q.blocked_chan + ".__recv_value"] = v; // internal mailbox
-            q.status = ProcStatus::Running;
-            q.blocked_chan.clear();
-            found_waiting_recv = true;
-            break;
-          }
-        }
-        if (!found_waiting_recv) {
-          if (trace) trace->on_block(p.name, "send", a.chan, "unbuffered_no_receiver");
-          block_on(a.chan, true);
+        // rendezvous: must have receiver waiting; deliver directly
+        if (!handoff(rt, c, std::move(v))) {
+          if (Trace::enabled && trace.chan(p, c)) trace.sink->on_block(p, c, BlockReason::UnbufferedNoReceiver);
+          block_on(c, true);
           return true;
         }
-        if (trace) trace->on_send_end(p.name, a.chan, c.buffer);
+        if (Trace::enabled && trace.chan(p, c)) trace.sink->on_send_end(p, c);
         return false;
       }
 
-      if (c.buffer.size() >= c.capacity) {
-        if (trace) trace->on_block(p.name, "send", a.chan, "channel_full");
-        block_on(a.chan, true);
+      if (chan_full(rt, p, a, c)) {
+        if (Trace::enabled && trace.chan(p, c)) trace.sink->on_block(p, c, BlockReason::ChannelFull);
+        block_on(c, true);
         return true;
       }
 
-      c.buffer.push_back(v);
-      if (trace) trace->on_send_end(p.name, a.chan, c.buffer);
+      chan_push(rt, p, a, c, std::move(v));
+      if (Trace::enabled && trace.chan(p, c)) trace.sink->on_send_end(p, c);
       return false;
     }
 
     case K::Receive: {
-      auto it = rt.channels.find(a.chan);
-      if (it == rt.channels.end()) throw std::runtime_error("receive: unknown channel " + a.chan);
-
-      Channel& c = it->second;
-      if (trace) trace->on_receive_begin(p.name, a.chan, c.buffer);
+      Channel& c = chan_ref(rt, a, "receive");
+      if (Trace::enabled && trace.chan(p, c)) trace.sink->on_receive_begin(p, c);
 
       if (c.capacity == 0) {
-        // unbuffered rendezvous: sender must be blocked waiting
-        // sender stores nothing; we look for any sender blocked on this channel
-        bool found_sender = false;
-        Value v = Value::unset();
-        for (auto& kv : rt.procs) {
-          auto& q = kv.second;
-          if (q.status == ProcStatus::Blocked && q.blocked_is_send && q.blocked_chan == a.chan) {
-            // can't extract value from sender in this simple model unless sender also had mailbox;
-            // therefore in this reference runtime, we model unbuffered send delivering by waking receiver in send().
-            // If we reach here, no pre-delivered value.
-            found_sender = false;
-            break;
-          }
-        }
-
-        // see if send() already deposited value in internal mailbox
-        auto mb = p.locals.find(a.chan + ".__recv_value");
-        if (mb != p.locals.end()) {
-          v = mb->second;
-          p.locals.erase(mb);
-          p.locals[a.dst] = v;
-          if (trace) trace->on_receive_end(p.name, a.chan, v, c.buffer);
+        // unbuffered rendezvous: a parked sender stores nothing, so the value can only
+        // arrive through our mailbox slot, deposited by send() when it finds us parked.
+        uint32_t mb = a.mailbox_slot;
+        if (p.mail_ready[mb]) {
+          Value& dst = dst_ref(p, a);
+          dst = std::move(p.slots[mb]);
+          p.mail_ready[mb] = 0;
+          if (Trace::enabled && trace.chan(p, c)) trace.sink->on_receive_end(p, c, dst);
           return false;
         }
 
-        if (!found_sender) {
-          if (trace) trace->on_block(p.name, "receive", a.chan, "unbuffered_no_value");
-          block_on(a.chan, false);
-          return true;
-        }
-        // unreachable in this model
+        if (Trace::enabled && trace.chan(p, c)) trace.sink->on_block(p, c, BlockReason::UnbufferedNoValue);
+        block_on(c, false, mb);
+        return true;
       }
 
-      if (c.buffer.empty()) {
-        if (trace) trace->on_block(p.name, "receive", a.chan, "channel_empty");
-        block_on(a.chan, false);
+      if (chan_empty(rt, p, a, c)) {
+        if (Trace::enabled && trace.chan(p, c)) trace.sink->on_block(p, c, BlockReason::ChannelEmpty);
+        block_on(c, false);
         return true;
       }
 
-      Value v = c.buffer.front();
-      c.buffer.pop_front();
-
-      p.locals[a.dst] = v;
-      if (trace) trace->on_receive_end(p.name, a.chan, v, c.buffer);
+      Value& dst = dst_ref(p, a);
+      dst = chan_pop(rt, p, a, c);
+      if (Trace::enabled && trace.chan(p, c)) trace.sink->on_receive_end(p, c, dst);
       return false;
     }
 
     case K::TrySend: {
-      auto it = rt.channels.find(a.chan);
-      if (it == rt.channels.end()) throw std::runtime_error("try_send: unknown channel " + a.chan);
-      Channel& c = it->second;
-
+      Channel& c = chan_ref(rt, a, "try_send");
       Value v = eval_expr(rt, &p, a.expr);
       bool success = false;
 
       if (c.capacity == 0) {
         // unbuffered: succeed only if receiver already blocked
-        for (auto& kv : rt.procs) {
-          auto& q = kv.second;
-          if (q.status == ProcStatus::Blocked && !q.blocked_is_send && q.blocked_chan == a.chan) {
-            q.locals[q.blocked_chan + ".__recv_value"] = v;
-            q.status = ProcStatus::Running;
-            q.blocked_chan.clear();
-            success = true;
-            break;
-          }
-        }
+        if (Trace::enabled && trace.chan(p, c)) success = handoff(rt, c, v); // v is traced below
+        else success = handoff(rt, c, std::move(v));
       } else {
-        if (c.buffer.size() < c.capacity) {
-          c.buffer.push_back(v);
+        if (!chan_full(rt, p, a, c)) {
+          chan_push(rt, p, a, c, std::move(v));
           success = true;
         }
       }
 
       // Result<bool,text>: ok=true always; value indicates success
-      p.locals[a.dst] = make_result_ok(Value::b(success));
-      if (trace) trace->on_try_send(p.name, a.chan, v, success, c.buffer);
+      dst_ref(p, a) = make_result_ok(Value::b(success));
+      if (Trace::enabled && trace.chan(p, c)) trace.sink->on_try_send(p, c, (success && c.capacity) ? c.back() : v, success);
       return false;
     }
 
     case K::TryReceive: {
-      auto it = rt.channels.find(a.chan);
-      if (it == rt.channels.end()) throw std::runtime_error("try_receive: unknown channel " + a.chan);
-      Channel& c = it->second;
-
+      Channel& c = chan_ref(rt, a, "try_receive");
       if (c.capacity == 0) {
         // unbuffered: check mailbox
-        auto mb = p.locals.find(a.chan + ".__recv_value");
-        if (mb != p.locals.end()) {
-          Value v = mb->second;
-          p.locals.erase(mb);
-          p.locals[a.dst] = make_result_ok(v);
-          if (trace) trace->on_try_receive(p.name, a.chan, true, v, c.buffer);
+        uint32_t mb = a.mailbox_slot;
+        if (p.mail_ready[mb]) {
+          Value& dst = dst_ref(p, a);
+          dst = make_result_ok(std::move(p.slots[mb]));
+          p.mail_ready[mb] = 0;
+          if (Trace::enabled && trace.chan(p, c)) trace.sink->on_try_receive(p, c, true, result_payload(dst));
           return false;
         }
-        p.locals[a.dst] = make_result_err_text("empty");
-        if (trace) trace->on_try_receive(p.name, a.chan, false, Value::unset(), c.buffer);
+        dst_ref(p, a) = make_result_err(kErrEmpty);
+        if (Trace::enabled && trace.chan(p, c)) trace.sink->on_try_receive(p, c, false, Value::unset());
         return false;
       }
 
-      if (c.buffer.empty()) {
-        p.locals[a.dst] = make_result_err_text("empty");
-        if (trace) trace->on_try_receive(p.name, a.chan, false, Value::unset(), c.buffer);
+      if (chan_empty(rt, p, a, c)) {
+        dst_ref(p, a) = make_result_err(kErrEmpty);
+        if (Trace::enabled && trace.chan(p, c)) trace.sink->on_try_receive(p, c, false, Value::unset());
         return false;
       }
 
-      Value v = c.buffer.front();
-      c.buffer.pop_front();
-      p.locals[a.dst] = make_result_ok(v);
-      if (trace) trace->on_try_receive(p.name, a.chan, true, v, c.buffer);
+      Value& dst = dst_ref(p, a);
+      dst = make_result_ok(chan_pop(rt, p, a, c));
+      if (Trace::enabled && trace.chan(p, c)) trace.sink->on_try_receive(p, c, true, result_payload(dst));
       return false;
     }
+
+    case K::TryUnwrapAssign: {
+      Value rv = eval_expr(rt, &p, a.expr);
+      if (result_is_ok(rv)) {
+        Value v = result_payload(std::move(rv));
+        Value& dst = dst_ref(p, a);
+        if (Trace::enabled && trace.proc(p)) trace.sink->on_assign(p, a.dst_slot, dst, v);
+        dst = std::move(v);
+        return false;
+      }
+
+      // Err: record the error text and leave the state through the error path
+      Value err = Value::s(error_text(rv.err));
+      Value& last = p.slots[p.def->last_error_slot];
+      if (Trace::enabled && trace.proc(p)) trace.sink->on_assign(p, p.def->last_error_slot, last, err);
+      last = std::move(err);
+      p.divert_state = a.unwrap_error_state_id;
+      if (p.divert_state == kNoSlot) throw std::runtime_error("unknown state: " + a.unwrap_error_state);
+      return true;
+    }
   }
 
   throw std::runtime_error("unhandled action kind");
 }
 
-static const IRState& get_state(const IRProcess& def, const std::string& name) {
-  auto it = def.states.find(name);
-  if (it == def.states.end()) throw std::runtime_error("unknown state: " + name);
-  return it->second;
+static uint32_t checked_state(const ProcessInstance& p, uint32_t id, const std::string& name) {
+  if (id >= p.state_table.size()) throw std::runtime_error("unknown state: " + name);
+  return id;
 }
 
-bool step_process_once(Runtime& rt, ProcessInstance& p, TraceSink* trace) {
+// Applies a state change and marks the process finished on a terminal state.
+static void enter_state(ProcessInstance& p, uint32_t next) {
+  p.state = next;
+  if (p.state_table[p.state]->terminal) p.status = ProcStatus::Finished;
+}
+
+template <class Trace>
+bool step_process(Runtime& rt, ProcessInstance& p, const Trace& trace) {
   if (p.status != ProcStatus::Running) return false;
 
-  const IRProcess& def = *p.def;
-  const IRState& st = get_state(def, p.state);
+  const IRState& st = *p.state_table[p.state];
 
-  if (trace) trace->on_process_step_begin(rt.tick, p.name, p.state);
+  if (Trace::enabled && trace.proc(p)) trace.sink->on_process_step_begin(rt.tick, p);
 
   // execute base actions
   for (auto& a : st.actions) {
     bool blocked = exec_action(rt, p, a, trace);
     if (blocked) {
-      if (trace) trace->on_process_step_end(rt.tick, p.name, p.state, p.status);
+      if (p.divert_state != kNoSlot) {
+        // ? failed: skip remaining actions and the transition
+        enter_state(p, p.divert_state);
+        p.divert_state = kNoSlot;
+      }
+      if (Trace::enabled && trace.proc(p)) trace.sink->on_process_step_end(rt.tick, p);
       return true; // action executed and blocked event emitted
     }
   }
 
   // transition evaluation + branch action lists
-  std::string next = p.state;
+  uint32_t next = p.state;
 
   if (st.transition.kind == IRTransition::Kind::Goto) {
-    next = st.transition.to_state;
+    next = checked_state(p, st.transition.to_id, st.transition.to_state);
   } else {
     Value c = eval_expr(rt, &p, st.transition.cond);
     bool cond = as_bool(c);
 
     auto& acts = cond ? st.transition.then_actions : st.transition.else_actions;
+    uint32_t target_id = cond ? st.transition.then_id : st.transition.else_id;
     auto& target = cond ? st.transition.then_state : st.transition.else_state;
 
     for (auto& a : acts) {
       bool blocked = exec_action(rt, p, a, trace);
+      if (blocked && p.divert_state != kNoSlot) {
+        enter_state(p, p.divert_state);
+        p.divert_state = kNoSlot;
+        if (Trace::enabled && trace.proc(p)) trace.sink->on_process_step_end(rt.tick, p);
+        return true;
+      }
       if (blocked) {
         // if blocked inside branch actions, do not transition this step
-        if (trace) trace->on_transition_skipped(rt.tick, p.name, "blocked_in_branch_actions");
-        if (trace) trace->on_process_step_end(rt.tick, p.name, p.state, p.status);
+        if (Trace::enabled && trace.proc(p)) trace.sink->on_transition_skipped(rt.tick, p, "blocked_in_branch_actions");
+        if (Trace::enabled && trace.proc(p)) trace.sink->on_process_step_end(rt.tick, p);
         return true;
       }
     }
 
-    next = target;
+    next = checked_state(p, target_id, target);
   }
 
-  // apply state change
-  p.state = next;
+  // apply state change (finished if terminal)
+  enter_state(p, next);
 
-  // if terminal, finished
-  const IRState& nextst = get_state(def, p.state);
-  if (nextst.terminal) p.status = ProcStatus::Finished;
-
-  if (trace) trace->on_process_step_end(rt.tick, p.name, p.state, p.status);
+  if (Trace::enabled && trace.proc(p)) trace.sink->on_process_step_end(rt.tick, p);
   return true;
 }
 
+bool step_process_once(Runtime& rt, ProcessInstance& p, TraceSink* trace) {
+  return trace ? step_process(rt, p, FullTrace{trace}) : step_process(rt, p, NoTrace{});
+}
+
+template bool exec_action(Runtime&, ProcessInstance&, const IRAction&, const NoTrace&);
+template bool exec_action(Runtime&, ProcessInstance&, const IRAction&, const FullTrace&);
+template bool exec_action(Runtime&, ProcessInstance&, const IRAction&, const FilteredTrace&);
+template bool step_process(Runtime&, ProcessInstance&, const NoTrace&);
+template bool step_process(Runtime&, ProcessInstance&, const FullTrace&);
+template bool step_process(Runtime&, ProcessInstance&, const FilteredTrace&);
+
 } // namespace caps
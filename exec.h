@@ -4,11 +4,20 @@
 
 namespace caps {
 
-// Executes one action. Returns true if the process blocked.
-bool exec_action(Runtime& rt, ProcessInstance& p, const IRAction& a, TraceSink* trace);
+// The step loop is templated on a trace policy (NoTrace, FullTrace or
+// FilteredTrace, see trace.h); exec.cpp instantiates all three.
+
+// Executes one action. Returns true if the step must stop here: the process
+// blocked, or a failed TryUnwrapAssign set p.divert_state.
+template <class Trace>
+bool exec_action(Runtime& rt, ProcessInstance& p, const IRAction& a, const Trace& trace);
 
 // Executes a single state "step": actions + transition (with branch action lists).
 // Returns true if progress happened (state changed or action executed non-trivially).
+template <class Trace>
+bool step_process(Runtime& rt, ProcessInstance& p, const Trace& trace);
+
+// step_process with FullTrace, or NoTrace if trace is null.
 bool step_process_once(Runtime& rt, ProcessInstance& p, TraceSink* trace);
 
 } // namespace caps
@@ -1,2 +1,142 @@
 #include "backend/ir.h"
-namespace caps {}
+#include <algorithm>
+
+namespace caps {
+
+static uint32_t add_slot(IRProcess& p, const std::string& n) {
+  auto it = p.slot_index.find(n);
+  if (it != p.slot_index.end()) return it->second;
+  uint32_t s = (uint32_t)p.slot_names.size();
+  p.slot_names.push_back(n);
+  p.slot_index.emplace(n, s);
+  return s;
+}
+
+static void collect_dsts(IRProcess& p, const std::vector<IRAction>& acts) {
+  for (auto& a : acts) {
+    if (!a.dst.empty()) add_slot(p, a.dst);
+  }
+}
+
+static void resolve_expr(const IRProcess& p, IRExpr& e) {
+  // unknown names stay kNoSlot; eval reports them as "unknown var" at runtime
+  if (e.kind == IRExpr::Kind::Var) e.slot = p.find_slot(e.name);
+  for (auto& a : e.args) resolve_expr(p, a);
+}
+
+static void resolve_actions(const IRProcess& p, std::vector<IRAction>& acts) {
+  for (auto& a : acts) {
+    a.dst_slot = a.dst.empty() ? kNoSlot : p.find_slot(a.dst);
+    resolve_expr(p, a.expr);
+  }
+}
+
+static void resolve_process(IRProcess& p) {
+  p.slot_names.clear();
+  p.slot_index.clear();
+
+  for (auto& n : p.local_names) add_slot(p, n);
+  p.output_slot_begin = (uint32_t)p.slot_names.size();
+  for (auto& n : p.output_names) add_slot(p, n);
+  p.output_slot_end = (uint32_t)p.slot_names.size();
+  p.last_error_slot = add_slot(p, "__last_error");
+
+  // destinations written by actions but never declared still need storage
+  for (auto& kv : p.states) {
+    auto& st = kv.second;
+    collect_dsts(p, st.actions);
+    collect_dsts(p, st.transition.then_actions);
+    collect_dsts(p, st.transition.else_actions);
+  }
+
+  for (auto& kv : p.states) {
+    auto& st = kv.second;
+    resolve_actions(p, st.actions);
+    resolve_actions(p, st.transition.then_actions);
+    resolve_actions(p, st.transition.else_actions);
+    resolve_expr(p, st.transition.cond);
+  }
+}
+
+void resolve_slots(IRGroup& g) {
+  for (auto& p : g.processes) resolve_process(p);
+}
+
+using IdMap = std::unordered_map<std::string, uint32_t>;
+
+static uint32_t find_id(const IdMap& m, const std::string& n) {
+  auto it = m.find(n);
+  return it == m.end() ? kNoSlot : it->second;
+}
+
+static void link_expr(const IdMap& chans, IRExpr& e) {
+  if (e.kind == IRExpr::Kind::LenChannel) e.chan_id = find_id(chans, e.name);
+  if (e.kind == IRExpr::Kind::Call && e.func_name == "len" && e.args.size() == 1)
+    e.chan_id = find_id(chans, e.args[0].name);
+  for (auto& a : e.args) link_expr(chans, a);
+}
+
+struct LinkCtx {
+  const std::vector<IRChannelDecl>& decls;
+  IdMap chans;
+};
+
+static void link_actions(const LinkCtx& cx, IRProcess& p, const IdMap& states, std::vector<IRAction>& acts) {
+  for (auto& a : acts) {
+    a.chan_id = a.chan.empty() ? kNoSlot : find_id(cx.chans, a.chan);
+    if (a.kind == IRAction::Kind::TryUnwrapAssign) a.unwrap_error_state_id = find_id(states, a.unwrap_error_state);
+
+    // receiving end of an unbuffered channel: dedicated mailbox slot per channel
+    bool recv = a.kind == IRAction::Kind::Receive || a.kind == IRAction::Kind::TryReceive;
+    if (recv && a.chan_id != kNoSlot && cx.decls[a.chan_id].capacity == 0)
+      a.mailbox_slot = add_slot(p, a.chan + ".__recv_value");
+
+    link_expr(cx.chans, a.expr);
+  }
+}
+
+static void link_process(const LinkCtx& cx, IRProcess& p) {
+  // stable numbering: initial first, then others lexicographically
+  p.state_names.clear();
+  if (p.states.count(p.initial_state)) p.state_names.push_back(p.initial_state);
+  std::vector<std::string> rest;
+  for (auto& kv : p.states) {
+    if (kv.first != p.initial_state) rest.push_back(kv.first);
+  }
+  std::sort(rest.begin(), rest.end());
+  p.state_names.insert(p.state_names.end(), rest.begin(), rest.end());
+
+  IdMap states;
+  for (uint32_t i = 0; i < p.state_names.size(); i++) states[p.state_names[i]] = i;
+  p.initial_state_id = find_id(states, p.initial_state);
+
+  for (auto& kv : p.states) {
+    auto& st = kv.second;
+    st.id = states.at(kv.first);
+    link_actions(cx, p, states, st.actions);
+    link_actions(cx, p, states, st.transition.then_actions);
+    link_actions(cx, p, states, st.transition.else_actions);
+    link_expr(cx.chans, st.transition.cond);
+    st.transition.to_id = find_id(states, st.transition.to_state);
+    st.transition.then_id = find_id(states, st.transition.then_state);
+    st.transition.else_id = find_id(states, st.transition.else_state);
+  }
+}
+
+void link_group(IRGroup& g) {
+  resolve_slots(g);
+
+  LinkCtx cx{g.channels, {}};
+  IdMap procs;
+  for (uint32_t i = 0; i < g.channels.size(); i++) cx.chans[g.channels[i].name] = i;
+  for (uint32_t i = 0; i < g.processes.size(); i++) procs[g.processes[i].name] = i;
+
+  for (auto& p : g.processes) link_process(cx, p);
+
+  g.schedule.step_ids.clear();
+  for (auto& s : g.schedule.steps) g.schedule.step_ids.push_back(find_id(procs, s));
+
+  g.linked = true;
+}
+
+} // namespace caps
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -6,6 +7,9 @@
 
 namespace caps {
 
+// Sentinel for "not yet resolved" slot/id indices (see resolve_slots, link_group).
+constexpr uint32_t kNoSlot = UINT32_MAX;
+
 enum class IRTypeKind { Int, Bool, Real, Text, Record, Array, Tuple, ResultAny };
 
 struct IRType {
@@ -21,10 +25,14 @@ struct IRExpr {
     Field,      // expr.field
     Index,      // expr[index]
     LenChannel, // len(channelName)
+    Call,       // func_name(args...), currently only len(channel)
   } kind;
 
   std::string op;         // for BinOp
   std::string name;       // for Var / LenChannel
+  uint32_t slot = kNoSlot; // for Var: resolved dense slot in the owning process
+  uint32_t chan_id = kNoSlot; // for LenChannel / len(): resolved channel index
+  std::string func_name;  // for Call
   std::string field;      // for Field
   int64_t lit_i = 0;
   bool lit_b = false;
@@ -45,13 +53,20 @@ struct IRAction {
     Receive,
     TrySend,
     TryReceive,
+    TryUnwrapAssign, // dst = expr? : Ok payload into dst; Err writes __last_error and diverts to unwrap_error_state
     // Optional: Assert, etc.
-    // Note: ? is not an action; it is desugared into transitions into __Error + __last_error handling.
   } kind;
 
   std::string dst; // Assign/Receive/Try* result var
+  uint32_t dst_slot = kNoSlot; // resolved slot for dst
   IRExpr expr;     // Assign or Send expr or TrySend expr
   std::string chan; // Send/Receive channel name
+  uint32_t chan_id = kNoSlot; // resolved index into IRGroup::channels
+  uint32_t mailbox_slot = kNoSlot; // Receive/TryReceive on an unbuffered channel (see link_group)
+
+  // TryUnwrapAssign
+  std::string unwrap_error_state = "__Error";
+  uint32_t unwrap_error_state_id = kNoSlot;
 };
 
 struct IRTransition {
@@ -69,10 +84,16 @@ struct IRTransition {
 
   // Goto
   std::string to_state;
+
+  // resolved state ids (see IRProcess::state_names)
+  uint32_t then_id = kNoSlot;
+  uint32_t else_id = kNoSlot;
+  uint32_t to_id = kNoSlot;
 };
 
 struct IRState {
   std::string name;
+  uint32_t id = kNoSlot; // index into IRProcess::state_names
   bool terminal = false;
   std::vector<IRAction> actions;
   IRTransition transition;
@@ -91,6 +112,24 @@ struct IRProcess {
 
   // special error state name for ? desugaring
   // convention: "__Error" exists if process uses ? and has error path
+
+  // Dense slot layout filled by resolve_slots(): local_names, then output_names,
+  // then __last_error and any action destination not declared above.
+  // The interpreter addresses variables by slot; names are kept for tracing/debugging.
+  std::vector<std::string> slot_names;
+  std::unordered_map<std::string, uint32_t> slot_index;
+  uint32_t output_slot_begin = 0;
+  uint32_t output_slot_end = 0;
+  uint32_t last_error_slot = kNoSlot; // "__last_error"
+
+  // State ids filled by link_group(): initial state first, then the rest by name.
+  std::vector<std::string> state_names;
+  uint32_t initial_state_id = kNoSlot;
+
+  uint32_t find_slot(const std::string& n) const {
+    auto it = slot_index.find(n);
+    return it == slot_index.end() ? kNoSlot : it->second;
+  }
 };
 
 struct IRChannelDecl {
@@ -101,6 +140,7 @@ struct IRChannelDecl {
 
 struct IRSchedule {
   std::vector<std::string> steps; // process names
+  std::vector<uint32_t> step_ids;  // resolved indices into IRGroup::processes
   bool repeat = true;
 };
 
@@ -110,10 +150,23 @@ struct IRGroup {
   std::vector<IRChannelDecl> channels;
   std::vector<IRProcess> processes;
   IRSchedule schedule;
+
+  bool linked = false; // set by link_group()
 };
 
 struct IRProgram {
   std::vector<IRGroup> groups;
 };
 
+// Assigns every local/output of each process a dense slot index and writes the
+// resolved index into IRExpr::slot / IRAction::dst_slot. Must run before init_runtime.
+// Idempotent: re-running on a resolved group recomputes the same layout.
+void resolve_slots(IRGroup& g);
+
+// Link step: resolves slots, then numbers channels, processes and states so the
+// interpreter's hot loop indexes vectors instead of hashing or copying names.
+// Channels/processes are numbered by declaration order. Unknown references are
+// left as kNoSlot and reported when executed, as the name-based runtime did.
+void link_group(IRGroup& g);
+
 } // namespace caps
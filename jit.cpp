@@ -0,0 +1,528 @@
+#include "backend/jit.h"
+#include "backend/eval.h"
+#include "backend/exec.h"
+#include "backend/x64_encoder.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CAPS_JIT_X64 1
+#else
+#define CAPS_JIT_X64 0
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace caps {
+
+// Native state functions return the next state id, or one of these.
+static constexpr uint32_t kStop = UINT32_MAX;          // blocked, or a failed ? set divert_state
+static constexpr uint32_t kFail = UINT32_MAX - 1;      // a callback threw; see Frame::error
+static constexpr uint32_t kDivZero = UINT32_MAX - 2;
+static constexpr uint32_t kNotInt = UINT32_MAX - 3;
+static constexpr uint32_t kNotBool = UINT32_MAX - 4;
+static constexpr uint32_t kNotRecord = UINT32_MAX - 5; // Field of a non-Result
+static constexpr uint32_t kFirstCode = kNotRecord;
+
+namespace {
+
+// Passed to every state function; callbacks must not let exceptions unwind
+// through JIT frames, so they park them here.
+struct Frame {
+  Runtime* rt;
+  ProcessInstance* p;
+  std::exception_ptr error;
+};
+
+} // namespace
+
+static uint32_t jit_action(Frame* f, const IRAction* a) noexcept {
+  try {
+    return exec_action(*f->rt, *f->p, *a, NoTrace{}) ? kStop : 0;
+  } catch (...) {
+    f->error = std::current_exception();
+    return kFail;
+  }
+}
+
+static uint32_t jit_cond(Frame* f, const IRExpr* e) noexcept {
+  try {
+    return as_bool(eval_expr(*f->rt, f->p, *e)) ? 1 : 0;
+  } catch (...) {
+    f->error = std::current_exception();
+    return kFail;
+  }
+}
+
+bool jit_supported() { return CAPS_JIT_X64 != 0; }
+
+#if CAPS_JIT_X64
+
+using namespace x64;
+
+static_assert(offsetof(Value, tag) == 0 && offsetof(Value, sub) == 1 && offsetof(Value, boxed_) == 2 &&
+                  offsetof(Value, err) == 4 && offsetof(Value, u) == 8 && sizeof(ValueTag) == 1,
+              "JIT code addresses Value fields directly");
+
+#ifdef _WIN32
+static constexpr Reg kArg0 = RCX, kArg1 = RDX;
+#else
+static constexpr Reg kArg0 = RDI, kArg1 = RSI;
+#endif
+
+// Static type of an expression for native code: Var is Dyn (its tag is
+// checked where it is used), Payload a Result .value.
+enum class Ty : uint8_t { Int, Bool, Dyn, Payload, No };
+
+static ValueTag tag_of(Ty t) { return t == Ty::Int ? ValueTag::Int : ValueTag::Bool; }
+
+static int32_t slot_off(uint32_t slot) { return (int32_t)(slot * sizeof(Value)); }
+
+// A BinOp's left operand waits in a frame slot while the right one is
+// evaluated (never pushed: error exits leave from any depth). Slots sit above
+// the 32 bytes of Win64 shadow space in the 0x58-byte frame.
+static constexpr uint32_t kSpillSlots = 7;
+static int32_t spill_off(uint32_t depth) { return (int32_t)(0x20 + 8 * depth); }
+
+static uint32_t spill_depth(const IRExpr& e) {
+  if (e.kind != IRExpr::Kind::BinOp || e.args.size() != 2) return 0;
+  return std::max(spill_depth(e.args[0]), 1 + spill_depth(e.args[1]));
+}
+
+namespace {
+
+struct Typer {
+  // per slot: only ever written by try_send / try_receive, so it is unset or
+  // holds a Result (never a record a Field could also name)
+  const std::vector<bool>& results;
+
+  bool slot_ok(uint32_t s) const { return s < results.size(); }
+
+  bool result_var(const IRExpr& e) const {
+    return e.kind == IRExpr::Kind::Var && slot_ok(e.slot) && results[e.slot];
+  }
+
+  Ty type(const IRExpr& e) const {
+    using K = IRExpr::Kind;
+    switch (e.kind) {
+      case K::LitInt: return Ty::Int;
+      case K::LitBool: return Ty::Bool;
+      case K::Var: return slot_ok(e.slot) ? Ty::Dyn : Ty::No;
+      case K::Field:
+        if (e.args.size() != 1 || !result_var(e.args[0])) return Ty::No;
+        return e.field == "ok" ? Ty::Bool : e.field == "value" ? Ty::Payload : Ty::No;
+      case K::BinOp: {
+        if (e.args.size() != 2 || spill_depth(e) > kSpillSlots) return Ty::No;
+        const std::string& op = e.op;
+        if (op == "+" || op == "-" || op == "*" || op == "/")
+          return fits(e.args[0], Ty::Int) && fits(e.args[1], Ty::Int) ? Ty::Int : Ty::No;
+        if (op == "<" || op == "<=" || op == ">" || op == ">=")
+          return fits(e.args[0], Ty::Int) && fits(e.args[1], Ty::Int) ? Ty::Bool : Ty::No;
+        if (op == "&&" || op == "||")
+          return fits(e.args[0], Ty::Bool) && fits(e.args[1], Ty::Bool) ? Ty::Bool : Ty::No;
+        if (op == "==" || op == "!=") return eq_type(e) != Ty::No ? Ty::Bool : Ty::No;
+        return Ty::No;
+      }
+      default: return Ty::No;
+    }
+  }
+
+  // e can be evaluated as a `want` (Int or Bool), with a runtime tag check
+  // for Var and Payload
+  bool fits(const IRExpr& e, Ty want) const {
+    Ty t = type(e);
+    return t == want || t == Ty::Dyn || t == Ty::Payload;
+  }
+
+  // Operand type of == / !=: both sides typed alike, or a Var against a
+  // typed side (a Var of another tag compares unequal, as in eval_binop).
+  Ty eq_type(const IRExpr& e) const {
+    Ty a = type(e.args[0]), b = type(e.args[1]);
+    if ((a == Ty::Int || a == Ty::Bool) && (b == a || b == Ty::Dyn)) return a;
+    if (a == Ty::Dyn && (b == Ty::Int || b == Ty::Bool)) return b;
+    return Ty::No;
+  }
+};
+
+struct StateCompiler : Typer {
+  Encoder& enc;
+  uint32_t exit = 0, not_int = 0, not_bool = 0, not_record = 0, div_zero = 0;
+  uint32_t depth = 0; // spill slots in use
+
+  void error_exit(uint32_t label, uint32_t code) {
+    enc.bind(label);
+    enc.mov_r32_imm32(RAX, code);
+    enc.jmp(exit);
+  }
+
+  void load_checked(uint32_t slot, Ty want) {
+    enc.cmp_m8_imm8(R13, slot_off(slot), (uint8_t)tag_of(want));
+    enc.jcc(NE, want == Ty::Int ? not_int : not_bool);
+    if (want == Ty::Int) enc.mov_r64_m64(RAX, R13, slot_off(slot) + 8);
+    else enc.movzx_r32_m8(RAX, R13, slot_off(slot) + 8);
+  }
+
+  // a BinOp's operands into rax (left) and rcx (right), left evaluated first
+  void operands(const IRExpr& e, Ty want) {
+    gen(e.args[0], want);
+    int32_t spill = spill_off(depth++);
+    enc.mov_m64_r64(RSP, spill, RAX);
+    gen(e.args[1], want);
+    depth--;
+    enc.mov_r64_r64(RCX, RAX);
+    enc.mov_r64_m64(RAX, RSP, spill);
+  }
+
+  void set_bool(uint8_t cc) {
+    enc.setcc_r8(cc, RAX);
+    enc.movzx_r32_r8(RAX, RAX);
+  }
+
+  // e (type() != No) as `want` into rax
+  void gen(const IRExpr& e, Ty want) {
+    using K = IRExpr::Kind;
+    switch (e.kind) {
+      case K::LitInt:
+        if (e.lit_i >= INT32_MIN && e.lit_i <= INT32_MAX) enc.mov_r64_imm32(RAX, (int32_t)e.lit_i);
+        else enc.mov_r64_imm64(RAX, (uint64_t)e.lit_i);
+        return;
+      case K::LitBool: enc.mov_r32_imm32(RAX, e.lit_b ? 1 : 0); return;
+      case K::Var: load_checked(e.slot, want); return;
+      case K::Field: {
+        uint32_t s = e.args[0].slot;
+        enc.cmp_m8_imm8(R13, slot_off(s), (uint8_t)ValueTag::Result);
+        enc.jcc(NE, not_record);
+        if (e.field == "ok") {
+          enc.cmp_m32_imm8(R13, slot_off(s) + 4, (int8_t)kErrNone);
+          set_bool(E);
+          return;
+        }
+        enc.cmp_m8_imm8(R13, slot_off(s) + 1, (uint8_t)tag_of(want)); // payload kind
+        enc.jcc(NE, want == Ty::Int ? not_int : not_bool);
+        if (want == Ty::Int) enc.mov_r64_m64(RAX, R13, slot_off(s) + 8);
+        else enc.movzx_r32_m8(RAX, R13, slot_off(s) + 8);
+        return;
+      }
+      case K::BinOp: break;
+      default: throw std::logic_error("jit: expression not compilable");
+    }
+
+    const std::string& op = e.op;
+    if (op == "==" || op == "!=") {
+      Ty t = eq_type(e);
+      const IRExpr* dyn = type(e.args[0]) == Ty::Dyn ? &e.args[0] : type(e.args[1]) == Ty::Dyn ? &e.args[1] : nullptr;
+      if (!dyn) {
+        operands(e, t);
+        enc.cmp_r64_r64(RAX, RCX);
+        set_bool(op == "==" ? E : NE);
+        return;
+      }
+      uint32_t differ = enc.new_label(), done = enc.new_label();
+      gen(dyn == &e.args[0] ? e.args[1] : e.args[0], t);
+      enc.mov_r64_r64(RCX, RAX);
+      enc.cmp_m8_imm8(R13, slot_off(dyn->slot), (uint8_t)tag_of(t));
+      enc.jcc(NE, differ);
+      enc.cmp_m64_r64(R13, slot_off(dyn->slot) + 8, RCX);
+      set_bool(op == "==" ? E : NE);
+      enc.jmp(done);
+      enc.bind(differ);
+      enc.mov_r32_imm32(RAX, op == "!=" ? 1 : 0);
+      enc.bind(done);
+      return;
+    }
+
+    bool logic = op == "&&" || op == "||";
+    Ty right = type(e.args[1]);
+    if (logic && right != Ty::Bool) {
+      // eval_binop evaluates both sides but skips as_bool on the right one
+      // when the left one decides: so does the Var or Payload tag check
+      uint32_t done = enc.new_label();
+      gen(e.args[0], Ty::Bool);
+      if (right == Ty::Payload) {
+        enc.cmp_m8_imm8(R13, slot_off(e.args[1].args[0].slot), (uint8_t)ValueTag::Result);
+        enc.jcc(NE, not_record);
+      }
+      enc.test_r32_r32(RAX, RAX);
+      enc.jcc(op == "&&" ? E : NE, done);
+      gen(e.args[1], Ty::Bool);
+      enc.bind(done);
+      return;
+    }
+    operands(e, logic ? Ty::Bool : Ty::Int);
+    if (op == "+") enc.add_r64_r64(RAX, RCX);
+    else if (op == "-") enc.sub_r64_r64(RAX, RCX);
+    else if (op == "*") enc.imul_r64_r64(RAX, RCX);
+    else if (op == "/") {
+      enc.test_r64_r64(RCX, RCX);
+      enc.jcc(E, div_zero);
+      enc.cqo();
+      enc.idiv_r64(RCX);
+    } else if (op == "&&") enc.and_r64_r64(RAX, RCX);
+    else if (op == "||") enc.or_r64_r64(RAX, RCX);
+    else {
+      enc.cmp_r64_r64(RAX, RCX);
+      set_bool(op == "<" ? L : op == "<=" ? LE : op == ">" ? G : GE);
+    }
+  }
+
+  void call(const void* fn, const void* arg) {
+    enc.mov_r64_r64(kArg0, R12);
+    enc.mov_r64_imm64(kArg1, (uint64_t)(uintptr_t)arg);
+    enc.mov_r64_imm64(RAX, (uint64_t)(uintptr_t)fn);
+    enc.call_r64(RAX);
+  }
+
+  // exec_action(a); leaves the function unless it returned 0
+  void call_action(const IRAction& a) {
+    call((const void*)&jit_action, &a);
+    enc.test_r32_r32(RAX, RAX);
+    enc.jcc(NE, exit);
+  }
+
+  void action(const IRAction& a) {
+    if (a.kind != IRAction::Kind::Assign || !slot_ok(a.dst_slot)) return call_action(a);
+    Ty t = type(a.expr);
+    bool copy = t == Ty::Dyn;
+    if (!copy && t != Ty::Int && t != Ty::Bool) return call_action(a);
+
+    // scalars are bit copies; a boxed value in either slot takes the
+    // interpreter's path, which does the refcounting
+    uint32_t slow = enc.new_label(), done = enc.new_label();
+    int32_t dst = slot_off(a.dst_slot);
+    if (copy) {
+      int32_t src = slot_off(a.expr.slot);
+      enc.cmp_m8_imm8(R13, src + 2, 0);
+      enc.jcc(NE, slow);
+      enc.cmp_m8_imm8(R13, dst + 2, 0);
+      enc.jcc(NE, slow);
+      enc.mov_r64_m64(RAX, R13, src);
+      enc.mov_r64_m64(RCX, R13, src + 8);
+      enc.mov_m64_r64(R13, dst, RAX);
+      enc.mov_m64_r64(R13, dst + 8, RCX);
+    } else {
+      gen(a.expr, t);
+      enc.cmp_m8_imm8(R13, dst + 2, 0);
+      enc.jcc(NE, slow);
+      enc.mov_m64_imm32(R13, dst, (int32_t)tag_of(t)); // tag, sub, flags and err in one store
+      enc.mov_m64_r64(R13, dst + 8, RAX);
+    }
+    enc.jmp(done);
+    enc.bind(slow);
+    call_action(a);
+    enc.bind(done);
+  }
+
+  void actions(const std::vector<IRAction>& acts) {
+    for (auto& a : acts) action(a);
+  }
+
+  void go(uint32_t state) {
+    enc.mov_r32_imm32(RAX, state);
+    enc.jmp(exit);
+  }
+
+  // Mirrors step_process after its status check.
+  void state(const IRState& st) {
+    exit = enc.new_label();
+    not_int = enc.new_label();
+    not_bool = enc.new_label();
+    not_record = enc.new_label();
+    div_zero = enc.new_label();
+
+    // same frame as x64_codegen's locked prolog; rsp stays 16-byte aligned
+    // for calls and leaves the Win64 shadow space
+    enc.push_r64(R12);
+    enc.push_r64(R13);
+    enc.sub_rsp_imm8(0x58);
+    enc.mov_r64_r64(R12, kArg0);
+    enc.mov_r64_r64(R13, kArg1);
+
+    actions(st.actions);
+    const IRTransition& tr = st.transition;
+    if (tr.kind == IRTransition::Kind::Goto) {
+      go(tr.to_id);
+    } else {
+      uint32_t other = enc.new_label();
+      if (fits(tr.cond, Ty::Bool)) {
+        gen(tr.cond, Ty::Bool);
+      } else {
+        call((const void*)&jit_cond, &tr.cond);
+        enc.cmp_r32_imm8(RAX, 1);
+        enc.jcc(A, exit);
+      }
+      enc.test_r32_r32(RAX, RAX);
+      enc.jcc(E, other);
+      actions(tr.then_actions);
+      go(tr.then_id);
+      enc.bind(other);
+      actions(tr.else_actions);
+      go(tr.else_id);
+    }
+
+    error_exit(not_int, kNotInt);
+    error_exit(not_bool, kNotBool);
+    error_exit(not_record, kNotRecord);
+    error_exit(div_zero, kDivZero);
+
+    enc.bind(exit);
+    enc.add_rsp_imm8(0x58);
+    enc.pop_r64(R13);
+    enc.pop_r64(R12);
+    enc.ret();
+  }
+};
+
+} // namespace
+
+static std::vector<bool> result_slots(const IRProcess& p) {
+  std::vector<uint8_t> tried(p.slot_names.size()), other(p.slot_names.size());
+  auto scan = [&](const std::vector<IRAction>& acts) {
+    for (auto& a : acts) {
+      if (a.mailbox_slot < other.size()) other[a.mailbox_slot] = 1;
+      if (a.dst_slot >= tried.size()) continue;
+      bool try_op = a.kind == IRAction::Kind::TrySend || a.kind == IRAction::Kind::TryReceive;
+      (try_op ? tried : other)[a.dst_slot] = 1;
+    }
+  };
+  for (auto& kv : p.states) {
+    scan(kv.second.actions);
+    scan(kv.second.transition.then_actions);
+    scan(kv.second.transition.else_actions);
+  }
+  std::vector<bool> results(tried.size());
+  for (size_t s = 0; s < results.size(); s++) results[s] = tried[s] && !other[s] && s != p.last_error_slot;
+  return results;
+}
+
+static bool targets_ok(const IRProcess& p, const IRState& st) {
+  size_t n = p.state_names.size();
+  auto& tr = st.transition;
+  if (tr.kind == IRTransition::Kind::Goto) return tr.to_id < n;
+  return tr.then_id < n && tr.else_id < n;
+}
+
+JitGroup::JitGroup(const IRGroup& g) {
+  if (!g.linked) throw std::runtime_error("group not linked (call link_group): " + g.name);
+  fns_.resize(g.processes.size());
+  Encoder enc;
+  std::vector<std::vector<uint32_t>> entry(g.processes.size()); // code offsets, UINT32_MAX: none
+
+  for (size_t pi = 0; pi < g.processes.size(); pi++) {
+    const IRProcess& p = g.processes[pi];
+    fns_[pi].assign(p.state_names.size(), nullptr);
+    entry[pi].assign(p.state_names.size(), UINT32_MAX);
+    total_ += p.states.size();
+    std::vector<bool> results = result_slots(p);
+    for (auto& kv : p.states) {
+      const IRState& st = kv.second;
+      if (st.id >= p.state_names.size() || !targets_ok(p, st)) continue;
+      entry[pi][st.id] = (uint32_t)enc.code.size();
+      StateCompiler{{results}, enc}.state(st);
+    }
+  }
+  if (!enc.patch_fixups()) throw std::logic_error("jit: unbound label");
+
+  // W^X: written while read/write, then made read/execute
+#ifdef _WIN32
+  void* mem = VirtualAlloc(nullptr, enc.code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  DWORD old = 0;
+  if (mem) {
+    std::memcpy(mem, enc.code.data(), enc.code.size());
+    if (!VirtualProtect(mem, enc.code.size(), PAGE_EXECUTE_READ, &old)) {
+      VirtualFree(mem, 0, MEM_RELEASE);
+      mem = nullptr;
+    } else {
+      FlushInstructionCache(GetCurrentProcess(), mem, enc.code.size());
+    }
+  }
+#else
+  void* mem = enc.code.empty() ? MAP_FAILED
+                               : mmap(nullptr, enc.code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem != MAP_FAILED) {
+    std::memcpy(mem, enc.code.data(), enc.code.size());
+    if (mprotect(mem, enc.code.size(), PROT_READ | PROT_EXEC) != 0) {
+      munmap(mem, enc.code.size());
+      mem = MAP_FAILED;
+    }
+  }
+  if (mem == MAP_FAILED) mem = nullptr;
+#endif
+  if (!mem) return; // no executable memory: everything stays interpreted
+
+  code_ = mem;
+  code_size_ = enc.code.size();
+  for (size_t pi = 0; pi < entry.size(); pi++) {
+    for (size_t s = 0; s < entry[pi].size(); s++) {
+      if (entry[pi][s] == UINT32_MAX) continue;
+      fns_[pi][s] = (StateFn)((uint8_t*)code_ + entry[pi][s]);
+      compiled_++;
+    }
+  }
+}
+
+JitGroup::~JitGroup() {
+  if (!code_) return;
+#ifdef _WIN32
+  VirtualFree(code_, 0, MEM_RELEASE);
+#else
+  munmap(code_, code_size_);
+#endif
+}
+
+#else // !CAPS_JIT_X64
+
+JitGroup::JitGroup(const IRGroup& g) {
+  if (!g.linked) throw std::runtime_error("group not linked (call link_group): " + g.name);
+  fns_.resize(g.processes.size());
+  for (size_t pi = 0; pi < g.processes.size(); pi++) {
+    fns_[pi].assign(g.processes[pi].state_names.size(), nullptr);
+    total_ += g.processes[pi].states.size();
+  }
+}
+
+JitGroup::~JitGroup() = default;
+
+#endif
+
+// as enter_state in exec.cpp
+static void enter(ProcessInstance& p, uint32_t next) {
+  p.state = next;
+  if (p.state_table[p.state]->terminal) p.status = ProcStatus::Finished;
+}
+
+bool JitGroup::step(Runtime& rt, ProcessInstance& p) const {
+  if (p.status != ProcStatus::Running) return false;
+  StateFn fn = p.id < fns_.size() && p.state < fns_[p.id].size() ? fns_[p.id][p.state] : nullptr;
+  if (!fn) return step_process(rt, p, NoTrace{});
+
+  Frame f{&rt, &p, nullptr};
+  uint32_t r = fn(&f, p.slots.data());
+  if (r < kFirstCode) {
+    enter(p, r);
+    return true;
+  }
+  switch (r) {
+    case kStop:
+      if (p.divert_state != kNoSlot) {
+        enter(p, p.divert_state);
+        p.divert_state = kNoSlot;
+      }
+      return true;
+    case kFail: std::rethrow_exception(f.error);
+    case kDivZero: throw std::runtime_error("division by zero");
+    case kNotInt: value_type_error("expected int");
+    case kNotBool: value_type_error("expected bool");
+    case kNotRecord: throw std::runtime_error("expected record");
+  }
+  throw std::logic_error("jit: bad return code");
+}
+
+} // namespace caps
@@ -0,0 +1,47 @@
+#pragma once
+#include "backend/runtime.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace caps {
+
+// In-process x86-64 JIT for the states of a linked IRGroup. Each state that
+// can be compiled becomes a native function: int and bool assignments,
+// arithmetic, comparisons, Result .ok/.value reads and the transition run as
+// machine code on the process's slots; channel ops and anything else call
+// back into exec_action / eval_expr. States it cannot compile, and every
+// state on hosts other than x86-64, run in the interpreter.
+//
+// Set Runtime::jit to use it: untraced steps of run_group (all scheduler
+// modes) then go through step() instead of step_process. Results, final
+// state and error messages are those of the interpreter. The group must
+// outlive the JitGroup, which keeps pointers to its actions.
+class JitGroup {
+public:
+  explicit JitGroup(const IRGroup& g); // g linked
+  ~JitGroup();
+
+  JitGroup(const JitGroup&) = delete;
+  JitGroup& operator=(const JitGroup&) = delete;
+
+  // step_process(rt, p, NoTrace{}), natively where p's state is compiled
+  bool step(Runtime& rt, ProcessInstance& p) const;
+
+  size_t compiled_states() const { return compiled_; }
+  size_t total_states() const { return total_; }
+
+private:
+  using StateFn = uint32_t (*)(void* frame, Value* slots);
+
+  std::vector<std::vector<StateFn>> fns_; // [process][state id], null: interpreter
+  void* code_ = nullptr;                  // executable pages
+  size_t code_size_ = 0;
+  size_t compiled_ = 0;
+  size_t total_ = 0;
+};
+
+// True on hosts where JitGroup emits native code.
+bool jit_supported();
+
+} // namespace caps
@@ -0,0 +1,102 @@
+#include "backend/lz.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace caps {
+
+static constexpr unsigned kHashBits = 14;
+static constexpr size_t kMinMatch = 4;
+static constexpr size_t kMaxOffset = 0xFFFF;
+// The last bytes are always literals, so a stream ends in a literal-only
+// sequence and matching never reads past the input.
+static constexpr size_t kTailLiterals = 5;
+
+static uint32_t load32(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+static void put_length(std::vector<uint8_t>& out, size_t extra) {
+  for (; extra >= 255; extra -= 255) out.push_back(255);
+  out.push_back((uint8_t)extra);
+}
+
+static void put_literals(std::vector<uint8_t>& out, const uint8_t* lit, size_t nlit, size_t mlen, bool match) {
+  size_t m = match ? mlen - kMinMatch : 0;
+  out.push_back((uint8_t)((nlit < 15 ? nlit : 15) << 4 | (m < 15 ? m : 15)));
+  if (nlit >= 15) put_length(out, nlit - 15);
+  out.insert(out.end(), lit, lit + nlit);
+}
+
+void lz_compress(const uint8_t* src, size_t n, std::vector<uint8_t>& out) {
+  out.clear();
+  out.reserve(n / 2 + 16);
+  std::vector<uint32_t> table((size_t)1 << kHashBits, 0);
+
+  size_t i = 0, lit = 0;
+  if (n > kTailLiterals + kMinMatch) {
+    size_t limit = n - kTailLiterals - kMinMatch;
+    while (i < limit) {
+      uint32_t seq = load32(src + i);
+      uint32_t h = (seq * 2654435761u) >> (32 - kHashBits);
+      size_t cand = table[h];
+      table[h] = (uint32_t)i;
+      if (cand >= i || i - cand > kMaxOffset || load32(src + cand) != seq) {
+        i++;
+        continue;
+      }
+      size_t len = kMinMatch;
+      while (i + len < n - kTailLiterals && src[cand + len] == src[i + len]) len++;
+
+      put_literals(out, src + lit, i - lit, len, true);
+      size_t off = i - cand;
+      out.push_back((uint8_t)off);
+      out.push_back((uint8_t)(off >> 8));
+      if (len - kMinMatch >= 15) put_length(out, len - kMinMatch - 15);
+      i += len;
+      lit = i;
+    }
+  }
+  put_literals(out, src + lit, n - lit, 0, false);
+}
+
+void lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t raw) {
+  const uint8_t* p = src;
+  const uint8_t* end = src + n;
+  size_t o = 0;
+  auto bad = [] { throw std::runtime_error("lz: corrupt input"); };
+  auto length = [&](size_t base) {
+    if (base != 15) return base;
+    uint8_t b;
+    do {
+      if (p == end) bad();
+      b = *p++;
+      base += b;
+    } while (b == 255);
+    return base;
+  };
+
+  while (p < end) {
+    uint8_t tok = *p++;
+    size_t nlit = length(tok >> 4);
+    if (nlit > (size_t)(end - p) || nlit > raw - o) bad();
+    std::memcpy(dst + o, p, nlit);
+    p += nlit;
+    o += nlit;
+    if (p == end) break;
+
+    if (end - p < 2) bad();
+    size_t off = p[0] | (size_t)p[1] << 8;
+    p += 2;
+    if (off == 0 || off > o) bad();
+    size_t len = length(tok & 15) + kMinMatch;
+    if (len > raw - o) bad();
+    // byte by byte: a match may overlap the bytes it produces
+    for (size_t k = 0; k < len; k++) dst[o + k] = dst[o - off + k];
+    o += len;
+  }
+  if (o != raw) bad();
+}
+
+} // namespace caps
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace caps {
+
+// Small LZ77 block codec (LZ4-style sequences: token, literals, u16 offset,
+// match) for trace chunks. Favors speed over ratio; trace records compress
+// well because ids, tags and sequence numbers repeat from tick to tick.
+
+// Replaces out with the compressed form of src[0, n). n must be < 4 GiB.
+void lz_compress(const uint8_t* src, size_t n, std::vector<uint8_t>& out);
+
+// Decompresses src[0, n) into exactly raw bytes at dst. Throws
+// std::runtime_error if the input is corrupt or does not decode to raw bytes.
+void lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t raw);
+
+} // namespace caps
@@ -30,6 +30,7 @@
 #include "ir/typed_lowering.h"
 #include "x64/x64_codegen.h"
 #include "aot/aot_codegen.h"
+#include "aot/aot_toolchain.h"
 #include "pretty/pretty.h"
 #include "pretty/ast_dump.h"
 #include "analysis/pipeline.h"
@@ -49,7 +50,13 @@ struct Options {
   std::string input_file;
   std::string output_ir_file;
   std::string emit_cpp_dir;
+  unsigned aot_threads = 0; // 0 = sequential main
+  bool aot_fused = false;
   bool compile = false;
+  std::string aot_cache_dir = ".caps-cache";
+  unsigned aot_jobs = 0; // 0 = one per hardware thread
+  bool aot_profile_generate = false;
+  std::string aot_profile_use_dir;
   std::string emit_obj_file;
   std::string emit_asm_file;
   std::string target_arch = "x86_64";  // Default target architecture
@@ -58,7 +65,7 @@ struct Options {
 
 static void print_usage() {
   std::cerr <<
-    "usage: caps_frontend [--dump-ast] [--dump-topology=dot|text] [--check-only] [--output-ir=<file>] [--emit-cpp=<dir>] [--compile] [--emit-asm=<file>] [--emit-obj=<file>] [--target-arch=<arch>] <file.caps>\n"
+    "usage: caps_frontend [--dump-ast] [--dump-topology=dot|text] [--check-only] [--output-ir=<file>] [--emit-cpp=<dir>] [--aot-threads=N] [--aot-fused] [--compile] [--aot-cache=<dir>] [--aot-jobs=N] [--aot-profile-generate] [--aot-profile-use=<dir>] [--emit-asm=<file>] [--emit-obj=<file>] [--target-arch=<arch>] <file.caps>\n"
     "\n"
     "  --dump-ast             Print parsed+sema-mutated AST\n"
     "  --dump-topology=dot    Print @pipeline_safe topology as Graphviz DOT\n"
@@ -66,7 +73,13 @@ static void print_usage() {
     "  --check-only           CI mode: diagnostics only; exit 0 on success, 2 on any error\n"
     "  --output-ir=<file>     Write IR output to file instead of stdout\n"
     "  --emit-cpp=<dir>       Emit C++ code for each group to <dir>/<group>.cpp\n"
-    "  --compile              Compile the emitted C++ to .exe using MSVC\n"
+    "  --aot-threads=N        Emitted main runs @pipeline_safe groups on N pinned worker threads\n"
+    "  --aot-fused            Emitted main is one fused scheduler function with the schedule inlined\n"
+    "  --compile              Compile the emitted C++ to <group>.exe (MSVC, else clang++/g++)\n"
+    "  --aot-cache=<dir>      Build cache for --compile: only groups whose C++ changed are recompiled (default .caps-cache)\n"
+    "  --aot-jobs=N           Groups --compile builds concurrently (default: one per hardware thread)\n"
+    "  --aot-profile-generate Emitted programs count state entries, branch outcomes and blocked channel ops, written to <group>.capsprof at exit\n"
+    "  --aot-profile-use=<dir> Lay out, hint and reorder each group from <dir>/<group>.capsprof\n"
     "  --emit-asm=<file>      Emit x86-64 assembly to <file>\n"
     "  --emit-obj=<file>      Emit COFF .obj file to <file>\n"
     "  --target-arch=<arch>   Set target architecture (x86_64, arm64, riscv, wasm)\n";
@@ -118,8 +131,50 @@ static bool parse_args(int argc, char** argv, Options& opt) {
       continue;
     }
 
+    if (a.rfind("--aot-threads=", 0) == 0) {
+      std::string n = a.substr(a.find('=') + 1);
+      if (n.empty() || n.find_first_not_of("0123456789") != std::string::npos || n.size() > 4) {
+        std::cerr << "error: --aot-threads requires '=N'\n";
+        return false;
+      }
+      opt.aot_threads = (unsigned)std::stoul(n);
+      continue;
+    }
+
+    if (a == "--aot-fused") { opt.aot_fused = true; continue; }
+
     if (a == "--compile") { opt.compile = true; continue; }
 
+    if (a.rfind("--aot-cache=", 0) == 0) {
+      opt.aot_cache_dir = a.substr(a.find('=') + 1);
+      if (opt.aot_cache_dir.empty()) {
+        std::cerr << "error: --aot-cache requires '=dir'\n";
+        return false;
+      }
+      continue;
+    }
+
+    if (a == "--aot-profile-generate") { opt.aot_profile_generate = true; continue; }
+
+    if (a.rfind("--aot-profile-use=", 0) == 0) {
+      opt.aot_profile_use_dir = a.substr(a.find('=') + 1);
+      if (opt.aot_profile_use_dir.empty()) {
+        std::cerr << "error: --aot-profile-use requires '=dir'\n";
+        return false;
+      }
+      continue;
+    }
+
+    if (a.rfind("--aot-jobs=", 0) == 0) {
+      std::string n = a.substr(a.find('=') + 1);
+      if (n.empty() || n.find_first_not_of("0123456789") != std::string::npos || n.size() > 4) {
+        std::cerr << "error: --aot-jobs requires '=N'\n";
+        return false;
+      }
+      opt.aot_jobs = (unsigned)std::stoul(n);
+      continue;
+    }
+
     if (a.rfind("--emit-obj=", 0) == 0) {
       auto eq = a.find('=');
       if (eq == std::string::npos) {
@@ -244,6 +299,19 @@ int main(int argc, char** argv) {
   if (!opt.check_only) {
     // IR Lowering
     Lowering lower;
+
+    // emitted groups #include the shared runtime instead of repeating it
+    std::vector<caps::aot::BuildUnit> builds;
+    if (!opt.emit_cpp_dir.empty()) {
+      std::string rt_file = opt.emit_cpp_dir + "/" + caps::aot::kRuntimeHeaderName;
+      std::ofstream rt(rt_file);
+      if (!rt) {
+        std::cerr << "error: cannot open C++ output file: " << rt_file << "\n";
+        return 1;
+      }
+      rt << caps::aot::runtime_header();
+    }
+
     for (auto& g : prog.groups) {
       IRGroup irg = lower.lower_group(g);
       // Apply optimizations
@@ -262,7 +330,35 @@ int main(int argc, char** argv) {
 
       if (!opt.emit_cpp_dir.empty()) {
         caps::aot::Group tg = caps::aot::lower_typed(irg);
-        std::string cpp_code = caps::aot::emit_cpp(tg, true);
+        for (auto& c : caps::aot::fuse_channels(tg)) {
+          std::cerr << "note: " << g.name << ": channel " << c << " holds at most one message, emitted as a slot\n";
+        }
+        caps::aot::EmitOptions eo;
+        eo.threads = opt.aot_threads;
+        eo.fused = opt.aot_fused;
+        eo.runtime_header = caps::aot::kRuntimeHeaderName;
+        if (opt.aot_profile_generate) eo.instrument = g.name + ".capsprof";
+        caps::aot::Profile prof;
+        if (!opt.aot_profile_use_dir.empty()) {
+          std::string prof_file = opt.aot_profile_use_dir + "/" + g.name + ".capsprof";
+          std::ifstream pin(prof_file);
+          if (!pin) {
+            std::cerr << "note: " << g.name << ": no profile " << prof_file << ", emitted without one\n";
+          } else {
+            try {
+              caps::aot::read_profile(pin, prof);
+            } catch (const std::exception& e) {
+              std::cerr << "error: " << prof_file << ": " << e.what() << "\n";
+              return 1;
+            }
+            eo.profile = &prof;
+          }
+        }
+        if (eo.threads > 0) {
+          std::string why = caps::aot::threads_ineligible_reason(tg);
+          if (!why.empty()) std::cerr << "note: " << g.name << ": sequential main, not threaded: " << why << "\n";
+        }
+        std::string cpp_code = caps::aot::emit_cpp(tg, eo);
         std::string cpp_file = opt.emit_cpp_dir + "/" + g.name + ".cpp";
         std::ofstream ofs(cpp_file);
         if (!ofs) {
@@ -272,16 +368,7 @@ int main(int argc, char** argv) {
         ofs << cpp_code;
         std::cout << "Emitted C++ to " << cpp_file << "\n";
 
-        if (opt.compile) {
-          std::string exe_file = g.name + ".exe";
-          std::string cmd = "cl /std:c++17 /O2 /EHsc " + cpp_file + " /Fe:" + exe_file;
-          int ret = system(cmd.c_str());
-          if (ret != 0) {
-            std::cerr << "Compilation failed for " << g.name << "\n";
-            return 1;
-          }
-          std::cout << "Compiled to " << exe_file << "\n";
-        }
+        if (opt.compile) builds.push_back({g.name, cpp_code, g.name + ".exe"});
       }
 
       // New: emit .obj or .asm
@@ -320,6 +407,30 @@ int main(int argc, char** argv) {
         return 1;
       }
     }
+
+    // --compile: all groups at once, so that they build in parallel
+    if (!builds.empty()) {
+      caps::aot::BuildOptions bo;
+      bo.cache_dir = opt.aot_cache_dir;
+      bo.jobs = opt.aot_jobs;
+      auto outcomes = caps::aot::build_exes(builds, bo);
+      bool failed = false;
+      for (size_t i = 0; i < builds.size(); i++) {
+        switch (outcomes[i]) {
+          case caps::aot::BuildOutcome::Failed:
+            std::cerr << "Compilation failed for " << builds[i].name << "\n";
+            failed = true;
+            break;
+          case caps::aot::BuildOutcome::Built:
+            std::cout << "Compiled to " << builds[i].out_exe_path << "\n";
+            break;
+          case caps::aot::BuildOutcome::Cached:
+            std::cout << "Up to date: " << builds[i].out_exe_path << " (cached)\n";
+            break;
+        }
+      }
+      if (failed) return 1;
+    }
   }
 
   return 0;
@@ -0,0 +1,69 @@
+#include "backend/mapped_file.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace caps {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+  HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (f == INVALID_HANDLE_VALUE) throw std::runtime_error("cannot open " + path);
+  LARGE_INTEGER sz;
+  if (!GetFileSizeEx(f, &sz)) {
+    CloseHandle(f);
+    throw std::runtime_error("cannot stat " + path);
+  }
+  size_t n = (size_t)sz.QuadPart;
+  const void* view = nullptr;
+  if (n) {
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m) {
+      view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(m);
+    }
+  }
+  CloseHandle(f);
+  if (n && !view) throw std::runtime_error("cannot map " + path);
+  data_ = (const uint8_t*)view;
+  size_ = n;
+}
+
+MappedFile::~MappedFile() {
+  if (data_) UnmapViewOfFile(data_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("cannot open " + path);
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("cannot stat " + path);
+  }
+  size_t n = (size_t)st.st_size;
+  void* view = n ? ::mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+  ::close(fd);
+  if (view == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+  data_ = (const uint8_t*)view;
+  size_ = n;
+}
+
+MappedFile::~MappedFile() {
+  if (data_) ::munmap((void*)data_, size_);
+}
+
+#endif
+
+} // namespace caps
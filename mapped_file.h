@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace caps {
+
+// Read-only memory mapping of a whole file (POSIX mmap / Win32 file mapping).
+// Used to restore checkpoints without reading them into a buffer first.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& path); // throws std::runtime_error
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& o) noexcept { swap(o); }
+  MappedFile& operator=(MappedFile&& o) noexcept { swap(o); return *this; }
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  void swap(MappedFile& o) noexcept {
+    std::swap(data_, o.data_);
+    std::swap(size_, o.size_);
+  }
+
+  // the view keeps the mapping alive; file handles are closed after mapping
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace caps
@@ -0,0 +1,366 @@
+#include "backend/parallel_scheduler.h"
+#include "backend/exec.h"
+#include "backend/jit.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace caps {
+
+// Sequential time is the global step index s = tick_index * L + position,
+// where L is the schedule length: the round-robin scheduler executes steps in
+// exactly this order. Every push/pop records the s it happened at, so a worker
+// that runs ahead of the other end of a channel leaves enough information for
+// that end to ignore operations from its own future.
+
+static constexpr uint64_t kDone = UINT64_MAX;
+
+// A stage starts tick t only once every other stage has reached tick
+// t - kMaxLagTicks, so a producer that never waits on a channel cannot run
+// unboundedly far ahead of its consumers.
+static constexpr uint64_t kMaxLagTicks = 64;
+
+// A waiting worker spins kSpinPauses times, yields until kYieldPauses, then
+// sleeps in slices of kSleepSlice until a frontier moves.
+static constexpr unsigned kSpinPauses = 64;
+static constexpr unsigned kYieldPauses = 256;
+static constexpr std::chrono::microseconds kSleepSlice{200};
+
+namespace {
+
+struct Endpoints {
+  uint32_t writer = kNoSlot;
+  uint32_t reader = kNoSlot;
+};
+
+// thrown into a waiting worker once another worker failed
+struct Aborted {};
+
+} // namespace
+
+static bool uses_len(const IRExpr& e) {
+  if (e.kind == IRExpr::Kind::LenChannel) return true;
+  if (e.kind == IRExpr::Kind::Call && e.func_name == "len") return true;
+  for (auto& a : e.args) {
+    if (uses_len(a)) return true;
+  }
+  return false;
+}
+
+static std::string scan_actions(const IRGroup& g, uint32_t pid, const std::vector<IRAction>& acts,
+                                std::vector<Endpoints>& ends) {
+  using K = IRAction::Kind;
+  for (auto& a : acts) {
+    if (uses_len(a.expr)) return "len() of a channel";
+    bool send = a.kind == K::Send || a.kind == K::TrySend;
+    bool recv = a.kind == K::Receive || a.kind == K::TryReceive;
+    if (!send && !recv) continue;
+    if (a.chan_id >= g.channels.size()) continue; // reported when executed
+    if (g.channels[a.chan_id].capacity == 0) return "rendezvous channel '" + a.chan + "'";
+
+    uint32_t& end = send ? ends[a.chan_id].writer : ends[a.chan_id].reader;
+    if (end != kNoSlot && end != pid)
+      return "channel '" + a.chan + "' has more than one " + (send ? "writer" : "reader");
+    end = pid;
+  }
+  return "";
+}
+
+static std::string scan_endpoints(const IRGroup& g, std::vector<Endpoints>& ends) {
+  ends.assign(g.channels.size(), {});
+  for (uint32_t pid = 0; pid < g.processes.size(); pid++) {
+    for (auto& kv : g.processes[pid].states) {
+      auto& st = kv.second;
+      std::string why = scan_actions(g, pid, st.actions, ends);
+      if (why.empty() && st.transition.kind == IRTransition::Kind::IfElse) {
+        if (uses_len(st.transition.cond)) why = "len() of a channel";
+        if (why.empty()) why = scan_actions(g, pid, st.transition.then_actions, ends);
+        if (why.empty()) why = scan_actions(g, pid, st.transition.else_actions, ends);
+      }
+      if (!why.empty()) return why;
+    }
+  }
+  for (uint32_t c = 0; c < ends.size(); c++) {
+    if (ends[c].writer != kNoSlot && ends[c].writer == ends[c].reader)
+      return "channel '" + g.channels[c].name + "' is written and read by the same process";
+  }
+  return "";
+}
+
+static std::string ineligible(const IRGroup& g, std::vector<Endpoints>& ends) {
+  if (std::find(g.annotations.begin(), g.annotations.end(), "pipeline_safe") == g.annotations.end())
+    return "group is not @pipeline_safe";
+  if (!g.linked) return "group not linked";
+  return scan_endpoints(g, ends);
+}
+
+std::string pipeline_ineligible_reason(const IRGroup& g) {
+  std::vector<Endpoints> ends;
+  return ineligible(g, ends);
+}
+
+namespace {
+
+class PipelineRun final : public ChannelSync {
+public:
+  PipelineRun(Runtime& rt, std::vector<Endpoints> ends, unsigned threads, uint64_t max_ticks);
+
+  RunResult run();
+
+  bool full(const ProcessInstance& p, uint32_t chan) override;
+  bool empty(const ProcessInstance& p, uint32_t chan) override;
+  void on_push(const ProcessInstance& p, uint32_t chan) override;
+  void on_pop(const ProcessInstance& p, uint32_t chan) override;
+
+private:
+  // Next step index a partition will execute; every earlier step of it is done.
+  struct alignas(64) Frontier {
+    std::atomic<uint64_t> next{0};
+  };
+
+  // step index of the push/pop that last used each ring slot
+  struct Stamps {
+    std::vector<uint64_t> push_step;
+    std::vector<uint64_t> pop_step;
+  };
+
+  void worker(uint32_t part);
+  bool caught_up(uint32_t peer, const ProcessInstance& p, uint64_t s) const;
+  void publish(Frontier& f, uint64_t s);
+  void hold_back(uint32_t part, uint64_t ti);
+  void pause(unsigned& spins);
+
+  Runtime& rt;
+  std::vector<Endpoints> ends;
+  uint64_t max_ticks;
+
+  std::vector<uint32_t> part_of;                     // process -> partition (kNoSlot: unscheduled)
+  std::vector<std::vector<uint32_t>> part_procs;     // partition -> processes
+  std::vector<std::vector<uint32_t>> part_positions; // partition -> schedule positions, ascending
+  std::unique_ptr<Frontier[]> frontier;
+
+  std::vector<Stamps> stamps;
+  std::vector<uint64_t> cur_step;  // per process, written by its own worker
+  std::vector<uint64_t> last_tick; // per process: last tick index (1-based) it stepped in, 0 = none
+
+  // sleeping waiters (see pause)
+  std::mutex wait_mu;
+  std::condition_variable wake;
+  std::atomic<uint32_t> sleepers{0};
+
+  std::atomic<bool> aborted{false};
+  std::mutex err_mu;
+  uint64_t err_step = kDone;
+  std::exception_ptr err;
+};
+
+PipelineRun::PipelineRun(Runtime& rt_, std::vector<Endpoints> ends_, unsigned threads, uint64_t max_ticks_)
+    : rt(rt_), ends(std::move(ends_)), max_ticks(max_ticks_) {
+  const auto& steps = rt.group->schedule.step_ids;
+
+  // stages in order of first appearance in the schedule, split into contiguous runs
+  std::vector<uint32_t> order;
+  std::vector<uint8_t> seen(rt.procs.size(), 0);
+  for (uint32_t id : steps) {
+    if (!seen[id]) { seen[id] = 1; order.push_back(id); }
+  }
+  threads = std::max(1u, std::min<unsigned>(threads, (unsigned)order.size()));
+
+  part_of.assign(rt.procs.size(), kNoSlot);
+  part_procs.resize(threads);
+  part_positions.resize(threads);
+  for (size_t k = 0; k < order.size(); k++) {
+    uint32_t part = (uint32_t)(k * threads / order.size());
+    part_of[order[k]] = part;
+    part_procs[part].push_back(order[k]);
+  }
+  for (uint32_t i = 0; i < steps.size(); i++) part_positions[part_of[steps[i]]].push_back(i);
+  frontier.reset(new Frontier[threads]);
+
+  stamps.resize(rt.channels.size());
+  for (size_t c = 0; c < rt.channels.size(); c++) {
+    stamps[c].push_step.assign(rt.channels[c].ring.size(), 0);
+    stamps[c].pop_step.assign(rt.channels[c].ring.size(), 0);
+  }
+  cur_step.assign(rt.procs.size(), 0);
+  last_tick.assign(rt.procs.size(), 0);
+}
+
+// True once `peer` can no longer touch the channel at a step before s. Read
+// before the channel counters: the frontier store releases every earlier
+// push/pop of that worker.
+bool PipelineRun::caught_up(uint32_t peer, const ProcessInstance& p, uint64_t s) const {
+  if (peer == kNoSlot || part_of[peer] == kNoSlot) return true; // never steps
+  if (part_of[peer] == part_of[p.id]) return true;              // same thread: already in order
+  return frontier[part_of[peer]].next.load(std::memory_order_acquire) > s;
+}
+
+// Advances a frontier and wakes sleeping waiters. The sleeper count is read
+// without a fence; a wake-up missed by that race costs one kSleepSlice.
+void PipelineRun::publish(Frontier& f, uint64_t s) {
+  f.next.store(s, std::memory_order_release);
+  if (sleepers.load(std::memory_order_relaxed) == 0) return;
+  std::lock_guard<std::mutex> lock(wait_mu);
+  wake.notify_all();
+}
+
+// Waits until every other stage has reached tick ti - kMaxLagTicks.
+void PipelineRun::hold_back(uint32_t part, uint64_t ti) {
+  if (ti < kMaxLagTicks) return;
+  uint64_t floor = (ti - kMaxLagTicks) * rt.group->schedule.step_ids.size();
+  for (uint32_t k = 0; k < part_positions.size(); k++) {
+    if (k == part) continue;
+    for (unsigned spins = 0; frontier[k].next.load(std::memory_order_acquire) < floor;) pause(spins);
+  }
+}
+
+// One round of a wait loop; the caller re-checks its condition afterwards.
+void PipelineRun::pause(unsigned& spins) {
+  if (aborted.load(std::memory_order_relaxed)) throw Aborted{};
+  if (++spins < kSpinPauses) return;
+  if (spins < kYieldPauses) {
+    std::this_thread::yield();
+    return;
+  }
+  std::unique_lock<std::mutex> lock(wait_mu);
+  sleepers.fetch_add(1, std::memory_order_relaxed);
+  wake.wait_for(lock, kSleepSlice);
+  sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Full at step s iff the item `capacity` places behind the tail was not popped
+// before s. A pop already stamped after s answers "full" without waiting.
+bool PipelineRun::full(const ProcessInstance& p, uint32_t chan) {
+  Channel& c = rt.channels[chan];
+  uint64_t t = c.tail.get();
+  if (t < c.capacity) return false;
+  uint64_t oldest = t - c.capacity;
+  uint64_t s = cur_step[p.id];
+  for (unsigned spins = 0;;) {
+    bool settled = caught_up(ends[chan].reader, p, s);
+    if (c.head.get() > oldest) return stamps[chan].pop_step[oldest & c.mask] > s;
+    if (settled) return true;
+    pause(spins);
+  }
+}
+
+// Empty at step s iff the head item does not exist yet or was pushed after s.
+bool PipelineRun::empty(const ProcessInstance& p, uint32_t chan) {
+  Channel& c = rt.channels[chan];
+  uint64_t h = c.head.get();
+  uint64_t s = cur_step[p.id];
+  for (unsigned spins = 0;;) {
+    bool settled = caught_up(ends[chan].writer, p, s);
+    if (c.tail.get() > h) return stamps[chan].push_step[h & c.mask] > s;
+    if (settled) return true;
+    pause(spins);
+  }
+}
+
+void PipelineRun::on_push(const ProcessInstance& p, uint32_t chan) {
+  Channel& c = rt.channels[chan];
+  stamps[chan].push_step[c.tail.get() & c.mask] = cur_step[p.id];
+}
+
+void PipelineRun::on_pop(const ProcessInstance& p, uint32_t chan) {
+  Channel& c = rt.channels[chan];
+  stamps[chan].pop_step[c.head.get() & c.mask] = cur_step[p.id];
+}
+
+void PipelineRun::worker(uint32_t part) {
+  const auto& steps = rt.group->schedule.step_ids;
+  const uint64_t L = steps.size();
+  Frontier& f = frontier[part];
+  uint64_t s = 0;
+
+  try {
+    for (uint64_t ti = 0; ti < max_ticks && !aborted.load(std::memory_order_relaxed); ti++) {
+      publish(f, ti * L); // every earlier step of this stage is done
+      hold_back(part, ti);
+      for (uint32_t i : part_positions[part]) {
+        ProcessInstance& p = rt.procs[steps[i]];
+        if (p.status != ProcStatus::Running) continue;
+        s = ti * L + i;
+        publish(f, s);
+        cur_step[p.id] = s;
+        if (rt.jit) rt.jit->step(rt, p);
+        else step_process(rt, p, NoTrace{});
+        last_tick[p.id] = ti + 1;
+      }
+
+      // blocked processes are never woken on buffered channels
+      bool any_running = false;
+      for (uint32_t id : part_procs[part]) any_running = any_running || rt.procs[id].status == ProcStatus::Running;
+      if (!any_running) break;
+    }
+  } catch (const Aborted&) {
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(err_mu);
+    if (s < err_step) { err_step = s; err = std::current_exception(); }
+    aborted.store(true, std::memory_order_relaxed);
+  }
+
+  publish(f, kDone);
+  std::lock_guard<std::mutex> lock(wait_mu);
+  wake.notify_all(); // sleepers re-check `aborted` too
+}
+
+RunResult PipelineRun::run() {
+  const uint64_t t0 = rt.tick;
+
+  rt.sync = this;
+  std::vector<std::thread> pool;
+  for (uint32_t k = 1; k < part_positions.size(); k++) pool.emplace_back([this, k] { worker(k); });
+  worker(0);
+  for (auto& th : pool) th.join();
+  rt.sync = nullptr;
+
+  if (err) std::rethrow_exception(err);
+
+  // Reconstruct the tick the round-robin loop would have stopped at.
+  uint64_t last = 0;
+  bool any_running = false, all_finished = true;
+  for (auto& p : rt.procs) {
+    last = std::max(last, last_tick[p.id]);
+    any_running = any_running || p.status == ProcStatus::Running;
+    all_finished = all_finished && p.status == ProcStatus::Finished;
+  }
+
+  if (!any_running && all_finished) {
+    rt.tick = t0 + std::max<uint64_t>(last, 1);
+    return {RunStatus::Completed, "allprocessesterminal"};
+  }
+  // the first tick in which nobody steps is the deadlock tick
+  if (!any_running && last < max_ticks) {
+    rt.tick = t0 + last + 1;
+    return {RunStatus::Deadlock, "allprocessesblockednoprogress"};
+  }
+  rt.tick = t0 + max_ticks;
+  return {RunStatus::Deadlock, "maxticks_exceeded"};
+}
+
+} // namespace
+
+RunResult run_group_pipelined(Runtime& rt, TraceSink* trace, uint64_t max_ticks, unsigned threads) {
+  if (!rt.group) throw std::runtime_error("runtime not initialized");
+
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  std::vector<Endpoints> ends;
+  bool eligible = trace == nullptr && rt.checkpoint_every == 0 && threads > 1 && max_ticks > 0 && ineligible(*rt.group, ends).empty();
+  if (!eligible) return run_group(rt, trace, max_ticks, SchedulerMode::RoundRobin);
+
+  for (uint32_t id : rt.group->schedule.step_ids) {
+    if (id >= rt.procs.size()) throw std::runtime_error("schedule references unknown process");
+  }
+
+  PipelineRun run(rt, std::move(ends), threads, max_ticks);
+  return run.run();
+}
+
+} // namespace caps
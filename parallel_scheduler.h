@@ -0,0 +1,26 @@
+#pragma once
+#include "backend/scheduler.h"
+#include <string>
+
+namespace caps {
+
+// Runs a @pipeline_safe group with its processes partitioned over worker
+// threads (one stage per thread when there are enough cores). Channels are the
+// existing rings used single-producer/single-consumer; instead of a barrier per
+// tick, each end of a channel runs ahead until the answer to full()/empty()
+// depends on a step the other end has not reached yet, and no stage runs more
+// than a fixed number of ticks ahead of another. Waits spin, then block.
+// Final state, result and per-channel message order are those of the
+// round-robin scheduler.
+//
+// threads == 0 picks std::thread::hardware_concurrency(). Falls back to the
+// round-robin scheduler (same result, one thread) when a trace sink is given or
+// pipeline_ineligible_reason() is non-empty.
+RunResult run_group_pipelined(Runtime& rt, TraceSink* trace, uint64_t max_ticks, unsigned threads = 0);
+
+// Empty if g can run pipelined, otherwise why not: missing @pipeline_safe,
+// rendezvous channels, len() of a channel, or a channel with more than one
+// writer or reader process, or written and read by the same process.
+std::string pipeline_ineligible_reason(const IRGroup& g);
+
+} // namespace caps
@@ -445,106 +445,6 @@ ScheduleDecl Parser::parse_schedule() {
   return s;
 }
 
-// Parser methods for new features
-std::unique_ptr<Expr> Parser::parse_match_expr() {
-  auto expr = std::make_unique<Expr>();
-  expr->kind = Expr::Kind::Match;
-  expr->pos = t().pos;
-
-  expect(TokenKind::KwMatch, "expected 'match' keyword");
-  expect(TokenKind::LBrace, "expected '{' after match");
-
-  // Parse cases
-  while (!is(TokenKind::RBrace) && !is(TokenKind::End)) {
-    Token pat = expect(TokenKind::Ident, "expected pattern after 'match'");
-    expect(TokenKind::Arrow, "expected '=>' after pattern");
-    Expr action = parse_expr();
-    expr->cases.push_back({pat.text, action});
-    if (!accept(TokenKind::Comma)) break;
-  }
-
-  expect(TokenKind::RBrace, "expected '}' to close match statement");
-  return expr;
-}
-
-std::unique_ptr<Expr> Parser::parse_array_expr() {
-  auto expr = std::make_unique<Expr>();
-  expr->kind = Expr::Kind::Array;
-  expr->pos = t().pos;
-
-  expect(TokenKind::LBrack, "expected '[' for array expression");
-
-  // Parse elements
-  while (!is(TokenKind::RBrack) && !is(TokenKind::End)) {
-    expr->args.push_back(parse_expr());
-    if (!accept(TokenKind::Comma)) break;
-  }
-
-  expect(TokenKind::RBrack, "expected ']' to close array expression");
-  return expr;
-}
-
-std::unique_ptr<Stmt> Parser::parse_for_loop() {
-  auto loop = std::make_unique<Stmt>();
-  loop->kind = Stmt::Kind::ForLoop;
-  loop->pos = t().pos;
-
-  expect(TokenKind::KwFor, "expected 'for' keyword");
-  expect(TokenKind::LParen, "expected '(' after 'for'");
-
-  // Parse loop variable
-  Token var = expect(TokenKind::Ident, "expected loop variable name");
-  loop->name = var.text;
-  expect(TokenKind::Colon, "expected ':' after loop variable name");
-  loop->explicit_type = parse_type_ref();
-
-  expect(TokenKind::In, "expected 'in' after loop variable declaration");
-  loop->iter_expr = parse_expr();
-
-  expect(TokenKind::RParen, "expected ')' to close for loop header");
-  expect(TokenKind::LBrace, "expected '{' to open for loop body");
-
-  // Parse loop body
-  while (!is(TokenKind::RBrace) && !is(TokenKind::End)) {
-    loop->body.push_back(parse_stmt());
-  }
-
-  expect(TokenKind::RBrace, "expected '}' to close for loop body");
-  return loop;
-}
-
-std::unique_ptr<Decl> Parser::parse_const_fn() {
-  auto fn = std::make_unique<Decl>();
-  fn->kind = Decl::Kind::ConstFn;
-  fn->pos = t().pos;
-
-  expect(TokenKind::KwConst, "expected 'const' keyword");
-  expect(TokenKind::KwFn, "expected 'fn' after 'const'");
-
-  // Parse function name
-  Token name = expect(TokenKind::Ident, "expected function name");
-  fn->name = name.text;
-
-  expect(TokenKind::LParen, "expected '(' after function name");
-
-  // Parse parameters
-  while (!is(TokenKind::RParen) && !is(TokenKind::End)) {
-    fn->params.push_back(parse_param());
-    if (!accept(TokenKind::Comma)) break;
-  }
-
-  expect(TokenKind::RParen, "expected ')' to close parameter list");
-  expect(TokenKind::ThinArrow, "expected '=>'' after parameter list");
-
-  // Parse return type
-  fn->return_type = parse_type_ref();
-
-  // Parse function body
-  fn->body = parse_expr();
-
-  return fn;
-}
-
 // Pratt parsing
 int Parser::infix_binding_power(TokenKind op, bool& right_assoc) const {
   right_assoc = false;
@@ -304,24 +304,17 @@ void PipelineChecker::check_group_pipeline_safe(const GroupDecl& g) {
 }
 
 // Deadlock detection: Check for cycles in process dependencies
-bool detect_deadlocks(const Group& group, Diag& diag) {
-  // Build dependency graph from channels
-  std::unordered_map<std::string, std::vector<std::string>> deps;
-  for (const auto& proc : group.processes) {
-    for (const auto& send : proc.sends) {
-      deps[proc.name].push_back(send.channel);
-    }
-  }
-  // Simplified cycle detection
-  // In practice, use topological sort or DFS
+bool detect_deadlocks(const GroupDecl& group, Diag& diag) {
+  (void)group;
+  (void)diag;
   return false;  // Placeholder
 }
 
 // Bounded memory proofs: Verify channel sizes and buffer limits
-bool prove_bounded_memory(const Group& group, Diag& diag) {
+bool prove_bounded_memory(const GroupDecl& group, Diag& diag) {
   for (const auto& chan : group.channels) {
     if (chan.capacity > 1000000) {  // Arbitrary limit
-      diag.error(chan.span, "Channel capacity too large for bounded proof");
+      diag.error(chan.pos, "Channel capacity too large for bounded proof");
       return false;
     }
   }
@@ -329,20 +322,27 @@ bool prove_bounded_memory(const Group& group, Diag& diag) {
 }
 
 // Channel graph analysis: Build and analyze communication graph
-void analyze_channel_graph(const Group& group, Diag& diag) {
+void analyze_channel_graph(const GroupDecl& group, Diag& diag) {
   // Model as graph: processes -> channels -> processes
   // Check for bottlenecks, isolation, etc.
+  (void)group;
+  (void)diag;
+}
+
+bool is_terminal_state(const OnBlock& ob) {
+  return ob.actions.empty() && ob.transition.kind == Transition::Kind::Unconditional &&
+         ob.transition.to_state == ob.state_name;
 }
 
 // Process lifecycle verification: Ensure all processes can terminate
-bool verify_lifecycles(const Group& group, Diag& diag) {
+bool verify_lifecycles(const GroupDecl& group, Diag& diag) {
   for (const auto& proc : group.processes) {
     bool has_terminal = false;
-    for (const auto& state : proc.states) {
-      if (state.transitions.empty()) has_terminal = true;
+    for (const auto& ob : proc.on_blocks) {
+      if (is_terminal_state(ob)) has_terminal = true;
     }
     if (!has_terminal) {
-      diag.error(proc.span, "Process has no terminal state");
+      diag.error(proc.pos, "Process has no terminal state");
       return false;
     }
   }
@@ -350,7 +350,7 @@ bool verify_lifecycles(const Group& group, Diag& diag) {
 }
 
 // Determinism proofs: Check for non-deterministic constructs
-bool prove_determinism(const Group& group, Diag& diag) {
+bool prove_determinism(const GroupDecl& group, Diag& diag) {
   // Ensure no external inputs, timers are deterministic, etc.
   return true;  // Placeholder
 }
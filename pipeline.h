@@ -63,3 +63,7 @@ bool prove_bounded_memory(const GroupDecl& group, Diag& diag);
 void analyze_channel_graph(const GroupDecl& group, Diag& diag);
 bool verify_lifecycles(const GroupDecl& group, Diag& diag);
 bool prove_determinism(const GroupDecl& group, Diag& diag);
+
+// A state has no way out when its on-block does nothing and stays put
+// (`on Done { -> Done }`); sema requires every declared state to have one.
+bool is_terminal_state(const OnBlock& ob);
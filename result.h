@@ -3,39 +3,37 @@
 
 namespace caps {
 
-// Result<T,E> is represented as a Record with fields:
-//   ok: bool
-//   value: <T> (Value)
-//   error: <E> (Value, usually text)
+// Result<T,E> is a native Value (ValueTag::Result):
+//   ok: err == kErrNone
+//   value: <T> payload stored inline (boxed only for text/aggregates)
+//   error: interned error code; text materialized on demand via error_text()
 inline Value make_result_ok(Value v) {
-  Record r;
-  r.fields["ok"] = Value::b(true);
-  r.fields["value"] = std::move(v);
-  r.fields["error"] = Value::s("");
-  return Value::rec(std::move(r));
+  return Value::ok(std::move(v));
 }
 
-inline Value make_result_err_text(std::string err) {
-  Record r;
-  r.fields["ok"] = Value::b(false);
-  r.fields["value"] = Value::unset();
-  r.fields["error"] = Value::s(std::move(err));
-  return Value::rec(std::move(r));
+inline Value make_result_err(uint32_t code) {
+  return Value::error(code);
+}
+
+inline Value make_result_err_text(const std::string& err) {
+  return Value::error(intern_error(err));
 }
 
 inline bool result_ok(const Value& rv) {
-  auto& rec = as_record(rv);
-  return as_bool(rec.fields.at("ok"));
+  return result_is_ok(rv);
+}
+
+inline Value result_value(const Value& rv) {
+  return result_payload(rv);
 }
 
-inline const Value& result_value(const Value& rv) {
-  auto& rec = as_record(rv);
-  return rec.fields.at("value");
+inline uint32_t result_error_code(const Value& rv) {
+  if (rv.tag != ValueTag::Result) value_type_error("expected result");
+  return rv.err;
 }
 
-inline const Value& result_error(const Value& rv) {
-  auto& rec = as_record(rv);
-  return rec.fields.at("error");
+inline Value result_error(const Value& rv) {
+  return Value::s(error_text(result_error_code(rv)));
 }
 
 } // namespace caps
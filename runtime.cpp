@@ -2,4 +2,24 @@
 
 namespace caps {
 
+const Value* ProcessInstance::find_var(const std::string& n) const {
+  uint32_t s = def ? def->find_slot(n) : kNoSlot;
+  return s < slots.size() ? &slots[s] : nullptr;
 }
+
+Value* ProcessInstance::find_var(const std::string& n) {
+  uint32_t s = def ? def->find_slot(n) : kNoSlot;
+  return s < slots.size() ? &slots[s] : nullptr;
+}
+
+const Channel* Runtime::find_channel(const std::string& n) const {
+  for (auto& c : channels) if (c.name == n) return &c;
+  return nullptr;
+}
+
+const ProcessInstance* Runtime::find_proc(const std::string& n) const {
+  for (auto& p : procs) if (p.name == n) return &p;
+  return nullptr;
+}
+
+} // namespace caps
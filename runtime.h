@@ -2,38 +2,94 @@
 #include "backend/ir.h"
 #include "backend/channel.h"
 #include "backend/value.h"
+#include <functional>
 #include <unordered_map>
 
 namespace caps {
 
 enum class ProcStatus { Running, Blocked, Finished };
 
+struct ProcessInstance;
+class JitGroup;
+
+// Installed in Runtime::sync by the pipelined scheduler (parallel_scheduler.h),
+// where the two ends of a buffered channel run on different threads and may be
+// ahead of or behind each other. full()/empty() answer as the sequential
+// schedule would at p's current step, waiting for the other end if needed;
+// on_push()/on_pop() are called just before Channel::push/pop.
+struct ChannelSync {
+  virtual ~ChannelSync() = default;
+  virtual bool full(const ProcessInstance& p, uint32_t chan) = 0;
+  virtual bool empty(const ProcessInstance& p, uint32_t chan) = 0;
+  virtual void on_push(const ProcessInstance& p, uint32_t chan) = 0;
+  virtual void on_pop(const ProcessInstance& p, uint32_t chan) = 0;
+};
+
 struct ProcessInstance {
   std::string name;
+  uint32_t id = 0; // index in Runtime::procs
   const IRProcess* def = nullptr;
 
-  std::string state;
+  uint32_t state = kNoSlot; // id into def->state_names / state_table
   ProcStatus status = ProcStatus::Running;
 
-  std::unordered_map<std::string, Value> locals;
-  std::unordered_map<std::string, Value> outputs;
+  // locals + outputs, indexed by the slots resolve_slots() assigned in def
+  std::vector<Value> slots;
+
+  // state id -> IRState in def, built by init_runtime
+  std::vector<const IRState*> state_table;
 
-  // for Blocked: what we’re waiting on
-  std::string blocked_chan;
+  // unbuffered-channel mailboxes live in slots (IRAction::mailbox_slot);
+  // mail_ready[slot] != 0 while a handed-over value is waiting there
+  std::vector<uint8_t> mail_ready;
+
+  // for Blocked: what we’re waiting on (channel id)
+  uint32_t blocked_chan = kNoSlot;
   bool blocked_is_send = false;
+  uint32_t blocked_mailbox = kNoSlot; // mailbox slot a sender delivers into
+
+  // set by a failed TryUnwrapAssign: state to enter instead of the transition
+  uint32_t divert_state = kNoSlot;
+
+  const std::string& state_name() const { return def->state_names[state]; }
+
+  // Name-based access for tracing/debugging only; the interpreter uses slots.
+  const Value* find_var(const std::string& n) const;
+  Value* find_var(const std::string& n);
 };
 
 struct Runtime {
   const IRGroup* group = nullptr;
 
-  std::unordered_map<std::string, Channel> channels;
-  std::unordered_map<std::string, ProcessInstance> procs;
+  // indexed by declaration order in group (see link_group)
+  std::vector<Channel> channels;
+  std::vector<ProcessInstance> procs;
 
   uint64_t tick = 0;
   size_t schedule_pos = 0;
 
   // deadlock detection
   uint64_t steps_since_progress = 0;
+
+  // Processes moved Blocked -> Running by a rendezvous handoff, in wake order.
+  // Drained by the scheduler after every step.
+  std::vector<uint32_t> woken;
+
+  // null except under the pipelined scheduler
+  ChannelSync* sync = nullptr;
+
+  // Set by the caller to run untraced steps as native code (see jit.h); built
+  // from the same group.
+  const JitGroup* jit = nullptr;
+
+  // Called by run_group at the end of every tick that is a multiple of
+  // checkpoint_every (0: never). See checkpoint_every() in checkpoint.h.
+  uint64_t checkpoint_every = 0;
+  std::function<void(const Runtime&)> on_checkpoint;
+
+  // Name-based lookup for tracing/debugging only.
+  const Channel* find_channel(const std::string& n) const;
+  const ProcessInstance* find_proc(const std::string& n) const;
 };
 
 } // namespace caps
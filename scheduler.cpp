@@ -1,23 +1,38 @@
 #include "backend/scheduler.h"
 #include "backend/exec.h"
+#include "backend/jit.h"
+#include "backend/parallel_scheduler.h"
+#include <algorithm>
+#include <functional>
 #include <stdexcept>
 
 namespace caps {
 
 static bool all_finished(const Runtime& rt) {
-  for (auto& kv : rt.procs) {
-    if (kv.second.status != ProcStatus::Finished) return false;
+  for (auto& p : rt.procs) {
+    if (p.status != ProcStatus::Finished) return false;
   }
   return true;
 }
 
 static bool any_running(const Runtime& rt) {
-  for (auto& kv : rt.procs) {
-    if (kv.second.status == ProcStatus::Running) return true;
+  for (auto& p : rt.procs) {
+    if (p.status == ProcStatus::Running) return true;
   }
   return false;
 }
 
+static void maybe_checkpoint(const Runtime& rt) {
+  if (rt.checkpoint_every && rt.tick % rt.checkpoint_every == 0 && rt.on_checkpoint) rt.on_checkpoint(rt);
+}
+
+// step_process, or the JIT's native code for it on untraced runs
+template <class Trace>
+static bool step(Runtime& rt, ProcessInstance& p, const Trace& trace) {
+  if (!Trace::enabled && rt.jit) return rt.jit->step(rt, p);
+  return step_process(rt, p, trace);
+}
+
 static bool any_progress_possible(const Runtime& rt) {
   // If there is at least one Running, progress is possible.
   if (any_running(rt)) return true;
@@ -28,71 +43,211 @@ static bool any_progress_possible(const Runtime& rt) {
 }
 
 void init_runtime(Runtime& rt, const IRGroup& g) {
+  if (!g.linked) throw std::runtime_error("group not linked (call link_group): " + g.name);
+
   rt.group = &g;
   rt.channels.clear();
   rt.procs.clear();
-  rt.tick = 0;
-  rt.schedule_pos = 0;
-  rt.steps_since_progress = 0;
 
   // Channels
   for (auto& c : g.channels) {
     Channel ch;
-    ch.name = c.name;
-    ch.capacity = c.capacity;
-    rt.channels[ch.name] = std::move(ch);
+    ch.init(c.name, c.capacity, g.processes.size());
+    ch.id = (uint32_t)rt.channels.size();
+    rt.channels.push_back(std::move(ch));
   }
 
   // Processes
   for (auto& p : g.processes) {
     ProcessInstance pi;
     pi.name = p.name;
+    pi.id = (uint32_t)rt.procs.size();
     pi.def = &p;
-    pi.state = p.initial_state;
-    pi.status = ProcStatus::Running;
 
-    // init locals + outputs as unset
-    for (auto& n : p.local_names) pi.locals[n] = Value::unset();
-    for (auto& n : p.output_names) pi.outputs[n] = Value::unset();
+    pi.state_table.assign(p.state_names.size(), nullptr);
+    for (auto& kv : p.states) pi.state_table[kv.second.id] = &kv.second;
+    if (p.initial_state_id == kNoSlot) throw std::runtime_error("unknown state: " + p.initial_state);
 
-    // special: __last_error always present if user wants it; safe to always include
-    pi.locals["__last_error"] = Value::s("");
+    // slot layout comes from resolve_slots; values are set by reset_runtime
+    pi.slots.resize(p.slot_names.size());
+    pi.mail_ready.resize(p.slot_names.size());
 
-    rt.procs[pi.name] = std::move(pi);
+    rt.procs.push_back(std::move(pi));
   }
 
+  reset_runtime(rt);
+
   // Trace header/topology is emitted by TraceSink implementation if desired.
 }
 
-RunResult run_group(Runtime& rt, TraceSink* trace, uint64_t max_ticks) {
+void reset_runtime(Runtime& rt) {
   if (!rt.group) throw std::runtime_error("runtime not initialized");
 
+  rt.tick = 0;
+  rt.schedule_pos = 0;
+  rt.steps_since_progress = 0;
+  rt.woken.clear();
+
+  for (auto& c : rt.channels) {
+    for (auto& v : c.ring) v = Value::unset();
+    c.head.set(0);
+    c.tail.set(0);
+    c.recv_waiters.clear();
+    c.send_waiters.clear();
+  }
+
+  for (auto& pi : rt.procs) {
+    const IRProcess& p = *pi.def;
+    pi.state = p.initial_state_id;
+    pi.status = ProcStatus::Running;
+    pi.blocked_chan = kNoSlot;
+    pi.blocked_is_send = false;
+    pi.blocked_mailbox = kNoSlot;
+    pi.divert_state = kNoSlot;
+
+    // locals + outputs start unset
+    for (uint32_t s = 0; s < pi.slots.size(); s++) {
+      if (s != p.last_error_slot) pi.slots[s] = Value::unset();
+    }
+    std::fill(pi.mail_ready.begin(), pi.mail_ready.end(), 0);
+
+    // special: __last_error always present if user wants it; safe to always include.
+    // A "" left over from the previous run is kept rather than reallocated.
+    Value& last = pi.slots[p.last_error_slot];
+    if (last.tag != ValueTag::Text || !as_text(last).empty()) last = Value::s("");
+  }
+}
+
+// Event-driven variant of the round-robin loop below. Only schedule positions
+// whose process is Running are queued; a blocked process leaves the queue and
+// comes back when a handoff on its channel wakes it (Runtime::woken). Within a
+// tick positions are visited in ascending order, and a process woken behind
+// the cursor waits for the next tick, exactly as the full scan would do.
+template <class Trace>
+static RunResult run_group_ready(Runtime& rt, const Trace& trace, uint64_t max_ticks) {
   auto& g = *rt.group;
+  const auto& steps = g.schedule.step_ids;
+
+  // schedule positions of each process (a process may appear more than once)
+  std::vector<std::vector<uint32_t>> positions(rt.procs.size());
+  for (uint32_t i = 0; i < steps.size(); i++) {
+    if (steps[i] >= rt.procs.size()) throw std::runtime_error("schedule references unknown process: " + g.schedule.steps[i]);
+    positions[steps[i]].push_back(i);
+  }
+
+  size_t finished = 0, blocked = 0;
+  auto count = [&](ProcStatus s, int d) {
+    if (s == ProcStatus::Finished) finished += d;
+    else if (s == ProcStatus::Blocked) blocked += d;
+  };
+  for (auto& p : rt.procs) count(p.status, 1);
+
+  // queued[i] == tick the position is queued for; guards against duplicates
+  std::vector<uint64_t> queued(steps.size(), 0);
+  std::vector<uint32_t> now, next;
+  auto by_pos = std::greater<uint32_t>(); // min-heap on schedule position
+  for (uint32_t i = 0; i < steps.size(); i++) {
+    if (rt.procs[steps[i]].status == ProcStatus::Running) {
+      next.push_back(i);
+      queued[i] = rt.tick + 1;
+    }
+  }
+  rt.woken.clear();
 
   for (uint64_t t = 0; t < max_ticks; t++) {
     rt.tick++;
 
-    if (trace) trace->on_tick_begin(rt.tick);
+    if (Trace::enabled) trace.sink->on_tick_begin(rt.tick);
+
+    bool progress_this_tick = false;
+
+    now.swap(next);
+    next.clear();
+    std::make_heap(now.begin(), now.end(), by_pos);
+
+    while (!now.empty()) {
+      std::pop_heap(now.begin(), now.end(), by_pos);
+      uint32_t cur = now.back();
+      now.pop_back();
+
+      auto& p = rt.procs[steps[cur]];
+      if (p.status != ProcStatus::Running) continue; // blocked/finished at an earlier position
+
+      bool progressed = step(rt, p, trace);
+      progress_this_tick = progress_this_tick || progressed;
+
+      if (p.status == ProcStatus::Running) {
+        next.push_back(cur);
+        queued[cur] = rt.tick + 1;
+      } else {
+        count(p.status, 1);
+      }
+
+      for (uint32_t id : rt.woken) {
+        blocked--;
+        for (uint32_t pos : positions[id]) {
+          if (pos > cur) {
+            if (queued[pos] == rt.tick) continue;
+            queued[pos] = rt.tick;
+            now.push_back(pos);
+            std::push_heap(now.begin(), now.end(), by_pos);
+          } else if (queued[pos] != rt.tick + 1) {
+            queued[pos] = rt.tick + 1;
+            next.push_back(pos);
+          }
+        }
+      }
+      rt.woken.clear();
+    }
+
+    if (Trace::enabled) trace.sink->on_tick_end(rt.tick);
+    maybe_checkpoint(rt);
+
+    if (finished == rt.procs.size()) {
+      if (Trace::enabled) trace.sink->on_status("Completed", "allprocessesterminal", rt);
+      return {RunStatus::Completed, "allprocessesterminal"};
+    }
+
+    if (!progress_this_tick && blocked > 0 && finished + blocked == rt.procs.size()) {
+      if (Trace::enabled) trace.sink->on_status("Deadlock", "allprocessesblockednoprogress", rt);
+      return {RunStatus::Deadlock, "allprocessesblockednoprogress"};
+    }
+  }
+
+  if (Trace::enabled) trace.sink->on_status("Deadlock", "maxticks_exceeded", rt);
+  return {RunStatus::Deadlock, "maxticks_exceeded"};
+}
+
+template <class Trace>
+static RunResult run_group_rr(Runtime& rt, const Trace& trace, uint64_t max_ticks) {
+  auto& g = *rt.group;
+
+  for (uint64_t t = 0; t < max_ticks; t++) {
+    rt.tick++;
+
+    if (Trace::enabled) trace.sink->on_tick_begin(rt.tick);
 
     bool progress_this_tick = false;
 
     // One schedule cycle = one tick
-    for (auto& pname : g.schedule.steps) {
-      auto it = rt.procs.find(pname);
-      if (it == rt.procs.end()) throw std::runtime_error("schedule references unknown process: " + pname);
+    for (size_t i = 0; i < g.schedule.step_ids.size(); i++) {
+      uint32_t id = g.schedule.step_ids[i];
+      if (id >= rt.procs.size()) throw std::runtime_error("schedule references unknown process: " + g.schedule.steps[i]);
 
-      auto& p = it->second;
+      auto& p = rt.procs[id];
 
       if (p.status == ProcStatus::Running) {
-        bool progressed = step_process_once(rt, p, trace);
+        bool progressed = step(rt, p, trace);
         progress_this_tick = progress_this_tick || progressed;
       }
     }
+    rt.woken.clear();
 
-    if (trace) trace->on_tick_end(rt.tick);
+    if (Trace::enabled) trace.sink->on_tick_end(rt.tick);
+    maybe_checkpoint(rt);
 
     if (all_finished(rt)) {
-      if (trace) trace->on_status("Completed", "allprocessesterminal", rt);
+      if (Trace::enabled) trace.sink->on_status("Completed", "allprocessesterminal", rt);
       return {RunStatus::Completed, "allprocessesterminal"};
     }
 
@@ -100,20 +255,40 @@ RunResult run_group(Runtime& rt, TraceSink* trace, uint64_t max_ticks) {
       // No one stepped (all blocked or finished)
       bool any_blocked = false;
       bool all_done_or_blocked = true;
-      for (auto& kv : rt.procs) {
-        if (kv.second.status == ProcStatus::Blocked) any_blocked = true;
-        if (kv.second.status == ProcStatus::Running) all_done_or_blocked = false;
+      for (auto& p : rt.procs) {
+        if (p.status == ProcStatus::Blocked) any_blocked = true;
+        if (p.status == ProcStatus::Running) all_done_or_blocked = false;
       }
 
       if (any_blocked && all_done_or_blocked) {
-        if (trace) trace->on_status("Deadlock", "allprocessesblockednoprogress", rt);
+        if (Trace::enabled) trace.sink->on_status("Deadlock", "allprocessesblockednoprogress", rt);
         return {RunStatus::Deadlock, "allprocessesblockednoprogress"};
       }
     }
   }
 
-  if (trace) trace->on_status("Deadlock", "maxticks_exceeded", rt);
+  if (Trace::enabled) trace.sink->on_status("Deadlock", "maxticks_exceeded", rt);
   return {RunStatus::Deadlock, "maxticks_exceeded"};
 }
 
+template <class Trace>
+static RunResult run_with(Runtime& rt, const Trace& trace, uint64_t max_ticks, SchedulerMode mode) {
+  if (mode == SchedulerMode::ReadyQueue) return run_group_ready(rt, trace, max_ticks);
+  return run_group_rr(rt, trace, max_ticks);
+}
+
+RunResult run_group(Runtime& rt, TraceSink* trace, uint64_t max_ticks, SchedulerMode mode) {
+  if (!rt.group) throw std::runtime_error("runtime not initialized");
+  if (mode == SchedulerMode::Pipelined) return run_group_pipelined(rt, trace, max_ticks);
+  return trace ? run_with(rt, FullTrace{trace}, max_ticks, mode) : run_with(rt, NoTrace{}, max_ticks, mode);
+}
+
+RunResult run_group(Runtime& rt, TraceSink* trace, const TraceFilter& filter, uint64_t max_ticks, SchedulerMode mode) {
+  if (!trace) return run_group(rt, nullptr, max_ticks, mode);
+  if (!rt.group) throw std::runtime_error("runtime not initialized");
+  // traced runs are sequential, as in run_group_pipelined
+  if (mode == SchedulerMode::Pipelined) mode = SchedulerMode::RoundRobin;
+  return run_with(rt, FilteredTrace{trace, &filter}, max_ticks, mode);
+}
+
 } // namespace caps
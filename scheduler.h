@@ -4,15 +4,34 @@
 
 namespace caps {
 
-enum class RunStatus { Completed, Deadlock, Running };
+// Error: a runtime error ended the run (run_group throws instead; batch runs
+// record it per instance).
+enum class RunStatus { Completed, Deadlock, Running, Error };
 
 struct RunResult {
   RunStatus status = RunStatus::Running;
   std::string reason;
 };
 
+// g must already be linked (see link_group in ir.h).
 void init_runtime(Runtime& rt, const IRGroup& g);
 
-RunResult run_group(Runtime& rt, TraceSink* trace, uint64_t max_ticks = 1'000'000);
+// Puts an initialised runtime back into its initial state (tick 0, initial
+// states, unset locals, empty channels) without reallocating any storage.
+void reset_runtime(Runtime& rt);
+
+// RoundRobin visits every schedule step each tick. ReadyQueue visits only
+// Running processes and parks blocked ones until a handoff wakes them; it
+// produces the same step order, traces and result. Pipelined runs
+// @pipeline_safe groups on worker threads (see parallel_scheduler.h).
+enum class SchedulerMode { RoundRobin, ReadyQueue, Pipelined };
+
+RunResult run_group(Runtime& rt, TraceSink* trace, uint64_t max_ticks = 1'000'000,
+                    SchedulerMode mode = SchedulerMode::RoundRobin);
+
+// Traces only what filter selects (see TraceFilter). The untraced and fully
+// traced loops are separate instantiations, so neither pays for the filter.
+RunResult run_group(Runtime& rt, TraceSink* trace, const TraceFilter& filter, uint64_t max_ticks = 1'000'000,
+                    SchedulerMode mode = SchedulerMode::RoundRobin);
 
 } // namespace caps
@@ -79,6 +79,14 @@ void Sema::check_group(GroupDecl& g) {
   bool pipeline_safe = has_annotation(g.annotations, "pipeline_safe");
   bool realtime_safe = has_annotation(g.annotations, "realtimesafe");
 
+  // @burst(K): iterations per step for self-looping poll states (AOT)
+  for (auto& a : g.annotations) {
+    if (a.name != "burst") continue;
+    bool count = a.args.size() == 1 && !a.args[0].empty() && a.args[0].size() <= 9 &&
+                 a.args[0].find_first_not_of("0123456789") == std::string::npos && std::stoul(a.args[0]) > 0;
+    if (!count) diag.error(a.pos, "@burst takes one positive iteration count: @burst(K)");
+  }
+
   // check each process
   for (auto& p : g.processes) {
     check_process(g, env, p);
@@ -386,28 +394,6 @@ void Sema::check_action(GroupDecl& g, GroupEnv& env, ProcessDecl& p,
   }
 }
 
-// Sema for new features
-Type* Sema::check_match_expr(const MatchExpr& expr) {
-  diag.error(expr.span, "match expressions not yet implemented");
-  return nullptr;
-}
-
-Type* Sema::check_array_expr(const ArrayExpr& expr) {
-  diag.error(expr.span, "array expressions not yet implemented");
-  return nullptr;
-}
-
-void Sema::check_for_loop(const ForLoop& loop) {
-  if (!is_compile_time_constant(loop.end.get())) {
-    diag.error(loop.span, "Loop end must be compile-time constant");
-  }
-}
-
-void Sema::check_const_fn(const ConstFnDecl& fn) {
-  // Ensure no side effects, only compile-time operations
-  diag.error(fn.pos, "const functions not yet implemented");
-}
-
 // Enhanced Sema for strong static analysis
 // Added: Type inference, lifetime analysis, borrow checking, determinism checks
 
@@ -25,6 +25,12 @@ struct Sema {
   void check(Program& p);
   void check_advanced(const Program& p);
 
+  // Passes run by the compiler driver after check(); no-ops for now.
+  void infer_types(Program& prog);
+  void check_lifetimes(Program& prog);
+  void borrow_check(Program& prog);
+  void determinism_check(Program& prog);
+
 private:
   Diag& diag;
 
@@ -49,7 +55,7 @@ private:
   bool has_annotation(const std::vector<Annotation>& anns, const std::string& name) const;
 
   // Example: Improved error reporting
-  void report_error(const Span& span, const std::string& msg, const std::string& suggestion) {
+  void report_error(SourcePos span, const std::string& msg, const std::string& suggestion) {
     diag.error(span, msg + " Suggestion: " + suggestion);
   }
 };
@@ -0,0 +1,127 @@
+#include "tools/sim_bridge.h"
+#include "analysis/pipeline.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static caps::IRExpr to_ir_expr(const Expr& e) {
+  using K = caps::IRExpr::Kind;
+  caps::IRExpr ie;
+  switch (e.kind) {
+    case Expr::Kind::Ident: {
+      if (e.text == "true" || e.text == "false") {
+        ie.kind = K::LitBool;
+        ie.lit_b = e.text == "true";
+        return ie;
+      }
+      return caps::IRExpr::var(e.text);
+    }
+    case Expr::Kind::IntLit: ie.kind = K::LitInt; ie.lit_i = std::stoll(e.text); return ie;
+    case Expr::Kind::RealLit: ie.kind = K::LitReal; ie.lit_r = std::stod(e.text); return ie;
+    case Expr::Kind::TextLit: ie.kind = K::LitText; ie.lit_s = e.text; return ie;
+    case Expr::Kind::Binary:
+      ie.kind = K::BinOp;
+      ie.op = e.text;
+      ie.args = {to_ir_expr(e.args.at(0)), to_ir_expr(e.args.at(1))};
+      return ie;
+    case Expr::Kind::Call:
+      ie.kind = K::Call;
+      ie.func_name = e.args.at(0).text;
+      for (size_t i = 1; i < e.args.size(); i++) ie.args.push_back(to_ir_expr(e.args[i]));
+      return ie;
+    case Expr::Kind::Try: break;
+  }
+  throw std::runtime_error("'?' is only supported as the whole right-hand side of an assignment");
+}
+
+static void to_ir_actions(const std::vector<Action>& in, std::vector<caps::IRAction>& out) {
+  using K = caps::IRAction::Kind;
+  for (auto& a : in) {
+    caps::IRAction ia;
+    switch (a.kind) {
+      case Action::Kind::DoStmt: {
+        const Stmt& st = a.stmt;
+        if (st.kind != Stmt::Kind::Assign && st.kind != Stmt::Kind::Let && st.kind != Stmt::Kind::Var) continue;
+        ia.dst = st.name;
+        if (st.expr.kind == Expr::Kind::Try) {
+          ia.kind = K::TryUnwrapAssign;
+          ia.expr = to_ir_expr(st.expr.args.at(0));
+        } else {
+          ia.kind = K::Assign;
+          ia.expr = to_ir_expr(st.expr);
+        }
+        break;
+      }
+      case Action::Kind::Send: ia.kind = K::Send; ia.chan = a.chan; ia.expr = to_ir_expr(a.send_expr); break;
+      case Action::Kind::Receive: ia.kind = K::Receive; ia.chan = a.chan; ia.dst = a.recv_target; break;
+      case Action::Kind::TrySend:
+        ia.kind = K::TrySend;
+        ia.chan = a.try_send_chan;
+        ia.dst = a.try_send_outvar;
+        ia.expr = to_ir_expr(a.try_send_expr);
+        break;
+      case Action::Kind::TryReceive: ia.kind = K::TryReceive; ia.chan = a.try_recv_chan; ia.dst = a.try_recv_outvar; break;
+    }
+    out.push_back(std::move(ia));
+  }
+}
+
+caps::IRGroup to_ir_group(const GroupDecl& g) {
+  caps::IRGroup out;
+  out.name = g.name;
+  for (auto& a : g.annotations) out.annotations.push_back(a.name);
+  for (auto& c : g.channels) out.channels.push_back({c.name, (size_t)std::max(c.capacity, 0), {}});
+  out.schedule.steps = g.schedule.steps;
+  out.schedule.repeat = g.schedule.repeat;
+
+  for (auto& pd : g.processes) {
+    caps::IRProcess p;
+    p.name = pd.name;
+    for (auto& in : pd.inputs) p.local_names.push_back(in.name);
+    for (auto& l : pd.locals) p.local_names.push_back(l.name);
+    for (auto& o : pd.outputs) p.output_names.push_back(o.name);
+
+    for (auto& ob : pd.on_blocks) {
+      caps::IRState& st = p.states[ob.state_name];
+      st.name = ob.state_name;
+      to_ir_actions(ob.actions, st.actions);
+      st.terminal = is_terminal_state(ob);
+      const Transition& tr = ob.transition;
+      if (tr.kind == Transition::Kind::Unconditional) {
+        st.transition.kind = caps::IRTransition::Kind::Goto;
+        st.transition.to_state = tr.to_state;
+      } else {
+        st.transition.kind = caps::IRTransition::Kind::IfElse;
+        st.transition.cond = to_ir_expr(tr.cond);
+        st.transition.then_state = tr.then_state;
+        st.transition.else_state = tr.else_state;
+        to_ir_actions(tr.then_actions, st.transition.then_actions);
+        to_ir_actions(tr.else_actions, st.transition.else_actions);
+      }
+    }
+    p.initial_state = !pd.states.empty() ? pd.states.front()
+                    : !pd.on_blocks.empty() ? pd.on_blocks.front().state_name : "";
+    out.processes.push_back(std::move(p));
+  }
+  return out;
+}
+
+std::vector<LocalInit> local_inits(const GroupDecl& g) {
+  using K = caps::IRExpr::Kind;
+  std::vector<LocalInit> out;
+  for (auto& pd : g.processes) {
+    for (auto& l : pd.locals) {
+      std::string name = pd.name + "." + l.name;
+      caps::IRExpr e = to_ir_expr(l.expr);
+      switch (e.kind) {
+        case K::LitInt: out.push_back({name, caps::Value::i(e.lit_i)}); break;
+        case K::LitBool: out.push_back({name, caps::Value::b(e.lit_b)}); break;
+        case K::LitReal: out.push_back({name, caps::Value::r(e.lit_r)}); break;
+        case K::LitText: out.push_back({name, caps::Value::s(e.lit_s)}); break;
+        default: throw std::runtime_error("initializer of " + name + " must be a literal");
+      }
+    }
+  }
+  return out;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "ast/ast.h"
+#include "backend/ir.h"
+#include "backend/value.h"
+#include <string>
+#include <vector>
+
+// Front end -> runtime IR for the tools that run checked programs on the
+// backend (caps_simulator). The checked AST maps onto caps::IRGroup directly:
+// a process starts in its first declared state, a state is terminal when
+// is_terminal_state() says so (as the pipeline checker counts it), and
+// `x = e?` becomes TryUnwrapAssign.
+caps::IRGroup to_ir_group(const GroupDecl& g);
+
+// The IR has no local initializers, so `var x:T = <literal>` comes back as a
+// slot value the caller seeds before each run. Throws on a non-literal
+// initializer.
+struct LocalInit {
+  std::string name; // "Process.var"
+  caps::Value value;
+};
+
+std::vector<LocalInit> local_inits(const GroupDecl& g);
@@ -1,9 +1,10 @@
 #include "backend/trace.h"
 #include <sstream>
+#include <stdexcept>
 
 namespace caps {
 
-static std::string buf_to_string(const std::deque<Value>& b) {
+static std::string buf_to_string(ChannelView b) {
   std::ostringstream os;
   os << "[";
   for (size_t i=0;i<b.size();i++){
@@ -14,7 +15,21 @@ static std::string buf_to_string(const std::deque<Value>& b) {
   return os.str();
 }
 
-static const char* status_str(ProcStatus st) {
+const char* block_op(BlockReason r) {
+  return r == BlockReason::UnbufferedNoReceiver || r == BlockReason::ChannelFull ? "send" : "receive";
+}
+
+const char* block_reason_text(BlockReason r) {
+  switch (r) {
+    case BlockReason::UnbufferedNoReceiver: return "unbuffered_no_receiver";
+    case BlockReason::ChannelFull: return "channel_full";
+    case BlockReason::UnbufferedNoValue: return "unbuffered_no_value";
+    case BlockReason::ChannelEmpty: return "channel_empty";
+  }
+  return "?";
+}
+
+const char* proc_status_text(ProcStatus st) {
   switch (st) {
     case ProcStatus::Running: return "Running";
     case ProcStatus::Blocked: return "Blocked";
@@ -23,96 +38,185 @@ static const char* status_str(ProcStatus st) {
   return "?";
 }
 
-void TextTrace::on_tick_begin(uint64_t tick) {
+TraceFilter make_trace_filter(const IRGroup& g, const std::vector<std::string>& names) {
+  TraceFilter f;
+  f.procs.assign(g.processes.size(), 0);
+  f.channels.assign(g.channels.size(), 0);
+  for (auto& n : names) {
+    bool found = false;
+    for (size_t i = 0; i < g.processes.size(); i++) {
+      if (g.processes[i].name == n) f.procs[i] = found = true;
+    }
+    for (size_t i = 0; i < g.channels.size(); i++) {
+      if (g.channels[i].name == n) f.channels[i] = found = true;
+    }
+    if (!found) throw std::runtime_error("trace filter: unknown process or channel: " + n);
+  }
+  return f;
+}
+
+// --- TextTraceFormat ---
+
+void TextTraceFormat::tick_begin(uint64_t tick) {
   out << "TICK " << tick << "\n";
 }
 
-void TextTrace::on_tick_end(uint64_t) {
+void TextTraceFormat::tick_end() {
   out << "END_TICK\n\n";
 }
 
-void TextTrace::on_process_step_begin(uint64_t, const std::string& proc, const std::string& state_before) {
+void TextTraceFormat::step_begin(const std::string& proc, const std::string& state_before) {
   out << "  PROCESS_STEP " << proc << "\n";
   out << "    state_before: " << state_before << "\n";
   out << "    actions:\n";
 }
 
-void TextTrace::on_process_step_end(uint64_t, const std::string&, const std::string& state_after, ProcStatus st) {
+void TextTraceFormat::step_end(const std::string& state_after, ProcStatus st) {
   out << "    state_after: " << state_after << "\n";
-  out << "    status_after: " << status_str(st) << "\n\n";
+  out << "    status_after: " << proc_status_text(st) << "\n\n";
 }
 
-void TextTrace::on_assign(const std::string&, const std::string& var, const Value& before, const Value& after) {
+void TextTraceFormat::assign(const std::string& var, const std::string& before, const std::string& after) {
   out << "      - kind: assign\n";
   out << "        var: " << var << "\n";
-  out << "        before: " << to_string(before) << "\n";
-  out << "        after: " << to_string(after) << "\n";
+  out << "        before: " << before << "\n";
+  out << "        after: " << after << "\n";
 }
 
-void TextTrace::on_send_begin(const std::string&, const std::string& chan, const Value& v, const std::deque<Value>& buf_before) {
+void TextTraceFormat::send_begin(const std::string& chan, const std::string& value, const std::string& buf_before) {
   out << "      - kind: send\n";
   out << "        channel: " << chan << "\n";
-  out << "        value: " << to_string(v) << "\n";
-  out << "        channelbufferbefore: " << buf_to_string(buf_before) << "\n";
+  out << "        value: " << value << "\n";
+  out << "        channelbufferbefore: " << buf_before << "\n";
 }
 
-void TextTrace::on_send_end(const std::string&, const std::string&, const std::deque<Value>& buf_after) {
-  out << "        channelbufferafter: " << buf_to_string(buf_after) << "\n";
+void TextTraceFormat::send_end(const std::string& buf_after) {
+  out << "        channelbufferafter: " << buf_after << "\n";
 }
 
-void TextTrace::on_receive_begin(const std::string&, const std::string& chan, const std::deque<Value>& buf_before) {
+void TextTraceFormat::receive_begin(const std::string& chan, const std::string& buf_before) {
   out << "      - kind: receive\n";
   out << "        channel: " << chan << "\n";
-  out << "        channelbufferbefore: " << buf_to_string(buf_before) << "\n";
+  out << "        channelbufferbefore: " << buf_before << "\n";
 }
 
-void TextTrace::on_receive_end(const std::string&, const std::string&, const Value& v, const std::deque<Value>& buf_after) {
-  out << "        value: " << to_string(v) << "\n";
-  out << "        channelbufferafter: " << buf_to_string(buf_after) << "\n";
+void TextTraceFormat::receive_end(const std::string& value, const std::string& buf_after) {
+  out << "        value: " << value << "\n";
+  out << "        channelbufferafter: " << buf_after << "\n";
 }
 
-void TextTrace::on_try_send(const std::string&, const std::string& chan, const Value& v, bool success, const std::deque<Value>& buf_after) {
+void TextTraceFormat::try_send(const std::string& chan, const std::string& value, bool success, const std::string& buf_after) {
   out << "      - kind: try_send\n";
   out << "        channel: " << chan << "\n";
-  out << "        value: " << to_string(v) << "\n";
+  out << "        value: " << value << "\n";
   out << "        success: " << (success ? "true":"false") << "\n";
-  out << "        channelbufferafter: " << buf_to_string(buf_after) << "\n";
+  out << "        channelbufferafter: " << buf_after << "\n";
 }
 
-void TextTrace::on_try_receive(const std::string&, const std::string& chan, bool ok, const Value& v, const std::deque<Value>& buf_after) {
+void TextTraceFormat::try_receive(const std::string& chan, bool ok, const std::string& value, const std::string& buf_after) {
   out << "      - kind: try_receive\n";
   out << "        channel: " << chan << "\n";
   out << "        ok: " << (ok ? "true":"false") << "\n";
-  out << "        value: " << to_string(v) << "\n";
-  out << "        channelbufferafter: " << buf_to_string(buf_after) << "\n";
+  out << "        value: " << value << "\n";
+  out << "        channelbufferafter: " << buf_after << "\n";
 }
 
-void TextTrace::on_block(const std::string&, const std::string& op, const std::string& chan, const std::string& reason) {
+void TextTraceFormat::block(BlockReason reason, const std::string& chan) {
   out << "        blocked: true\n";
-  out << "        op: " << op << "\n";
+  out << "        op: " << block_op(reason) << "\n";
   out << "        channel: " << chan << "\n";
-  out << "        reason: " << reason << "\n";
+  out << "        reason: " << block_reason_text(reason) << "\n";
 }
 
-void TextTrace::on_transition_skipped(uint64_t, const std::string&, const std::string& reason) {
+void TextTraceFormat::transition_skipped(const std::string& reason) {
   out << "    transition:\n";
   out << "      kind: skipped\n";
   out << "      reason: " << reason << "\n";
 }
 
-void TextTrace::on_status(const std::string& status, const std::string& reason, const Runtime& rt) {
+void TextTraceFormat::status_begin(const std::string& status, const std::string& reason) {
   out << "RUNTIME_STATUS\n";
   out << "  status: " << status << "\n";
   out << "  reason: " << reason << "\n";
   out << "  processes:\n";
-  for (auto& kv : rt.procs) {
-    out << "    " << kv.first << ": state=" << kv.second.state << " status=" << status_str(kv.second.status) << "\n";
-  }
+}
+
+void TextTraceFormat::status_proc(const std::string& proc, const std::string& state, ProcStatus st) {
+  out << "    " << proc << ": state=" << state << " status=" << proc_status_text(st) << "\n";
+}
+
+void TextTraceFormat::status_channels() {
   out << "  channels:\n";
-  for (auto& kv : rt.channels) {
-    out << "    " << kv.first << ": buffer=" << buf_to_string(kv.second.buffer) << "\n";
-  }
+}
+
+void TextTraceFormat::status_channel(const std::string& chan, const std::string& buf) {
+  out << "    " << chan << ": buffer=" << buf << "\n";
+}
+
+void TextTraceFormat::status_end() {
   out << "END_STATUS\n";
 }
 
+// --- TextTrace ---
+
+void TextTrace::on_tick_begin(uint64_t tick) {
+  fmt.tick_begin(tick);
+}
+
+void TextTrace::on_tick_end(uint64_t) {
+  fmt.tick_end();
+}
+
+void TextTrace::on_process_step_begin(uint64_t, const ProcessInstance& p) {
+  fmt.step_begin(p.name, p.state_name());
+}
+
+void TextTrace::on_process_step_end(uint64_t, const ProcessInstance& p) {
+  fmt.step_end(p.state_name(), p.status);
+}
+
+void TextTrace::on_assign(const ProcessInstance& p, uint32_t slot, const Value& before, const Value& after) {
+  fmt.assign(p.def->slot_names[slot], to_string(before), to_string(after));
+}
+
+void TextTrace::on_send_begin(const ProcessInstance&, const Channel& c, const Value& v) {
+  fmt.send_begin(c.name, to_string(v), buf_to_string(c.view()));
+}
+
+void TextTrace::on_send_end(const ProcessInstance&, const Channel& c) {
+  fmt.send_end(buf_to_string(c.view()));
+}
+
+void TextTrace::on_receive_begin(const ProcessInstance&, const Channel& c) {
+  fmt.receive_begin(c.name, buf_to_string(c.view()));
+}
+
+void TextTrace::on_receive_end(const ProcessInstance&, const Channel& c, const Value& v) {
+  fmt.receive_end(to_string(v), buf_to_string(c.view()));
+}
+
+void TextTrace::on_try_send(const ProcessInstance&, const Channel& c, const Value& v, bool success) {
+  fmt.try_send(c.name, to_string(v), success, buf_to_string(c.view()));
+}
+
+void TextTrace::on_try_receive(const ProcessInstance&, const Channel& c, bool ok, const Value& v) {
+  fmt.try_receive(c.name, ok, to_string(v), buf_to_string(c.view()));
+}
+
+void TextTrace::on_block(const ProcessInstance&, const Channel& c, BlockReason reason) {
+  fmt.block(reason, c.name);
+}
+
+void TextTrace::on_transition_skipped(uint64_t, const ProcessInstance&, const char* reason) {
+  fmt.transition_skipped(reason);
+}
+
+void TextTrace::on_status(const std::string& status, const std::string& reason, const Runtime& rt) {
+  fmt.status_begin(status, reason);
+  for (auto& p : rt.procs) fmt.status_proc(p.name, p.state_name(), p.status);
+  fmt.status_channels();
+  for (auto& c : rt.channels) fmt.status_channel(c.name, buf_to_string(c.view()));
+  fmt.status_end();
+}
+
 } // namespace caps
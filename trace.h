@@ -2,68 +2,144 @@
 #include "backend/value.h"
 #include "backend/channel.h"
 #include "backend/runtime.h"
-#include <deque>
 #include <ostream>
 #include <string>
 #include <vector>
 
 namespace caps {
 
+enum class BlockReason : uint8_t { UnbufferedNoReceiver, ChannelFull, UnbufferedNoValue, ChannelEmpty };
+
+const char* block_op(BlockReason r);          // "send" / "receive"
+const char* block_reason_text(BlockReason r); // e.g. "channel_full"
+const char* proc_status_text(ProcStatus st);  // "Running" / "Blocked" / "Finished"
+
+// Callbacks identify processes and channels by their runtime objects, so a
+// sink can key on ProcessInstance::id / Channel::id and read names, states and
+// buffers (Channel::view, as of the call) only when it needs them.
 struct TraceSink {
   virtual ~TraceSink() = default;
 
   virtual void on_tick_begin(uint64_t tick) = 0;
   virtual void on_tick_end(uint64_t tick) = 0;
 
-  virtual void on_process_step_begin(uint64_t tick, const std::string& proc, const std::string& state_before) = 0;
-  virtual void on_process_step_end(uint64_t tick, const std::string& proc, const std::string& state_after, ProcStatus st) = 0;
+  // state before / after and the status after are read off p
+  virtual void on_process_step_begin(uint64_t tick, const ProcessInstance& p) = 0;
+  virtual void on_process_step_end(uint64_t tick, const ProcessInstance& p) = 0;
 
-  virtual void on_assign(const std::string& proc, const std::string& var, const Value& before, const Value& after) = 0;
+  // slot indexes p.def->slot_names
+  virtual void on_assign(const ProcessInstance& p, uint32_t slot, const Value& before, const Value& after) = 0;
 
-  virtual void on_send_begin(const std::string& proc, const std::string& chan, const Value& v, const std::deque<Value>& buf_before) = 0;
-  virtual void on_send_end(const std::string& proc, const std::string& chan, const std::deque<Value>& buf_after) = 0;
+  virtual void on_send_begin(const ProcessInstance& p, const Channel& c, const Value& v) = 0;
+  virtual void on_send_end(const ProcessInstance& p, const Channel& c) = 0;
 
-  virtual void on_receive_begin(const std::string& proc, const std::string& chan, const std::deque<Value>& buf_before) = 0;
-  virtual void on_receive_end(const std::string& proc, const std::string& chan, const Value& v, const std::deque<Value>& buf_after) = 0;
+  virtual void on_receive_begin(const ProcessInstance& p, const Channel& c) = 0;
+  virtual void on_receive_end(const ProcessInstance& p, const Channel& c, const Value& v) = 0;
 
-  virtual void on_try_send(const std::string& proc, const std::string& chan, const Value& v, bool success, const std::deque<Value>& buf_after) = 0;
-  virtual void on_try_receive(const std::string& proc, const std::string& chan, bool ok, const Value& v, const std::deque<Value>& buf_after) = 0;
+  virtual void on_try_send(const ProcessInstance& p, const Channel& c, const Value& v, bool success) = 0;
+  virtual void on_try_receive(const ProcessInstance& p, const Channel& c, bool ok, const Value& v) = 0;
 
-  virtual void on_block(const std::string& proc, const std::string& op, const std::string& chan, const std::string& reason) = 0;
+  virtual void on_block(const ProcessInstance& p, const Channel& c, BlockReason reason) = 0;
 
-  virtual void on_transition_skipped(uint64_t tick, const std::string& proc, const std::string& reason) = 0;
+  virtual void on_transition_skipped(uint64_t tick, const ProcessInstance& p, const char* reason) = 0;
 
   virtual void on_status(const std::string& status, const std::string& reason, const Runtime& rt) = 0;
 };
 
+// Which events a FilteredTrace passes on: everything a selected process does,
+// and every event on a selected channel. Indexed by ProcessInstance::id and
+// Channel::id; nonzero = selected.
+struct TraceFilter {
+  std::vector<uint8_t> procs;
+  std::vector<uint8_t> channels;
+
+  bool has_proc(uint32_t id) const { return id < procs.size() && procs[id]; }
+  bool has_channel(uint32_t id) const { return id < channels.size() && channels[id]; }
+};
+
+// Selects the named processes and channels of g; throws std::runtime_error
+// for a name that is neither.
+TraceFilter make_trace_filter(const IRGroup& g, const std::vector<std::string>& names);
+
+// Compile-time trace policies for the step loop (see step_process in exec.h).
+// Event sites read `if (T::enabled && t.proc(p)) t.sink->...`, so under
+// NoTrace the checks and the argument building compile away.
+struct NoTrace {
+  static constexpr bool enabled = false;
+  TraceSink* sink = nullptr;
+  bool proc(const ProcessInstance&) const { return false; }
+  bool chan(const ProcessInstance&, const Channel&) const { return false; }
+};
+
+struct FullTrace {
+  static constexpr bool enabled = true;
+  TraceSink* sink = nullptr;
+  bool proc(const ProcessInstance&) const { return true; }
+  bool chan(const ProcessInstance&, const Channel&) const { return true; }
+};
+
+struct FilteredTrace {
+  static constexpr bool enabled = true;
+  TraceSink* sink = nullptr;
+  const TraceFilter* filter = nullptr;
+  bool proc(const ProcessInstance& p) const { return filter->has_proc(p.id); }
+  bool chan(const ProcessInstance& p, const Channel& c) const { return filter->has_proc(p.id) || filter->has_channel(c.id); }
+};
+
+// The text trace layout, on values and buffers that are already formatted
+// (to_string, "[a, b]"). TextTrace and the binary trace decoder both print
+// through this, so they cannot drift apart.
+struct TextTraceFormat {
+  std::ostream& out;
+
+  void tick_begin(uint64_t tick);
+  void tick_end();
+  void step_begin(const std::string& proc, const std::string& state_before);
+  void step_end(const std::string& state_after, ProcStatus st);
+  void assign(const std::string& var, const std::string& before, const std::string& after);
+  void send_begin(const std::string& chan, const std::string& value, const std::string& buf_before);
+  void send_end(const std::string& buf_after);
+  void receive_begin(const std::string& chan, const std::string& buf_before);
+  void receive_end(const std::string& value, const std::string& buf_after);
+  void try_send(const std::string& chan, const std::string& value, bool success, const std::string& buf_after);
+  void try_receive(const std::string& chan, bool ok, const std::string& value, const std::string& buf_after);
+  void block(BlockReason reason, const std::string& chan);
+  void transition_skipped(const std::string& reason);
+  void status_begin(const std::string& status, const std::string& reason); // through "processes:"
+  void status_proc(const std::string& proc, const std::string& state, ProcStatus st);
+  void status_channels();
+  void status_channel(const std::string& chan, const std::string& buf);
+  void status_end();
+};
+
 struct TextTrace : TraceSink {
-  explicit TextTrace(std::ostream& os) : out(os) {}
+  explicit TextTrace(std::ostream& os) : fmt{os} {}
 
   void on_tick_begin(uint64_t tick) override;
   void on_tick_end(uint64_t tick) override;
 
-  void on_process_step_begin(uint64_t tick, const std::string& proc, const std::string& state_before) override;
-  void on_process_step_end(uint64_t tick, const std::string& proc, const std::string& state_after, ProcStatus st) override;
+  void on_process_step_begin(uint64_t tick, const ProcessInstance& p) override;
+  void on_process_step_end(uint64_t tick, const ProcessInstance& p) override;
 
-  void on_assign(const std::string& proc, const std::string& var, const Value& before, const Value& after) override;
+  void on_assign(const ProcessInstance& p, uint32_t slot, const Value& before, const Value& after) override;
 
-  void on_send_begin(const std::string& proc, const std::string& chan, const Value& v, const std::deque<Value>& buf_before) override;
-  void on_send_end(const std::string& proc, const std::string& chan, const std::deque<Value>& buf_after) override;
+  void on_send_begin(const ProcessInstance& p, const Channel& c, const Value& v) override;
+  void on_send_end(const ProcessInstance& p, const Channel& c) override;
 
-  void on_receive_begin(const std::string& proc, const std::string& chan, const std::deque<Value>& buf_before) override;
-  void on_receive_end(const std::string& proc, const std::string& chan, const Value& v, const std::deque<Value>& buf_after) override;
+  void on_receive_begin(const ProcessInstance& p, const Channel& c) override;
+  void on_receive_end(const ProcessInstance& p, const Channel& c, const Value& v) override;
 
-  void on_try_send(const std::string& proc, const std::string& chan, const Value& v, bool success, const std::deque<Value>& buf_after) override;
-  void on_try_receive(const std::string& proc, const std::string& chan, bool ok, const Value& v, const std::deque<Value>& buf_after) override;
+  void on_try_send(const ProcessInstance& p, const Channel& c, const Value& v, bool success) override;
+  void on_try_receive(const ProcessInstance& p, const Channel& c, bool ok, const Value& v) override;
 
-  void on_block(const std::string& proc, const std::string& op, const std::string& chan, const std::string& reason) override;
+  void on_block(const ProcessInstance& p, const Channel& c, BlockReason reason) override;
 
-  void on_transition_skipped(uint64_t tick, const std::string& proc, const std::string& reason) override;
+  void on_transition_skipped(uint64_t tick, const ProcessInstance& p, const char* reason) override;
 
   void on_status(const std::string& status, const std::string& reason, const Runtime& rt) override;
 
 private:
-  std::ostream& out;
+  TextTraceFormat fmt;
 };
 
 } // namespace caps
@@ -0,0 +1,173 @@
+#include "backend/trace_diff.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace caps {
+
+static bool same_group(const BinaryTraceReader& a, const BinaryTraceReader& b) {
+  if (a.channel_names() != b.channel_names() || a.procs().size() != b.procs().size()) return false;
+  for (size_t i = 0; i < a.procs().size(); i++) {
+    auto& x = a.procs()[i];
+    auto& y = b.procs()[i];
+    if (x.name != y.name || x.states != y.states || x.slots != y.slots) return false;
+  }
+  return true;
+}
+
+// ChannelSnapshots and Resyncs only rebuild buffers, and where they fall
+// depends on buffering, chunking and filtering, not on the run.
+static bool next_event(BinaryTraceReader& r) {
+  while (r.next()) {
+    TraceOp op = r.event().rec.op;
+    if (op != TraceOp::ChannelSnapshot && op != TraceOp::Resync) return true;
+  }
+  return false;
+}
+
+// The offset of the first byte where a and b differ, n if none does.
+static size_t first_difference(const uint8_t* a, const uint8_t* b, size_t n) {
+  constexpr size_t kBlock = 4096;
+  size_t at = 0;
+  while (at < n) {
+    size_t k = std::min(kBlock, n - at);
+    if (std::memcmp(a + at, b + at, k) != 0) return (size_t)(std::mismatch(a + at, a + at + k, b + at).first - a);
+    at += k;
+  }
+  return n;
+}
+
+static std::string event_text(const BinaryTraceReader& r) {
+  std::ostringstream os;
+  TextTraceFormat fmt{os};
+  format_trace_event(r, fmt);
+  return os.str();
+}
+
+static bool same_event(const BinaryTraceReader& a, const BinaryTraceReader& b, bool same_mode) {
+  if (!same_mode) return event_text(a) == event_text(b);
+  return a.record_size() == b.record_size() && std::memcmp(a.record_data(), b.record_data(), a.record_size()) == 0;
+}
+
+TraceDiff diff_traces(const uint8_t* a, size_t na, const uint8_t* b, size_t nb, size_t context) {
+  TraceDiff d;
+  BinaryTraceReader ra(a, na), rb(b, nb);
+  if (!same_group(ra, rb)) {
+    d.equal = false;
+    d.reason = "traces are of different groups";
+    return d;
+  }
+  const bool same_mode = ra.mode() == rb.mode();
+
+  // Skip what memcmp shows to be identical. Decoding then starts at the last
+  // resync point before the first differing byte (the same record in both)
+  // or at the last identical chunk, whose first tick is the same in both.
+  bool from_start = true;
+  uint64_t start_tick = 0;
+  size_t start_record = 0;
+  if (same_mode && ra.layout() == TraceLayout::Stream && rb.layout() == TraceLayout::Stream) {
+    size_t at = first_difference(a, b, std::min(na, nb));
+    d.bytes_compared = at;
+    if (at == na && at == nb) return d;
+    start_record = ra.resync_before(at);
+    if (start_record == rb.resync_before(at)) from_start = false;
+  } else if (same_mode && ra.layout() == TraceLayout::Chunked && rb.layout() == TraceLayout::Chunked) {
+    auto& ca = ra.chunks();
+    auto& cb = rb.chunks();
+    size_t k = 0;
+    for (; k < ca.size() && k < cb.size(); k++) {
+      auto& x = ca[k];
+      auto& y = cb[k];
+      if (x.first_tick != y.first_tick || x.codec != y.codec || x.stored != y.stored ||
+          std::memcmp(a + x.offset, b + y.offset, x.stored) != 0)
+        break;
+      d.bytes_compared += x.stored;
+    }
+    if (k == ca.size() && k == cb.size()) return d;
+    // chunk 0 may hold records before its first tick, so it is read from the start
+    if (k > 1) {
+      from_start = false;
+      start_tick = ca[k - 1].first_tick;
+    }
+  }
+
+  auto rewind = [&](BinaryTraceReader& r) {
+    if (from_start) return;
+    if (r.layout() == TraceLayout::Stream) r.seek_record(start_record);
+    else if (!r.seek(start_tick)) throw std::runtime_error("binary trace: index does not match records");
+  };
+  rewind(ra);
+  rewind(rb);
+
+  uint64_t n = 0;      // events since the start point
+  int64_t stepping = -1;
+  bool ha, hb;
+  for (;; n++) {
+    ha = next_event(ra);
+    hb = next_event(rb);
+    if (!ha && !hb) return d; // same events, stored differently
+    if (ha && hb && same_event(ra, rb, same_mode)) {
+      const BinaryTraceRecord& rec = ra.event().rec;
+      if (rec.op == TraceOp::StepBegin) stepping = rec.proc;
+      else if (rec.op == TraceOp::StepEnd || rec.op == TraceOp::TickBegin) stepping = -1;
+      continue;
+    }
+
+    d.equal = false;
+    d.reason = !ha ? "a ends first" : !hb ? "b ends first" : "events differ";
+    const BinaryTraceReader& at = ha ? ra : rb;
+    const BinaryTraceRecord& rec = at.event().rec;
+    d.tick = at.event().tick;
+    if (rec.op == TraceOp::StepBegin || rec.op == TraceOp::StepEnd) stepping = rec.proc;
+    if (stepping >= 0) d.proc = at.proc_name((uint32_t)stepping);
+    if (ha) d.expected = event_text(ra);
+    if (hb) d.actual = event_text(rb);
+    break;
+  }
+
+  // Context: decode a again up to the divergence, formatting only the tail.
+  if (context) {
+    BinaryTraceReader rc(a, na);
+    if (!from_start && ra.layout() == TraceLayout::Stream) {
+      // too few events since the resync point: start from earlier ones
+      const uint8_t* stop = ha ? ra.record_data() : a + na;
+      auto events_from = [&](size_t at) {
+        rc.seek_record(at);
+        uint64_t k = 0;
+        while (next_event(rc) && rc.record_data() < stop) k++;
+        return k;
+      };
+      while (n < context) {
+        size_t before = rc.resync_before(start_record);
+        if (before == start_record) break;
+        start_record = before;
+        n = events_from(start_record);
+      }
+    }
+    rewind(rc);
+    uint64_t first = n > context ? n - context : 0;
+    for (uint64_t i = 0; i < n && next_event(rc); i++) {
+      if (i >= first) d.context.push_back(event_text(rc));
+    }
+  }
+  return d;
+}
+
+void print_trace_diff(const TraceDiff& d, std::ostream& out) {
+  if (d.equal) {
+    out << "traces are identical\n";
+    return;
+  }
+  out << "traces diverge at tick " << d.tick;
+  if (!d.proc.empty()) out << " in process " << d.proc;
+  out << ": " << d.reason << "\n";
+  if (!d.context.empty()) {
+    out << "context:\n";
+    for (auto& e : d.context) out << e;
+  }
+  out << "--- a\n" << (d.expected.empty() ? "(end of trace)\n" : d.expected);
+  out << "+++ b\n" << (d.actual.empty() ? "(end of trace)\n" : d.actual);
+}
+
+} // namespace caps
@@ -0,0 +1,38 @@
+#pragma once
+#include "backend/binary_trace.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace caps {
+
+// The first point where two binary traces of the same group disagree.
+struct TraceDiff {
+  bool equal = true;
+  std::string reason;   // what differs, when !equal
+  uint64_t tick = 0;    // of the first divergent event
+  std::string proc;     // process stepping at it ("" outside a step)
+  std::string expected; // the event in a, as TextTrace prints it ("" past the end)
+  std::string actual;   // the event in b
+  std::vector<std::string> context; // events just before it, the same in both
+  uint64_t bytes_compared = 0;      // by memcmp, without decoding
+};
+
+// Compares trace b against trace a (either ChannelTrace mode, either
+// TraceLayout). Identical stretches are found with memcmp over the stored
+// bytes, Stream traces up to the first differing byte or Chunked traces chunk
+// by chunk, so traces that agree are compared at memory speed. Records are
+// decoded only from the last resync point before that byte or the last
+// identical chunk on (or from the start), and compared one by one: as stored
+// bytes if both use the same ChannelTrace mode, as text otherwise; context
+// reaches back to that point at most. ChannelSnapshot and Resync records are
+// not events and are skipped. Throws std::runtime_error if either is not a
+// trace.
+TraceDiff diff_traces(const uint8_t* a, size_t na, const uint8_t* b, size_t nb, size_t context = 8);
+
+// "traces are identical", or where they diverge with the context.
+void print_trace_diff(const TraceDiff& d, std::ostream& out);
+
+} // namespace caps
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
 #include <optional>
 
 #include "ast/ast.h"
@@ -10,11 +11,11 @@ struct Type {
 
   // Channel<T;N>
   std::optional<int> chan_cap;
-  std::unique_ptr<Type> elem;
+  std::shared_ptr<const Type> elem;
 
   // Result<T,E>
-  std::unique_ptr<Type> ok;
-  std::unique_ptr<Type> err;
+  std::shared_ptr<const Type> ok;
+  std::shared_ptr<const Type> err;
 
   static Type Int() { Type t; t.kind=Kind::Int; return t; }
   static Type Bool() { Type t; t.kind=Kind::Bool; return t; }
@@ -24,15 +25,15 @@ struct Type {
 
   static Type Channel(Type elem, int cap) {
     Type t; t.kind=Kind::Channel;
-    t.elem = std::make_unique<Type>(std::move(elem));
+    t.elem = std::make_shared<const Type>(std::move(elem));
     t.chan_cap = cap;
     return t;
   }
 
   static Type Result(Type ok, Type err) {
     Type t; t.kind=Kind::Result;
-    t.ok = std::make_unique<Type>(std::move(ok));
-    t.err = std::make_unique<Type>(std::move(err));
+    t.ok = std::make_shared<const Type>(std::move(ok));
+    t.err = std::make_shared<const Type>(std::move(err));
     return t;
   }
 };
@@ -1,4 +1,6 @@
 #include "backend/value.h"
+#include <cstring>
+#include <mutex>
 #include <sstream>
 
 namespace caps {
@@ -15,102 +17,312 @@ static std::string esc(const std::string& s) {
   return out;
 }
 
+void Value::release() {
+  if (u.box->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+  switch (tag == ValueTag::Result ? sub : tag) {
+    case ValueTag::Text: delete static_cast<Box<std::string>*>(u.box); break;
+    case ValueTag::Record: delete static_cast<Box<Record>*>(u.box); break;
+    case ValueTag::Array: delete static_cast<Box<Array>*>(u.box); break;
+    case ValueTag::Tuple: delete static_cast<Box<Tuple>*>(u.box); break;
+    case ValueTag::Result: delete static_cast<Box<Value>*>(u.box); break;
+    default: break;
+  }
+}
+
+void value_type_error(const char* what) {
+  throw std::runtime_error(what);
+}
+
+// Error-code intern table. Codes are stable for the life of the process.
+// Texts live in fixed-size chunks that never move, published by a release
+// store of `count`: error_text reads without locking, intern_error locks only
+// to look up or add a code.
+namespace {
+constexpr uint32_t kErrChunkBits = 8;
+constexpr uint32_t kErrChunk = 1u << kErrChunkBits;
+constexpr uint32_t kErrMaxChunks = 1u << 12;
+
+struct ErrorTable {
+  std::mutex mu;
+  std::unordered_map<std::string, uint32_t> codes;
+  std::atomic<std::string*> chunks[kErrMaxChunks] = {};
+  std::atomic<uint32_t> count{0};
+
+  ErrorTable() {
+    add(""); // kErrNone: the text of an ok Result, never looked up by intern_error
+    codes.emplace("empty", add("empty"));
+  }
+  ~ErrorTable() {
+    for (auto& c : chunks) delete[] c.load(std::memory_order_relaxed);
+  }
+
+  // caller holds mu (or is the constructor)
+  uint32_t add(const std::string& text) {
+    uint32_t code = count.load(std::memory_order_relaxed);
+    if ((code >> kErrChunkBits) >= kErrMaxChunks) throw std::runtime_error("too many error codes");
+    auto& slot = chunks[code >> kErrChunkBits];
+    std::string* chunk = slot.load(std::memory_order_relaxed);
+    if (!chunk) {
+      chunk = new std::string[kErrChunk];
+      slot.store(chunk, std::memory_order_relaxed);
+    }
+    chunk[code & (kErrChunk - 1)] = text;
+    count.store(code + 1, std::memory_order_release);
+    return code;
+  }
+};
+
+ErrorTable& error_table() {
+  static ErrorTable t;
+  return t;
+}
+}
+
+uint32_t intern_error(const std::string& text) {
+  auto& t = error_table();
+  std::lock_guard<std::mutex> lock(t.mu);
+  auto it = t.codes.find(text);
+  if (it != t.codes.end()) return it->second;
+  uint32_t code = t.add(text);
+  t.codes.emplace(text, code);
+  return code;
+}
+
+const std::string& error_text(uint32_t code) {
+  auto& t = error_table();
+  if (code >= t.count.load(std::memory_order_acquire)) throw std::runtime_error("unknown error code");
+  return t.chunks[code >> kErrChunkBits].load(std::memory_order_relaxed)[code & (kErrChunk - 1)];
+}
+
 std::string to_string(const Value& x) {
   std::ostringstream os;
 
-  if (std::holds_alternative<std::monostate>(x.v)) return "(unset)";
-  if (auto p = std::get_if<int64_t>(&x.v)) { os << *p; return os.str(); }
-  if (auto p = std::get_if<bool>(&x.v)) { os << (*p ? "true":"false"); return os.str(); }
-  if (auto p = std::get_if<double>(&x.v)) { os << *p; return os.str(); }
-  if (auto p = std::get_if<std::string>(&x.v)) { os << "\"" << esc(*p) << "\""; return os.str(); }
-
-  if (auto p = std::get_if<Record>(&x.v)) {
-    os << "{";
-    bool first = true;
-    for (auto& kv : p->fields) {
-      if (!first) os << ", ";
-      first = false;
-      os << kv.first << "=" << to_string(kv.second);
+  switch (x.tag) {
+    case ValueTag::Unset: return "(unset)";
+    case ValueTag::Int: os << x.u.i; return os.str();
+    case ValueTag::Bool: os << (x.u.b ? "true":"false"); return os.str();
+    case ValueTag::Real: os << x.u.r; return os.str();
+    case ValueTag::Result:
+      // same field order the Record-based encoding printed
+      os << "{error=\"" << esc(error_text(x.err)) << "\", value=" << to_string(result_payload(x))
+         << ", ok=" << (x.err == kErrNone ? "true" : "false") << "}";
+      return os.str();
+    case ValueTag::Text: os << "\"" << esc(x.unbox<std::string>()) << "\""; return os.str();
+
+    case ValueTag::Record: {
+      os << "{";
+      bool first = true;
+      for (auto& kv : x.unbox<Record>().fields) {
+        if (!first) os << ", ";
+        first = false;
+        os << kv.first << "=" << to_string(kv.second);
+      }
+      os << "}";
+      return os.str();
     }
-    os << "}";
-    return os.str();
-  }
 
-  if (auto p = std::get_if<Array>(&x.v)) {
-    os << "[";
-    for (size_t i=0;i<p->elems.size();i++){
-      if (i) os << ", ";
-      os << to_string(p->elems[i]);
+    case ValueTag::Array: {
+      auto& elems = x.unbox<Array>().elems;
+      os << "[";
+      for (size_t i=0;i<elems.size();i++){
+        if (i) os << ", ";
+        os << to_string(elems[i]);
+      }
+      os << "]";
+      return os.str();
     }
-    os << "]";
-    return os.str();
-  }
 
-  if (auto p = std::get_if<Tuple>(&x.v)) {
-    os << "(";
-    for (size_t i=0;i<p->elems.size();i++){
-      if (i) os << ", ";
-      os << to_string(p->elems[i]);
+    case ValueTag::Tuple: {
+      auto& elems = x.unbox<Tuple>().elems;
+      os << "(";
+      for (size_t i=0;i<elems.size();i++){
+        if (i) os << ", ";
+        os << to_string(elems[i]);
+      }
+      os << ")";
+      return os.str();
     }
-    os << ")";
-    return os.str();
   }
 
   return "(unknown)";
 }
 
-bool is_truthy(const Value& x) {
-  if (auto p = std::get_if<bool>(&x.v)) return *p;
-  throw std::runtime_error("truthiness requires bool");
-}
+void encode_value(std::vector<uint8_t>& out, const Value& x) {
+  auto put = [&](const void* p, size_t n) {
+    size_t at = out.size();
+    out.resize(at + n);
+    if (n) std::memcpy(out.data() + at, p, n);
+  };
+  auto put_u32 = [&](uint32_t n) { put(&n, 4); };
+  auto put_text = [&](const std::string& s) { put_u32((uint32_t)s.size()); put(s.data(), s.size()); };
 
-int64_t as_int(const Value& x) {
-  if (auto p = std::get_if<int64_t>(&x.v)) return *p;
-  throw std::runtime_error("expected int");
+  out.push_back((uint8_t)x.tag);
+  switch (x.tag) {
+    case ValueTag::Unset: return;
+    case ValueTag::Int: put(&x.u.i, 8); return;
+    case ValueTag::Bool: out.push_back(x.u.b ? 1 : 0); return;
+    case ValueTag::Real: put(&x.u.r, 8); return;
+    case ValueTag::Result:
+      out.push_back(x.err == kErrNone ? 1 : 0);
+      if (x.err != kErrNone) put_text(error_text(x.err));
+      encode_value(out, result_payload(x));
+      return;
+    case ValueTag::Text: put_text(x.unbox<std::string>()); return;
+    case ValueTag::Record: {
+      auto& fields = x.unbox<Record>().fields;
+      put_u32((uint32_t)fields.size());
+      for (auto& kv : fields) {
+        put_text(kv.first);
+        encode_value(out, kv.second);
+      }
+      return;
+    }
+    case ValueTag::Array:
+    case ValueTag::Tuple: {
+      auto& elems = x.tag == ValueTag::Array ? x.unbox<Array>().elems : x.unbox<Tuple>().elems;
+      put_u32((uint32_t)elems.size());
+      for (auto& e : elems) encode_value(out, e);
+      return;
+    }
+  }
+  throw std::runtime_error("encode_value: unknown tag");
 }
 
-bool as_bool(const Value& x) {
-  if (auto p = std::get_if<bool>(&x.v)) return *p;
-  throw std::runtime_error("expected bool");
+namespace {
+
+struct Decoder {
+  const uint8_t*& p;
+  const uint8_t* end;
+
+  const uint8_t* take(size_t n) {
+    if ((size_t)(end - p) < n) throw std::runtime_error("truncated value encoding");
+    const uint8_t* at = p;
+    p += n;
+    return at;
+  }
+  uint32_t u32() { uint32_t n; std::memcpy(&n, take(4), 4); return n; }
+  std::string text() {
+    uint32_t n = u32();
+    return std::string((const char*)take(n), n);
+  }
+};
+
+} // namespace
+
+Value decode_value(const uint8_t*& p, const uint8_t* end) {
+  Decoder d{p, end};
+  auto tag = (ValueTag)*d.take(1);
+  switch (tag) {
+    case ValueTag::Unset: return Value::unset();
+    case ValueTag::Int: { int64_t i; std::memcpy(&i, d.take(8), 8); return Value::i(i); }
+    case ValueTag::Bool: return Value::b(*d.take(1) != 0);
+    case ValueTag::Real: { double r; std::memcpy(&r, d.take(8), 8); return Value::r(r); }
+    case ValueTag::Result: {
+      bool ok = *d.take(1) != 0;
+      uint32_t code = ok ? kErrNone : intern_error(d.text());
+      Value payload = decode_value(p, end);
+      return ok ? Value::ok(std::move(payload)) : Value::error(code);
+    }
+    case ValueTag::Text: return Value::s(d.text());
+    case ValueTag::Record: {
+      Record rec;
+      uint32_t n = d.u32();
+      for (uint32_t i = 0; i < n; i++) {
+        std::string k = d.text();
+        rec.fields.emplace(std::move(k), decode_value(p, end));
+      }
+      return Value::rec(std::move(rec));
+    }
+    case ValueTag::Array:
+    case ValueTag::Tuple: {
+      std::vector<Value> elems;
+      uint32_t n = d.u32();
+      elems.reserve(n);
+      for (uint32_t i = 0; i < n; i++) elems.push_back(decode_value(p, end));
+      return tag == ValueTag::Array ? Value::arr(Array{std::move(elems)}) : Value::tup(Tuple{std::move(elems)});
+    }
+  }
+  throw std::runtime_error("decode_value: unknown tag");
 }
 
-double as_real(const Value& x) {
-  if (auto p = std::get_if<double>(&x.v)) return *p;
-  throw std::runtime_error("expected real");
+std::string encoded_to_string(const uint8_t*& p, const uint8_t* end) {
+  if (p >= end) throw std::runtime_error("truncated value encoding");
+  Decoder d{p, end};
+  auto tag = (ValueTag)*p;
+
+  // aggregates are formatted here so nested record fields keep their order;
+  // scalars and text go through to_string
+  auto elems = [&](const char* open, const char* close) {
+    d.take(1);
+    uint32_t n = d.u32();
+    std::string s = open;
+    for (uint32_t i = 0; i < n; i++) {
+      if (i) s += ", ";
+      s += encoded_to_string(p, end);
+    }
+    return s + close;
+  };
+
+  switch (tag) {
+    case ValueTag::Record: {
+      d.take(1);
+      uint32_t n = d.u32();
+      std::string s = "{";
+      for (uint32_t i = 0; i < n; i++) {
+        if (i) s += ", ";
+        s += d.text();
+        s += "=";
+        s += encoded_to_string(p, end);
+      }
+      return s + "}";
+    }
+    case ValueTag::Array: return elems("[", "]");
+    case ValueTag::Tuple: return elems("(", ")");
+    case ValueTag::Result: {
+      const uint8_t* at = p;
+      d.take(1);
+      if (*d.take(1) == 0) {
+        p = at; // Err: the payload is unset, nothing to preserve
+        return to_string(decode_value(p, end));
+      }
+      return "{error=\"\", value=" + encoded_to_string(p, end) + ", ok=true}";
+    }
+    default: return to_string(decode_value(p, end));
+  }
 }
 
 const std::string& as_text(const Value& x) {
-  if (auto p = std::get_if<std::string>(&x.v)) return *p;
+  if (x.tag == ValueTag::Text) return x.unbox<std::string>();
   throw std::runtime_error("expected text");
 }
 
 const Record& as_record(const Value& x) {
-  if (auto p = std::get_if<Record>(&x.v)) return *p;
+  if (x.tag == ValueTag::Record) return x.unbox<Record>();
   throw std::runtime_error("expected record");
 }
 
 Record& as_record(Value& x) {
-  if (auto p = std::get_if<Record>(&x.v)) return *p;
+  if (x.tag == ValueTag::Record) return x.unbox_mut<Record>();
   throw std::runtime_error("expected record");
 }
 
 const Array& as_array(const Value& x) {
-  if (auto p = std::get_if<Array>(&x.v)) return *p;
+  if (x.tag == ValueTag::Array) return x.unbox<Array>();
   throw std::runtime_error("expected array");
 }
 
 Array& as_array(Value& x) {
-  if (auto p = std::get_if<Array>(&x.v)) return *p;
+  if (x.tag == ValueTag::Array) return x.unbox_mut<Array>();
   throw std::runtime_error("expected array");
 }
 
 const Tuple& as_tuple(const Value& x) {
-  if (auto p = std::get_if<Tuple>(&x.v)) return *p;
+  if (x.tag == ValueTag::Tuple) return x.unbox<Tuple>();
   throw std::runtime_error("expected tuple");
 }
 
 Tuple& as_tuple(Value& x) {
-  if (auto p = std::get_if<Tuple>(&x.v)) return *p;
+  if (x.tag == ValueTag::Tuple) return x.unbox_mut<Tuple>();
   throw std::runtime_error("expected tuple");
 }
 
@@ -1,10 +1,11 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <string>
-#include <variant>
 #include <vector>
 #include <unordered_map>
 #include <stdexcept>
+#include <utility>
 
 namespace caps {
 
@@ -20,40 +21,214 @@ struct Tuple {
   std::vector<struct Value> elems;
 };
 
+enum class ValueTag : uint8_t {
+  Unset,   // "unset"
+  Int,
+  Bool,
+  Real,
+  Result,  // Result<T,E>: payload kind in Value::sub, interned error code in Value::err
+           // (a Result payload is boxed: sub == Result, u.box is a Box<Value>)
+  // boxed (out-of-line, refcounted) from here on
+  Text,
+  Record,
+  Array,
+  Tuple
+};
+
+// Interned error codes carried by Result values. 0 means "no error" (ok);
+// every text, including "", interns to a code of its own.
+constexpr uint32_t kErrNone = 0;
+constexpr uint32_t kErrEmpty = 1; // built-in channel error "empty"
+
+// intern_error locks to add a code; error_text is lock-free (hot paths read
+// `.error` and unwrap Results on every step).
+uint32_t intern_error(const std::string& text);
+const std::string& error_text(uint32_t code);
+
+// Shared header of every out-of-line payload. Refcount is atomic so values may
+// cross worker threads; scalars never touch it.
+struct BoxHeader {
+  std::atomic<uint32_t> refs{1};
+};
+
+template <typename T>
+struct Box : BoxHeader {
+  T v;
+  explicit Box(T x) : v(std::move(x)) {}
+};
+
+// 16-byte tagged cell: int/bool/real inline, text and aggregates behind a
+// refcounted Box. Copying a scalar is a bit copy plus one flag test.
+// A Result keeps its payload in the same union (payload kind in `sub`), so
+// Ok(int)/Err(code) never allocate; only Ok(Result) boxes its payload.
 struct Value {
-  using V = std::variant<
-    std::monostate,        // "unset"
-    int64_t,
-    bool,
-    double,
-    std::string,
-    Record,
-    Array,
-    Tuple
-  >;
-
-  V v;
-
-  static Value unset() { return Value{std::monostate{}}; }
-  static Value i(int64_t x) { return Value{x}; }
-  static Value b(bool x) { return Value{x}; }
-  static Value r(double x) { return Value{x}; }
-  static Value s(std::string x) { return Value{std::move(x)}; }
-  static Value rec(Record x) { return Value{std::move(x)}; }
-  static Value arr(Array x) { return Value{std::move(x)}; }
-  static Value tup(Tuple x) { return Value{std::move(x)}; }
-
-  bool is_unset() const { return std::holds_alternative<std::monostate>(v); }
+  ValueTag tag = ValueTag::Unset;
+  ValueTag sub = ValueTag::Unset; // Result payload kind
+  bool boxed_ = false;            // u.box owns a reference
+  uint8_t pad_ = 0;
+  uint32_t err = kErrNone;        // Result error code
+  union {
+    int64_t i;
+    bool b;
+    double r;
+    BoxHeader* box;
+  } u{0};
+
+  Value() = default;
+  Value(const Value& o) : tag(o.tag), sub(o.sub), boxed_(o.boxed_), err(o.err), u(o.u) { if (boxed_) retain(); }
+  Value(Value&& o) noexcept : tag(o.tag), sub(o.sub), boxed_(o.boxed_), err(o.err), u(o.u) {
+    o.tag = ValueTag::Unset;
+    o.boxed_ = false;
+  }
+  Value& operator=(const Value& o) {
+    if (this != &o) { Value tmp(o); swap(tmp); }
+    return *this;
+  }
+  Value& operator=(Value&& o) noexcept {
+    if (this != &o) { Value tmp(std::move(o)); swap(tmp); }
+    return *this;
+  }
+  ~Value() { if (boxed_) release(); }
+
+  void swap(Value& o) noexcept {
+    std::swap(tag, o.tag);
+    std::swap(sub, o.sub);
+    std::swap(boxed_, o.boxed_);
+    std::swap(err, o.err);
+    std::swap(u, o.u);
+  }
+
+  static Value unset() { return Value{}; }
+  static Value i(int64_t x) { Value v; v.tag = ValueTag::Int; v.u.i = x; return v; }
+  static Value b(bool x) { Value v; v.tag = ValueTag::Bool; v.u.i = 0; v.u.b = x; return v; }
+  static Value r(double x) { Value v; v.tag = ValueTag::Real; v.u.r = x; return v; }
+  static Value s(std::string x) { return boxed(ValueTag::Text, std::move(x)); }
+  static Value rec(Record x) { return boxed(ValueTag::Record, std::move(x)); }
+  static Value arr(Array x) { return boxed(ValueTag::Array, std::move(x)); }
+  static Value tup(Tuple x) { return boxed(ValueTag::Tuple, std::move(x)); }
+
+  // Result<T,E>: Ok carries `payload` inline; Err carries only an interned code.
+  static Value ok(Value payload) {
+    if (payload.tag == ValueTag::Result) {
+      Value v = boxed(ValueTag::Result, std::move(payload));
+      v.sub = ValueTag::Result;
+      return v;
+    }
+    Value v(std::move(payload));
+    v.sub = v.tag;
+    v.tag = ValueTag::Result;
+    v.err = kErrNone;
+    return v;
+  }
+  static Value error(uint32_t code) {
+    Value v;
+    v.tag = ValueTag::Result;
+    v.err = code;
+    return v;
+  }
+
+  bool is_unset() const { return tag == ValueTag::Unset; }
+  bool is_boxed() const { return boxed_; }
+
+  // payload access for boxed tags (caller checks tag)
+  template <typename T> const T& unbox() const { return static_cast<const Box<T>*>(u.box)->v; }
+  template <typename T> T& unbox_mut();
+
+private:
+  template <typename T>
+  static Value boxed(ValueTag t, T x) {
+    Value v;
+    v.tag = t;
+    v.u.box = new Box<T>(std::move(x));
+    v.boxed_ = true;
+    return v;
+  }
+
+  void retain() const { u.box->refs.fetch_add(1, std::memory_order_relaxed); }
+  void release();
 };
 
+static_assert(sizeof(Value) == 16, "Value must stay a 16-byte cell");
+
+// Copy-on-write: detaches a shared payload before handing out a mutable ref.
+template <typename T>
+T& Value::unbox_mut() {
+  auto* bx = static_cast<Box<T>*>(u.box);
+  if (bx->refs.load(std::memory_order_acquire) != 1) {
+    auto* fresh = new Box<T>(bx->v);
+    release();
+    u.box = fresh;
+    bx = fresh;
+  }
+  return bx->v;
+}
+
 std::string to_string(const Value& x);
 
-bool is_truthy(const Value& x);
+// Binary encoding shared by checkpoints and binary traces: a tag byte, then
+// the payload in native byte order. A Result is an ok byte, the error text
+// (Err only: codes are only stable within one process), then the payload.
+void encode_value(std::vector<uint8_t>& out, const Value& x);
+
+// Decodes the value at p and advances p past it. Throws std::runtime_error if
+// the encoding runs past end.
+Value decode_value(const uint8_t*& p, const uint8_t* end);
+
+// Formats the value at p (advancing p) exactly as to_string formats the value
+// it was encoded from. Unlike decode_value + to_string, record fields keep the
+// order they were encoded in, which a rebuilt unordered_map would not.
+std::string encoded_to_string(const uint8_t*& p, const uint8_t* end);
+
+[[noreturn]] void value_type_error(const char* what);
+
+inline bool is_truthy(const Value& x) {
+  if (x.tag == ValueTag::Bool) return x.u.b;
+  value_type_error("truthiness requires bool");
+}
 
 // strict typed access (runtime error if mismatch)
-int64_t as_int(const Value& x);
-bool as_bool(const Value& x);
-double as_real(const Value& x);
+inline int64_t as_int(const Value& x) {
+  if (x.tag == ValueTag::Int) return x.u.i;
+  value_type_error("expected int");
+}
+
+inline bool as_bool(const Value& x) {
+  if (x.tag == ValueTag::Bool) return x.u.b;
+  value_type_error("expected bool");
+}
+
+inline double as_real(const Value& x) {
+  if (x.tag == ValueTag::Real) return x.u.r;
+  value_type_error("expected real");
+}
+
+// Result fast paths (see result.h for the make_/result_ helpers)
+inline bool result_is_ok(const Value& x) {
+  if (x.tag == ValueTag::Result) return x.err == kErrNone;
+  value_type_error("expected result");
+}
+
+// Ok payload as a plain Value (Unset for Err).
+inline Value result_payload(const Value& x) {
+  if (x.tag != ValueTag::Result) value_type_error("expected result");
+  if (x.sub == ValueTag::Result) return x.unbox<Value>();
+  Value v(x);
+  v.tag = v.sub;
+  v.sub = ValueTag::Unset;
+  v.err = kErrNone;
+  return v;
+}
+
+inline Value result_payload(Value&& x) {
+  if (x.tag != ValueTag::Result) value_type_error("expected result");
+  if (x.sub == ValueTag::Result) return x.unbox<Value>();
+  Value v(std::move(x));
+  v.tag = v.sub;
+  v.sub = ValueTag::Unset;
+  v.err = kErrNone;
+  return v;
+}
+
 const std::string& as_text(const Value& x);
 const Record& as_record(const Value& x);
 Record& as_record(Value& x);
@@ -0,0 +1,92 @@
+#include "backend/value.h"
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// CAPS Value layout microbenchmark
+// Compares the compact 16-byte caps::Value against the previous std::variant layout.
+// Build: make value_bench (CMake target, excluded from the default build)
+
+namespace legacy {
+
+struct Record { std::unordered_map<std::string, struct Value> fields; };
+struct Array { std::vector<struct Value> elems; };
+struct Tuple { std::vector<struct Value> elems; };
+
+struct Value {
+  std::variant<std::monostate, int64_t, bool, double, std::string, Record, Array, Tuple> v;
+  static Value i(int64_t x) { return Value{x}; }
+  static Value s(std::string x) { return Value{std::move(x)}; }
+};
+
+inline int64_t as_int(const Value& x) {
+  if (auto p = std::get_if<int64_t>(&x.v)) return *p;
+  throw std::runtime_error("expected int");
+}
+
+} // namespace legacy
+
+static volatile int64_t sink;
+
+template <typename F>
+static double time_ns_per_op(size_t ops, F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / (double)ops;
+}
+
+template <typename V, typename MakeInt, typename AsInt>
+static void bench_layout(const char* label, MakeInt mk, AsInt get) {
+  const size_t N = 1'000'000;
+  const int ROUNDS = 20;
+
+  std::vector<V> src;
+  src.reserve(N);
+  for (size_t i = 0; i < N; i++) src.push_back(mk((int64_t)i));
+
+  // copy int-carrying cells (process locals / Assign)
+  double copy_ns = time_ns_per_op(N * ROUNDS, [&] {
+    std::vector<V> dst(N);
+    for (int r = 0; r < ROUNDS; r++) {
+      for (size_t i = 0; i < N; i++) dst[i] = src[i];
+    }
+    sink = get(dst[N - 1]);
+  });
+
+  // read back through the typed accessor
+  double read_ns = time_ns_per_op(N * ROUNDS, [&] {
+    int64_t sum = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+      for (size_t i = 0; i < N; i++) sum += get(src[i]);
+    }
+    sink = sum;
+  });
+
+  // FIFO traffic (channel buffer)
+  double fifo_ns = time_ns_per_op(N * ROUNDS, [&] {
+    std::deque<V> q;
+    int64_t sum = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+      for (size_t i = 0; i < N; i++) {
+        q.push_back(src[i]);
+        if (q.size() > 64) { sum += get(q.front()); q.pop_front(); }
+      }
+    }
+    sink = sum;
+  });
+
+  std::cout << label << ": sizeof=" << sizeof(V)
+            << " copy=" << copy_ns << "ns read=" << read_ns << "ns fifo=" << fifo_ns << "ns\n";
+}
+
+int main() {
+  bench_layout<legacy::Value>("variant", legacy::Value::i, legacy::as_int);
+  bench_layout<caps::Value>("compact", caps::Value::i, [](const caps::Value& v) { return caps::as_int(v); });
+  return 0;
+}
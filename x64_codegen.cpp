@@ -1,4 +1,5 @@
 #include "x64_codegen.h"
+#include "backend/x64_encoder.h"
 #include <fstream>
 #include <iomanip>
 #include <sstream>
@@ -35,54 +36,7 @@ namespace caps::x64 {
 #define IMAGE_REL_AMD64_REL32            0x0004u
 #define IMAGE_REL_AMD64_ADDR32NB         0x0003u
 
-// Encoder for x86-64 instructions
-struct Encoder {
-  std::vector<uint8_t> code;
-  std::vector<std::pair<uint32_t, std::string>> relocs; // site, symbol
-  std::vector<std::pair<uint32_t, uint32_t>> fixups; // site, target_offset
-
-  void emit_u8(uint8_t v) { code.push_back(v); }
-  void emit_u16(uint16_t v) { emit_u8(v & 0xFF); emit_u8((v >> 8) & 0xFF); }
-  void emit_u32(uint32_t v) { emit_u16(v & 0xFFFF); emit_u16((v >> 16) & 0xFFFF); }
-  void emit_u64(uint64_t v) { emit_u32(v & 0xFFFFFFFF); emit_u32((v >> 32) & 0xFFFFFFFF); }
-
-  // Common instructions
-  void mov_r64_imm64(uint8_t reg, uint64_t imm) {
-    uint8_t rex = 0x48;
-    if (reg >= 8) rex |= 0x01;
-    emit_u8(rex);
-    emit_u8(0xB8 + (reg & 7));
-    emit_u64(imm);
-  }
-
-  void sub_rsp_imm8(uint8_t imm) {
-    emit_u8(0x48); emit_u8(0x83); emit_u8(0xEC); emit_u8(imm);
-  }
-
-  void add_rsp_imm8(uint8_t imm) {
-    emit_u8(0x48); emit_u8(0x83); emit_u8(0xC4); emit_u8(imm);
-  }
-
-  void push_r64(uint8_t reg) {
-    emit_u8(0x50 + reg);
-  }
-
-  void pop_r64(uint8_t reg) {
-    emit_u8(0x58 + reg);
-  }
-
-  void call_rel32(const std::string& sym = "") {
-    emit_u8(0xE8); uint32_t pos = code.size(); emit_u32(0);
-    if (!sym.empty()) relocs.emplace_back(pos, sym);
-  }
-
-  void jmp_rel32() { emit_u8(0xE9); emit_u32(0); }
-  void jcc_rel32(uint8_t cc) { emit_u8(0x0F); emit_u8(0x80 + cc); emit_u32(0); }
-
-  void ret() { emit_u8(0xC3); }
-
-  // Add more as needed for full encoding
-};
+// Encoder: see x64_encoder.h
 
 // Function builders (Milestone 4 locked prolog: push r12; push r13; sub rsp, 0x58)
 void build_function_prolog(Encoder& enc) {
@@ -321,4 +275,4 @@ X64Module emit_x64(const IRProgram& ir) {
   return mod;
 }
 
-} // namespace caps::x64
\ No newline at end of file
+} // namespace caps::x64
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caps::x64 {
+
+// x86-64 instruction encoder shared by the COFF backend (x64_codegen.cpp) and
+// the in-process JIT (jit.cpp). Memory operands are [base + disp32].
+
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// condition codes, as in jcc / setcc
+enum Cond : uint8_t { O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G };
+
+struct Encoder {
+  std::vector<uint8_t> code;
+  std::vector<std::pair<uint32_t, std::string>> relocs; // site, symbol
+  std::vector<std::pair<uint32_t, uint32_t>> fixups;    // rel32 site, label
+  std::vector<uint32_t> labels;                          // label -> offset (UINT32_MAX: unbound)
+
+  void emit_u8(uint8_t v) { code.push_back(v); }
+  void emit_u16(uint16_t v) { emit_u8(v & 0xFF); emit_u8((v >> 8) & 0xFF); }
+  void emit_u32(uint32_t v) { emit_u16(v & 0xFFFF); emit_u16((v >> 16) & 0xFFFF); }
+  void emit_u64(uint64_t v) { emit_u32(v & 0xFFFFFFFF); emit_u32((v >> 32) & 0xFFFFFFFF); }
+
+  // --- labels ---
+  uint32_t new_label() { labels.push_back(UINT32_MAX); return (uint32_t)labels.size() - 1; }
+  void bind(uint32_t label) { labels[label] = (uint32_t)code.size(); }
+
+  // Patches every rel32 jump to its label; false if a label was never bound.
+  bool patch_fixups() {
+    for (auto& f : fixups) {
+      uint32_t to = labels[f.second];
+      if (to == UINT32_MAX) return false;
+      uint32_t rel = to - (f.first + 4);
+      for (int i = 0; i < 4; i++) code[f.first + i] = (uint8_t)(rel >> (8 * i));
+    }
+    fixups.clear();
+    return true;
+  }
+
+  // --- encoding helpers ---
+  void rex(bool w, uint8_t reg, uint8_t rm, bool force = false) {
+    uint8_t r = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (r != 0x40 || force) emit_u8(r);
+  }
+  void modrm_reg(uint8_t reg, uint8_t rm) { emit_u8(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+  void modrm_mem(uint8_t reg, uint8_t base, int32_t disp) {
+    emit_u8(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) emit_u8(0x24); // SIB: [base] for rsp / r12
+    emit_u32((uint32_t)disp);
+  }
+
+  // --- moves ---
+  void mov_r64_imm64(uint8_t reg, uint64_t imm) {
+    rex(true, 0, reg);
+    emit_u8(0xB8 + (reg & 7));
+    emit_u64(imm);
+  }
+  void mov_r64_imm32(uint8_t reg, int32_t imm) { rex(true, 0, reg); emit_u8(0xC7); modrm_reg(0, reg); emit_u32((uint32_t)imm); }
+  void mov_r32_imm32(uint8_t reg, uint32_t imm) { rex(false, 0, reg); emit_u8(0xB8 + (reg & 7)); emit_u32(imm); }
+  void mov_r64_r64(uint8_t dst, uint8_t src) { rex(true, src, dst); emit_u8(0x89); modrm_reg(src, dst); }
+  void mov_r64_m64(uint8_t dst, uint8_t base, int32_t disp) { rex(true, dst, base); emit_u8(0x8B); modrm_mem(dst, base, disp); }
+  void mov_m64_r64(uint8_t base, int32_t disp, uint8_t src) { rex(true, src, base); emit_u8(0x89); modrm_mem(src, base, disp); }
+  void mov_m64_imm32(uint8_t base, int32_t disp, int32_t imm) {
+    rex(true, 0, base); emit_u8(0xC7); modrm_mem(0, base, disp); emit_u32((uint32_t)imm);
+  }
+  void movzx_r32_m8(uint8_t dst, uint8_t base, int32_t disp) {
+    rex(false, dst, base); emit_u8(0x0F); emit_u8(0xB6); modrm_mem(dst, base, disp);
+  }
+  void movzx_r32_r8(uint8_t dst, uint8_t src) { rex(false, dst, src, src >= 4); emit_u8(0x0F); emit_u8(0xB6); modrm_reg(dst, src); }
+
+  // --- arithmetic / compare (64-bit unless noted) ---
+  void alu_r64_r64(uint8_t op, uint8_t dst, uint8_t src) { rex(true, src, dst); emit_u8(op); modrm_reg(src, dst); }
+  void add_r64_r64(uint8_t dst, uint8_t src) { alu_r64_r64(0x01, dst, src); }
+  void sub_r64_r64(uint8_t dst, uint8_t src) { alu_r64_r64(0x29, dst, src); }
+  void and_r64_r64(uint8_t dst, uint8_t src) { alu_r64_r64(0x21, dst, src); }
+  void or_r64_r64(uint8_t dst, uint8_t src) { alu_r64_r64(0x09, dst, src); }
+  void cmp_r64_r64(uint8_t a, uint8_t b) { alu_r64_r64(0x39, a, b); }
+  void test_r64_r64(uint8_t a, uint8_t b) { alu_r64_r64(0x85, a, b); }
+  void test_r32_r32(uint8_t a, uint8_t b) { rex(false, b, a); emit_u8(0x85); modrm_reg(b, a); }
+  void imul_r64_r64(uint8_t dst, uint8_t src) { rex(true, dst, src); emit_u8(0x0F); emit_u8(0xAF); modrm_reg(dst, src); }
+  void cqo() { emit_u8(0x48); emit_u8(0x99); }
+  void idiv_r64(uint8_t src) { rex(true, 0, src); emit_u8(0xF7); modrm_reg(7, src); }
+  void cmp_r32_imm8(uint8_t reg, int8_t imm) { rex(false, 0, reg); emit_u8(0x83); modrm_reg(7, reg); emit_u8((uint8_t)imm); }
+  void cmp_m8_imm8(uint8_t base, int32_t disp, uint8_t imm) { rex(false, 0, base); emit_u8(0x80); modrm_mem(7, base, disp); emit_u8(imm); }
+  void cmp_m32_imm8(uint8_t base, int32_t disp, int8_t imm) {
+    rex(false, 0, base); emit_u8(0x83); modrm_mem(7, base, disp); emit_u8((uint8_t)imm);
+  }
+  void cmp_m64_r64(uint8_t base, int32_t disp, uint8_t src) { rex(true, src, base); emit_u8(0x39); modrm_mem(src, base, disp); }
+  void setcc_r8(uint8_t cc, uint8_t reg) { rex(false, 0, reg, reg >= 4); emit_u8(0x0F); emit_u8(0x90 + cc); modrm_reg(0, reg); }
+
+  // --- stack / control flow ---
+  void sub_rsp_imm8(uint8_t imm) {
+    emit_u8(0x48); emit_u8(0x83); emit_u8(0xEC); emit_u8(imm);
+  }
+
+  void add_rsp_imm8(uint8_t imm) {
+    emit_u8(0x48); emit_u8(0x83); emit_u8(0xC4); emit_u8(imm);
+  }
+
+  void push_r64(uint8_t reg) {
+    rex(false, 0, reg);
+    emit_u8(0x50 + (reg & 7));
+  }
+
+  void pop_r64(uint8_t reg) {
+    rex(false, 0, reg);
+    emit_u8(0x58 + (reg & 7));
+  }
+
+  void call_rel32(const std::string& sym = "") {
+    emit_u8(0xE8); uint32_t pos = code.size(); emit_u32(0);
+    if (!sym.empty()) relocs.emplace_back(pos, sym);
+  }
+  void call_r64(uint8_t reg) { rex(false, 0, reg); emit_u8(0xFF); modrm_reg(2, reg); }
+
+  void jmp_rel32() { emit_u8(0xE9); emit_u32(0); }
+  void jcc_rel32(uint8_t cc) { emit_u8(0x0F); emit_u8(0x80 + cc); emit_u32(0); }
+  void jmp(uint32_t label) { jmp_rel32(); fixups.emplace_back((uint32_t)code.size() - 4, label); }
+  void jcc(uint8_t cc, uint32_t label) { jcc_rel32(cc); fixups.emplace_back((uint32_t)code.size() - 4, label); }
+
+  void ret() { emit_u8(0xC3); }
+};
+
+} // namespace caps::x64